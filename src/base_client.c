@@ -38,12 +38,10 @@ base_client_new(Wm *w, Window win)
 
    dbg("%s() called  \n", __func__);
 
-   c = malloc(sizeof(Client));
+   c = slab_alloc(&slab_clients);
 
    if (c == NULL) return NULL;
 
-   memset(c, 0, sizeof(Client));
-
    /* Stardard bits */
    
    c->type    = MBCLIENT_TYPE_APP; /* start off with common case */
@@ -69,6 +67,7 @@ base_client_new(Wm *w, Window win)
 
    /* Basic attributes */
 
+   STATS_ROUND_TRIP();
    XGetWindowAttributes(w->dpy, win, &attr);
 
    /*
@@ -96,8 +95,11 @@ base_client_new(Wm *w, Window win)
    c->width  = attr.width;
    c->height = attr.height;
 
+   c->output = wm_output_at(w, c->x + c->width/2, c->y + c->height/2);
+
    c->gravity = NorthWestGravity;
 
+   STATS_ROUND_TRIP();
    if (XGetWMNormalHints(w->dpy, c->window, &sz_hints, &mask))
      {
        if (mask & PWinGravity)
@@ -120,6 +122,7 @@ base_client_new(Wm *w, Window win)
     *     resized.                                                   )
     */
 
+   STATS_ROUND_TRIP();
    if ( !XGetWMNormalHints(w->dpy, c->window, c->size, &icccm_mask) )
    {
       c->width = attr.width;
@@ -149,6 +152,7 @@ base_client_new(Wm *w, Window win)
 
    /* WM Hints */
 
+   STATS_ROUND_TRIP();
    if ((wmhints = XGetWMHints(w->dpy, c->window)) != NULL)
    {
      dbg("%s() checking WMHints\n", __func__);
@@ -204,6 +208,7 @@ base_client_new(Wm *w, Window win)
      
    /* Where is client running ? */
 
+  STATS_ROUND_TRIP();
   if (XGetWMClientMachine(c->wm->dpy, c->window, &text_prop))
   {
     c->host_machine = strdup((char *) text_prop.value);
@@ -213,12 +218,12 @@ base_client_new(Wm *w, Window win)
   
   /* EWMH PID */
 
-  if (XGetWindowProperty (w->dpy, win, 
-			  w->atoms[_NET_WM_PID],
-			  0, 2L,
-			  False, XA_CARDINAL,
-			  &type, &format, &n_items,
-			  &bytes_after, (unsigned char **)&data) == Success
+  if (stats_xget_window_property(w->dpy, win, 
+				 w->atoms[_NET_WM_PID],
+				 0, 2L,
+				 False, XA_CARDINAL,
+				 &type, &format, &n_items, &bytes_after,
+				 (unsigned char **)&data) == Success
       && n_items && data != NULL)
     {
       c->pid = *data;
@@ -236,15 +241,15 @@ base_client_new(Wm *w, Window win)
 
   /* EWMH User time - only support value being set to 0 */
 
-  if (XGetWindowProperty(w->dpy, win,
-			 w->atoms[_NET_WM_USER_TIME], 
-			 0L, 2L, False,
-			 XA_CARDINAL, 
-			 &type, 
-			 &format,
-			 &n_items, 
-			 &bytes_after,
-			 (unsigned char **) &data) == Success
+  if (stats_xget_window_property(w->dpy, win,
+				 w->atoms[_NET_WM_USER_TIME], 
+				 0L, 2L, False,
+				 XA_CARDINAL, 
+				 &type, 
+				 &format,
+				 &n_items, 
+				 &bytes_after,
+				 (unsigned char **) &data) == Success
       && n_items && data != NULL && *data == 0)
     c->flags |= CLIENT_NO_FOCUS_ON_MAP;
 
@@ -271,6 +276,7 @@ base_client_new(Wm *w, Window win)
 
    client_set_state(c, WithdrawnState);
 
+   STATS_ROUND_TRIP();
    XSync(w->dpy, False);
    if (misc_untrap_xerrors()) 	/* An X error occured */
      {				/* Likely client died */
@@ -305,6 +311,7 @@ base_client_process_name(Client *c)
     {
       c->name_is_utf8 = False;
       
+      STATS_ROUND_TRIP();
       if (XGetWMName(w->dpy, c->window, &text_prop) != 0)
 	{
 	  dbg("%s() name is from XGetWMName\n", __func__ );
@@ -315,11 +322,13 @@ base_client_process_name(Client *c)
 	}
       else
 	{
+	  STATS_ROUND_TRIP();
 	  XFetchName(w->dpy, c->window, (char **)&c->name);
 
 	  if (c->name == NULL) 
 	    {
 	      XStoreName(w->dpy, c->window, "<unnamed>");
+	      STATS_ROUND_TRIP();
 	      XFetchName(w->dpy, c->window, (char **) &c->name);
 
 	      if (c->name == NULL) 
@@ -367,6 +376,7 @@ base_client_process_name(Client *c)
 	  free(c->name);
 
 	  XStoreName(w->dpy, c->window, tmp_name);
+	  STATS_ROUND_TRIP();
 	  XFetchName(w->dpy, c->window, (char **)&c->name);
 	}
     }
@@ -430,6 +440,11 @@ base_client_move_resize(Client *c)
 {
   int i;
 
+  c->layout_x      = c->x;
+  c->layout_y      = c->y;
+  c->layout_width  = c->width;
+  c->layout_height = c->height;
+
    for (i=0; i<MSK_COUNT; i++)
      if (c->backing_masks[i] != None)
        {
@@ -497,10 +512,16 @@ base_client_destroy(Client *c)
 	       input_method = p;
 	     }
 	   else
-	     p->trans = c->trans;
+	     {
+	       p->trans = c->trans;
+	       stack_update_trans(p);
+	     }
 	 }
 #else
-	 p->trans = c->trans;
+	 {
+	   p->trans = c->trans;
+	   stack_update_trans(p);
+	 }
 #endif
      }
 
@@ -518,32 +539,37 @@ base_client_destroy(Client *c)
 
    comp_engine_client_destroy(w, c);
 
+   client_decor_queue_remove(c);
+
+   client_layout_queue_remove(c);
+
+#ifdef USE_XSYNC
+   ewmh_sync_client_destroy(c);
+#endif
+
    list_remove(&w->client_age_list, (void*)c);
 
    stack_remove(c);
 
    /* Now free up various resources */
 
-   if (c->type != MBCLIENT_TYPE_OVERRIDE)
-     {
-       client_buttons_delete_all(c);
+   client_buttons_delete_all(c);
        
-       if (c->frame && c->frame != c->window) 
-	 {
-	   XDestroySubwindows(w->dpy, c->frame);
-	   XDestroyWindow(w->dpy, c->frame);
-	 }
+   if (c->frame && c->frame != c->window) 
+     {
+       XDestroySubwindows(w->dpy, c->frame);
+       XDestroyWindow(w->dpy, c->frame);
+     }
 
-       for (i=0; i<MSK_COUNT; i++)
-	 if (c->backing_masks[i] != None)
-	   XFreePixmap(w->dpy, c->backing_masks[i]);
+   for (i=0; i<MSK_COUNT; i++)
+     if (c->backing_masks[i] != None)
+       XFreePixmap(w->dpy, c->backing_masks[i]);
 
-       /* No need to free up pixmap icon data client resource  */
+   /* No need to free up pixmap icon data client resource  */
 
-       if (c->icon_rgba_data) XFree(c->icon_rgba_data);
+   if (c->icon_rgba_data) XFree(c->icon_rgba_data);
 
-       XUngrabButton(w->dpy, Button1, 0, c->window);
-     }    
+   XUngrabButton(w->dpy, Button1, 0, c->window);
 
     if (c->name)         XFree(c->name);
     if (c->startup_id)   XFree(c->startup_id);
@@ -556,18 +582,26 @@ base_client_destroy(Client *c)
     /* Be sure to flush out all calls before we untrap.
      * Important here as the above does alot.
     */
+    STATS_ROUND_TRIP();
     XSync(w->dpy, False);
     misc_untrap_xerrors();
 
     ewmh_update_lists(w); 
 
-    free(c);
-
 #ifdef USE_ALT_INPUT_WIN
     if (input_method)
       {
-	 /* were now gone */
+	 /* were now gone, off our transient list before it's freed */
 	input_method->trans = NULL;
+	stack_update_trans(input_method);
+      }
+#endif
+
+    slab_free(&slab_clients, c);
+
+#ifdef USE_ALT_INPUT_WIN
+    if (input_method)
+      {
 	/* Hide will destroy the client */
 	input_method->hide(input_method);
       }
@@ -50,11 +50,11 @@ client_get_state(Client *c)
 
   misc_trap_xerrors(); 
 
-  if (XGetWindowProperty(w->dpy, c->window,
-			 w->atoms[WM_STATE], 0L, 2L, False,
-			 w->atoms[WM_STATE], &real_type, &real_format,
-			 &items_read, &items_left,
-			 (unsigned char **) &data) == Success
+  if (stats_xget_window_property(w->dpy, c->window,
+				 w->atoms[WM_STATE], 0L, 2L, False,
+				 w->atoms[WM_STATE], &real_type, &real_format,
+				 &items_read, &items_left,
+				 (unsigned char **) &data) == Success
       && items_read)
     state = *data;
 
@@ -73,6 +73,12 @@ client_deliver_config(Client *c)
 {
   Wm *w = c->wm;
   XConfigureEvent ce;
+
+#ifdef USE_XSYNC
+  /* Frame not resized yet, sync_client_done() sends this once it is */
+  if (c->ewmh_sync_pending)
+    return;
+#endif
    
   ce.type = ConfigureNotify;
   ce.event = c->window;
@@ -112,6 +118,7 @@ client_get_wm_protocols(Client *c)
 
   misc_trap_xerrors();
 
+  STATS_ROUND_TRIP();
   status = XGetWMProtocols(c->wm->dpy, c->window, &protocols, &n);
 
   if (status && n && !misc_untrap_xerrors()) 
@@ -186,6 +193,7 @@ client_deliver_message(Client       *c,
 
   XSendEvent(w->dpy, c->window, False, NoEventMask, &ev);
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
 }
 
@@ -230,6 +238,7 @@ client_deliver_delete(Client *c)
   int   i, n, found = 0;
   Atom *protocols;
     
+  STATS_ROUND_TRIP();
   if (XGetWMProtocols(w->dpy, c->window, &protocols, &n)) {
     for (i=0; i<n; i++)
       if (protocols[i] == w->atoms[WM_DELETE_WINDOW]) found++;
@@ -262,6 +271,7 @@ client_want_focus(Client *c)
 
   misc_trap_xerrors(); 
 
+  STATS_ROUND_TRIP();
   hints = XGetWMHints(w->dpy, c->window);
 
   /* TODO: Oddly the above will sometimes fire an X Error, yet hints get set. 
@@ -351,12 +361,53 @@ client_set_focus(Client *c)
 }
 
 
+/* Adds p to a transient list, keeping it in stack order */
+static void
+client_transient_list_insert(MBList **list, Client *p)
+{
+  MBList **link = list, *item;
+
+  while (*link != NULL 
+	 && ((Client *)(*link)->data)->stack_order < p->stack_order)
+    link = &(*link)->next;
+
+  item       = list_new(0, NULL, p);
+  item->next = *link;
+  *link      = item;
+}
+
+static void
+client_get_transient_list_recurse(Wm *w, MBList **list, Client *c)
+{
+  Client *p = NULL;
+
+  stack_enumerate_transients(w, p, c)
+    {
+      if (p->type == MBCLIENT_TYPE_DIALOG)
+	client_transient_list_insert(list, p);
+
+      client_get_transient_list_recurse(w, list, p);
+    }
+}
+
 void
 client_get_transient_list(Wm *w, MBList **list, Client *c)
 {
   Client *p = NULL;
 
-  stack_enumerate(w,p)
+  if (c != NULL)
+    {
+      /* Follow transients 'down' through each clients own list */
+      client_get_transient_list_recurse(w, list, c);
+
+      /* App windows with matchbox window groups 'share' transients,
+       * those still need a look at every dialog. */
+      if (!c->win_group 
+	  || (c->type != MBCLIENT_TYPE_APP && c->type != MBCLIENT_TYPE_DESKTOP))
+	return;
+    }
+
+  stack_enumerate_type(w, p, MBCLIENT_TYPE_DIALOG)
     {
       if (p != c && p->type == MBCLIENT_TYPE_DIALOG)
 	{
@@ -388,37 +439,19 @@ client_get_transient_list(Wm *w, MBList **list, Client *c)
 		    list_add(list, NULL, 0, p);
 		}
 	    }
-	  else
+	  else if (trans != NULL)
 	    {
-	      /* Follow transients 'down', for a match. */
-
-	      while (trans != NULL && trans != c)
+	      /* Handle window groups and transiency, skipping those
+	       * already found above. 
+	       */
+	      while (trans->trans != NULL && trans != c)
 		trans = trans->trans;
-	      
-	      if (trans == c)
-		{
-		  list_add(list, NULL, 0, p);
-		}
-	      else if (p->trans 
-		       && c->win_group 
-		       && (c->type == MBCLIENT_TYPE_APP
-			   || c->type == MBCLIENT_TYPE_DESKTOP))
-		{
-		  /* Handle window groups and transiency. 
-		   * App windows with matchbox window groups
-                   * 'share' transients  
-		  */
-		  trans = p->trans;
-
-		  while (trans->trans != NULL)
-		    trans = trans->trans;
-
-		  if ((trans->type == MBCLIENT_TYPE_APP
-		       || trans->type == MBCLIENT_TYPE_DESKTOP)
-		      && trans->win_group == c->win_group) 
-		    list_add(list, NULL, 0, p);
-		}
 
+	      if (trans != c
+		  && (trans->type == MBCLIENT_TYPE_APP
+		      || trans->type == MBCLIENT_TYPE_DESKTOP)
+		  && trans->win_group == c->win_group) 
+		client_transient_list_insert(list, p);
 	    }
 	}
     }
@@ -701,9 +734,7 @@ client_button_new(Client *c,
 		  Bool    want_inputonly, 
 		  void   *data )
 {
-  MBClientButton      *b = malloc(sizeof(MBClientButton));
-
-  memset(b, 0, sizeof(MBClientButton));
+  MBClientButton      *b = slab_alloc(&slab_buttons);
 
   client_button_init(c, win_parent, b, 
 		     x, y, width, height, 
@@ -746,15 +777,164 @@ client_buttons_delete_all(Client *c)
       dbg("%s() destroying a button\n", __func__); 
       if (b->win != None)
 	XDestroyWindow(w->dpy, b->win);
-      free(b);
+      slab_free(&slab_buttons, b);
       p = l->next;
-      free(l);
+      if (l->name) free(l->name);
+      slab_free(&slab_list_items, l);
       l = p;
     }
 
   c->buttons = NULL;
 }
 
+/* Decoration repaints are queued and done once per event loop iteration
+ * so a client touched several times while handling an event ( or by a 
+ * relayout of every window ) only gets painted once. 
+ */
+void
+client_decor_queue_redraw(Client *c, int frames)
+{
+  Wm *w = c->wm;
+
+  c->decor_dirty |= frames;
+
+  if (c->decor_queued) return;
+
+  c->decor_next   = w->decor_queue;
+  c->decor_queued = True;
+  w->decor_queue  = c;
+}
+
+void
+client_decor_queue_remove(Client *c)
+{
+  Wm     *w = c->wm;
+  Client *p = NULL;
+
+  if (!c->decor_queued) return;
+
+  if (w->decor_queue == c)
+    w->decor_queue = c->decor_next;
+  else
+    for (p = w->decor_queue; p != NULL; p = p->decor_next)
+      if (p->decor_next == c)
+	{
+	  p->decor_next = c->decor_next;
+	  break;
+	}
+
+  c->decor_next   = NULL;
+  c->decor_queued = False;
+}
+
+/* Paint any dirty frames now */
+void
+client_decor_flush(Client *c)
+{
+  if (!c->decor_dirty) return;
+
+  dbg("%s() repainting frames 0x%x for %s\n", 
+      __func__, c->decor_dirty, c->name);
+
+  c->decor_paint_mask = c->decor_dirty;
+  c->decor_dirty      = 0;
+
+  c->redraw(c, False);
+
+  c->decor_paint_mask = 0;
+}
+
+void
+client_decor_queue_flush(Wm *w)
+{
+  Client *c = NULL;
+
+  while ((c = w->decor_queue) != NULL)
+    {
+      w->decor_queue  = c->decor_next;
+      c->decor_next   = NULL;
+      c->decor_queued = False;
+
+      /* Apps not on show keep their dirty frames, main_client_show()
+       * will paint them if they ever come forward.
+       */
+      if (c->type == MBCLIENT_TYPE_APP
+	  && (!c->mapped || c != wm_get_visible_main_client(w)))
+	continue;
+
+      client_decor_flush(c);
+    }
+}
+
+/* Like decorations, relayout geometry changes are queued and only
+ * pushed out once the event is handled. Clients whose geometry ends
+ * up where it was last put are left alone.
+ */
+void
+client_layout_queue(Client *c)
+{
+  Wm *w = c->wm;
+
+  /* Panels and toolbars moving shifts the edge offsets */
+  if (c->type == MBCLIENT_TYPE_PANEL || c->type == MBCLIENT_TYPE_TOOLBAR)
+    wm_offsets_invalidate(w);
+
+  if (c->layout_queued) return;
+
+  c->layout_next   = w->layout_queue;
+  c->layout_queued = True;
+  w->layout_queue  = c;
+}
+
+void
+client_layout_queue_remove(Client *c)
+{
+  Wm     *w = c->wm;
+  Client *p = NULL;
+
+  if (!c->layout_queued) return;
+
+  if (w->layout_queue == c)
+    w->layout_queue = c->layout_next;
+  else
+    for (p = w->layout_queue; p != NULL; p = p->layout_next)
+      if (p->layout_next == c)
+	{
+	  p->layout_next = c->layout_next;
+	  break;
+	}
+
+  c->layout_next   = NULL;
+  c->layout_queued = False;
+}
+
+void
+client_layout_queue_flush(Wm *w)
+{
+  Client *c = NULL;
+  int     moved = 0, skipped = 0;
+
+  while ((c = w->layout_queue) != NULL)
+    {
+      w->layout_queue  = c->layout_next;
+      c->layout_next   = NULL;
+      c->layout_queued = False;
+
+      if (c->x == c->layout_x && c->y == c->layout_y
+	  && c->width == c->layout_width && c->height == c->layout_height)
+	{
+	  skipped++;
+	  continue;
+	}
+
+      c->move_resize(c);
+      client_deliver_config(c);
+      moved++;
+    }
+
+  dbg("%s() moved %i, %i unchanged\n", __func__, moved, skipped);
+}
+
 MBClientButton*
 client_get_button_from_event(Client *c, XButtonEvent *e)
 {
@@ -828,6 +1008,7 @@ client_button_do_ops(Client       *c,
 	 return button_item->id;
        }
 
+     STATS_ROUND_TRIP();
      if (XGrabPointer(w->dpy, e->subwindow, False,
 		      ButtonPressMask|ButtonReleaseMask|
 		      PointerMotionMask|EnterWindowMask|LeaveWindowMask,
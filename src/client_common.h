@@ -141,5 +141,26 @@ client_button_remove (Client *c, int button_action);
 void 
 client_buttons_delete_all (Client *c);
 
+void
+client_decor_queue_redraw (Client *c, int frames);
+
+void
+client_decor_queue_remove (Client *c);
+
+void
+client_decor_flush (Client *c);
+
+void
+client_decor_queue_flush (Wm *w);
+
+void
+client_layout_queue (Client *c);
+
+void
+client_layout_queue_remove (Client *c);
+
+void
+client_layout_queue_flush (Wm *w);
+
 
 #endif 
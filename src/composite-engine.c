@@ -35,6 +35,15 @@
 static void
 comp_engine_add_damage (Wm *w, XserverRegion damage);
 
+static void
+comp_engine_override_show(Wm *w, MBOverride *o);
+
+static void
+comp_engine_override_hide(Wm *w, MBOverride *o);
+
+static void
+comp_engine_override_repair(Wm *w, MBOverride *o);
+
 typedef struct _conv {
     int	    size;
     double  *data;
@@ -462,14 +471,10 @@ shadow_gaussian_make_picture (Wm *w, int width, int height)
 }
 
 static XserverRegion
-client_win_extents (Wm *w, Client *client)
+win_extents (Wm *w, int x, int y, int width, int height, Bool has_shadow)
 {
-  int x, y, width, height;
   XRectangle	    r;
 
-  /* XXX make coverage much fast as its now getting called all the time */
-  client->get_coverage(client, &x, &y, &width, &height);  
-
   r.x = x;
   r.y = y; 
   r.width = width;
@@ -477,9 +482,7 @@ client_win_extents (Wm *w, Client *client)
 
   if (w->config->shadow_style)
     {
-      if (client->type == MBCLIENT_TYPE_DIALOG 
-	  || client->type == MBCLIENT_TYPE_TASK_MENU 
-	  || client->type == MBCLIENT_TYPE_OVERRIDE)
+      if (has_shadow)
 	{
 	  if (w->config->shadow_style == SHADOW_STYLE_SIMPLE)
 	    {
@@ -500,10 +503,29 @@ client_win_extents (Wm *w, Client *client)
 }
 
 static XserverRegion
-client_border_size (Wm *w, Client *c, int x, int y)
+client_win_extents (Wm *w, Client *client)
+{
+  int x, y, width, height;
+
+  /* XXX make coverage much fast as its now getting called all the time */
+  client->get_coverage(client, &x, &y, &width, &height);  
+
+  return win_extents (w, x, y, width, height,
+		      (client->type == MBCLIENT_TYPE_DIALOG 
+		       || client->type == MBCLIENT_TYPE_TASK_MENU));
+}
+
+static XserverRegion
+override_win_extents (Wm *w, MBOverride *o)
+{
+  return win_extents (w, o->x, o->y, o->width, o->height, True);
+}
+
+static XserverRegion
+win_border_size (Wm *w, Window win, int x, int y)
 {
     XserverRegion   border;
-    border = XFixesCreateRegionFromWindow (w->dpy, c->frame, WindowRegionBounding );
+    border = XFixesCreateRegionFromWindow (w->dpy, win, WindowRegionBounding );
     /* translate this */
     XFixesTranslateRegion (w->dpy, border, x, y);
     return border;
@@ -679,7 +701,8 @@ comp_engine_theme_init(Wm *w)
 void
 comp_engine_deinit(Wm *w)
 {
-  Client *c = NULL;
+  Client     *c = NULL;
+  MBOverride *o = NULL;
 
   if (!w->have_comp_engine) 
     {
@@ -709,6 +732,10 @@ comp_engine_deinit(Wm *w)
   stack_enumerate(w, c) 
     comp_engine_client_destroy(w, c);
 
+  /* Overrides are kept, just without anything to paint them with */
+  for (o = w->override_bottom; o != NULL; o = o->above)
+    comp_engine_override_hide(w, o);
+
   /* XXX should free up any client picture data ? */
 
   w->comp_engine_disabled = True;
@@ -718,13 +745,18 @@ comp_engine_deinit(Wm *w)
 void
 comp_engine_reinit(Wm *w)
 {
-  Client *c = NULL;
+  Client     *c = NULL;
+  MBOverride *o = NULL;
 
   w->comp_engine_disabled = False;
   comp_engine_init (w);
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
 
+  for (o = w->override_bottom; o != NULL; o = o->above)
+    comp_engine_override_show(w, o);
+
   if (!stack_empty(w))
     {
       stack_enumerate(w, c) 
@@ -856,25 +888,37 @@ comp_engine_client_init(Wm *w, Client *client)
 
 }
 
-int
-comp_engine_client_get_trans_prop(Wm *w, Client *client)
+/* CM_TRANSLUCENCY of a window, -1 if unset */
+static int
+comp_engine_get_trans_prop(Wm *w, Window win)
 {
    Atom actual;
-   int format;
+   int format, result = -1;
    unsigned long n, left;
-   char *data;
+   char *data = NULL;
 
-    XGetWindowProperty(w->dpy, client->window, w->atoms[CM_TRANSLUCENCY], 
-		       0L, 1L, False, XA_INTEGER, &actual, &format, 
-		       &n, &left, (unsigned char **) &data);
+    stats_xget_window_property(w->dpy, win, 
+			       w->atoms[CM_TRANSLUCENCY], 
+			       0L, 1L, False, XA_INTEGER, &actual, &format, 
+			       &n, &left, (unsigned char **) &data);
 
     if (data != None)
     {
-      client->transparency  = (int) *data;
+      result = (int) *data;
       XFree( (void *) data);
-      return client->transparency;
     }
-    return -1;
+    return result;
+}
+
+int
+comp_engine_client_get_trans_prop(Wm *w, Client *client)
+{
+  int transparency = comp_engine_get_trans_prop(w, client->window);
+
+  if (transparency != -1)
+    client->transparency = transparency;
+
+  return transparency;
 }
 
 
@@ -910,6 +954,7 @@ comp_engine_client_show(Wm *w, Client *client)
 
   client->damage = XDamageCreate (w->dpy, client->frame, 
 				  XDamageReportNonEmpty);
+  client->damaged = False;
   region = client_win_extents (w, client);
   comp_engine_add_damage (w, region);
 
@@ -942,7 +987,8 @@ comp_engine_client_hide(Wm *w, Client *client)
   if (client->damage != None)
     {
       XDamageDestroy (w->dpy, client->damage);
-      client->damage = None;
+      client->damage  = None;
+      client->damaged = False;
     }
 
   if (client->extents != None)
@@ -993,14 +1039,44 @@ comp_engine_add_damage (Wm *w, XserverRegion damage)
       w->all_damage = damage;
 }
 
-void
-comp_engine_client_repair (Wm *w, Client *client)
+/* comp_engine_render() only goes down the stack as far as the visible
+ * app on each output, anything under its own output's gets covered.
+ * Each output's is looked up once per render, returns True if any
+ * output has none. */
+static Bool
+comp_engine_outputs_top_update(Wm *w)
+{
+  Client *top;
+  Bool    uncovered = False;
+  int     i;
+
+  for (i = 0; i < w->n_outputs; i++)
+    {
+      top = wm_get_output_visible_main_client(w, i);
+
+      if (top == NULL)
+	uncovered = True;
 
+      w->outputs[i].top_order = top ? top->stack_order : 0;
+    }
+
+  return uncovered;
+}
+
+/* Only valid after comp_engine_outputs_top_update() */
+static Bool
+comp_engine_client_is_covered(Wm *w, Client *client)
+{
+  return (client->stack_order < w->outputs[client->output].top_order);
+}
+
+static void
+_comp_engine_client_repair (Wm *w, Client *client)
 {
   XserverRegion   parts;
   int x, y, width, height;
 
-  if (!w->have_comp_engine) return;
+  client->damaged = False;
 
   dbg("%s() called for client '%s'\n", __func__, client->name);
   
@@ -1018,6 +1094,30 @@ comp_engine_client_repair (Wm *w, Client *client)
   comp_engine_add_damage (w, parts);
 }
 
+void
+comp_engine_client_repair (Wm *w, Client *client)
+{
+  Client *top;
+
+  if (!w->have_comp_engine) return;
+
+  top = wm_get_output_visible_main_client(w, client->output);
+
+  if (top != NULL && client->stack_order < top->stack_order)
+    {
+      /* Left in the damage object, which wont notify again till it's
+       * subtracted, so an app busy out of sight doesn't wake us up. 
+       * comp_engine_render() repairs it once it's back on show. */
+      if (!client->damaged)
+	w->stats.damage_deferred++;
+
+      client->damaged = True;
+      return;
+    }
+
+  _comp_engine_client_repair (w, client);
+}
+
 
 void
 comp_engine_client_configure(Wm *w, Client *client)
@@ -1043,6 +1143,214 @@ comp_engine_client_configure(Wm *w, Client *client)
   comp_engine_add_damage (w, damage);
 }
 
+/* Override redirect windows.
+ *
+ * These come and go all the time ( menus, tooltips ) and all the
+ * compositor needs of them is where they are and what to paint them
+ * with, so rather than a Client each gets a small MBOverride, in a list
+ * of their own kept over the client stack. Their CM_TRANSLUCENCY is
+ * read synchronously by comp_engine_get_trans_prop() when
+ * comp_engine_override_add() first sees them, inside its error
+ * trap. It used to be sent off asynchronously through Xlib internals
+ * and collected by a single sync in comp_engine_render(); that
+ * prefetch has been dropped, so each new override costs a round trip.
+ */
+
+static void
+comp_engine_override_link_above(Wm *w, MBOverride *o, MBOverride *below)
+{
+  if (below == NULL)		/* to the bottom */
+    {
+      o->below = NULL;
+      o->above = w->override_bottom;
+      w->override_bottom = o;
+    }
+  else
+    {
+      o->below = below;
+      o->above = below->above;
+      below->above = o;
+    }
+
+  if (o->above)
+    o->above->below = o;
+  else
+    w->override_top = o;
+}
+
+static void
+comp_engine_override_unlink(Wm *w, MBOverride *o)
+{
+  if (o->below)
+    o->below->above = o->above;
+  else
+    w->override_bottom = o->above;
+
+  if (o->above)
+    o->above->below = o->below;
+  else
+    w->override_top = o->below;
+
+  o->above = o->below = NULL;
+}
+
+MBOverride*
+comp_engine_override_find(Wm *w, Window win)
+{
+  MBOverride *o;
+
+  for (o = w->override_top; o != NULL; o = o->below)
+    if (o->window == win)
+      return o;
+
+  return NULL;
+}
+
+static void
+comp_engine_override_show(Wm *w, MBOverride *o)
+{
+  XRenderPictureAttributes pa;
+
+  if (!w->have_comp_engine) return;
+
+  if (o->picture == None)
+    {
+      pa.subwindow_mode = IncludeInferiors;
+
+      o->picture = XRenderCreatePicture (w->dpy, o->window,
+					 XRenderFindVisualFormat (w->dpy, 
+								  o->visual),
+					 CPSubwindowMode,
+					 &pa);
+    }
+
+  if (o->damage == None)
+    o->damage = XDamageCreate (w->dpy, o->window, XDamageReportNonEmpty);
+
+  comp_engine_add_damage (w, override_win_extents (w, o));
+}
+
+static void
+comp_engine_override_hide(Wm *w, MBOverride *o)
+{
+  if (o->damage != None)
+    {
+      XDamageDestroy (w->dpy, o->damage);
+      o->damage = None;
+    }
+
+  if (o->extents != None)
+    {
+      comp_engine_add_damage (w, o->extents); 
+      o->extents = None;
+    }
+
+  if (o->picture != None)
+    {
+      XRenderFreePicture (w->dpy, o->picture);
+      o->picture = None;
+    }
+
+  if (o->border_clip != None)
+    {
+      XFixesDestroyRegion (w->dpy, o->border_clip);
+      o->border_clip = None;
+    }
+}
+
+static void
+comp_engine_override_repair(Wm *w, MBOverride *o)
+{
+  XserverRegion parts;
+
+  parts = XFixesCreateRegion (w->dpy, 0, 0);
+
+  XDamageSubtract (w->dpy, o->damage, None, parts);
+  XFixesTranslateRegion (w->dpy, parts, o->x, o->y);
+
+  comp_engine_add_damage (w, parts);
+}
+
+/* Called on the MapNotify of an override redirect window */
+void
+comp_engine_override_add(Wm *w, Window win, XWindowAttributes *attr)
+{
+  XRenderPictFormat *format;
+  MBOverride        *o;
+
+  if (!w->have_comp_engine) return;
+
+  dbg("%s() tracking override %li\n", __func__, win);
+
+  o = slab_alloc(&slab_overrides);
+
+  o->window       = win;
+  o->x            = attr->x;
+  o->y            = attr->y;
+  o->width        = attr->width;
+  o->height       = attr->height;
+  o->visual       = attr->visual;
+
+  /* Gone already just means no property, the unmap follows */
+  misc_trap_xerrors();
+  o->transparency = comp_engine_get_trans_prop(w, win);
+  misc_untrap_xerrors();
+
+  format = XRenderFindVisualFormat (w->dpy, o->visual);
+
+  if (format && format->type == PictTypeDirect && format->direct.alphaMask)
+    o->is_argb32 = True;
+
+  comp_engine_override_link_above(w, o, w->override_top);
+
+  comp_engine_override_show(w, o);
+}
+
+/* Moved, resized or restacked. Restacking is only followed among the
+ * overrides themselves, they all stay over the clients. */
+void
+comp_engine_override_configure(Wm *w, MBOverride *o, XConfigureEvent *e)
+{
+  XserverRegion  damage, extents;
+  MBOverride    *sibling = NULL;
+
+  damage = XFixesCreateRegion (w->dpy, 0, 0);
+
+  if (o->extents != None)
+    XFixesCopyRegion (w->dpy, damage, o->extents);
+
+  o->x      = e->x;
+  o->y      = e->y;
+  o->width  = e->width;
+  o->height = e->height;
+
+  if (e->above == None 
+      || ((sibling = comp_engine_override_find(w, e->above)) != NULL
+	  && sibling != o && sibling != o->below))
+    {
+      comp_engine_override_unlink(w, o);
+      comp_engine_override_link_above(w, o, sibling);
+    }
+
+  extents = override_win_extents (w, o);
+  XFixesUnionRegion (w->dpy, damage, damage, extents);
+  XFixesDestroyRegion (w->dpy, extents);
+
+  comp_engine_add_damage (w, damage);
+}
+
+/* Unmapped or destroyed */
+void
+comp_engine_override_remove(Wm *w, MBOverride *o)
+{
+  dbg("%s() dropping override %li\n", __func__, o->window);
+
+  comp_engine_override_hide(w, o);
+
+  comp_engine_override_unlink(w, o);
+
+  slab_free(&slab_overrides, o);
+}
 
 void
 comp_engine_handle_events(Wm *w, XEvent *ev)
@@ -1053,13 +1361,29 @@ comp_engine_handle_events(Wm *w, XEvent *ev)
     {
       XDamageNotifyEvent *de;
       Client *c;
+      MBOverride *o;
       
       dbg("%s() called have damage event \n", __func__);
 
       de = (XDamageNotifyEvent *)ev;
+
+      /* Menus and tooltips mostly */
+      if ((o = comp_engine_override_find(w, de->drawable)) != NULL)
+	{
+	  comp_engine_override_repair(w, o);
+	  return;
+	}
       
       c = wm_find_client(w, de->drawable, FRAME);
 
+#ifdef USE_XSYNC
+      /* Hold off showing a half drawn resize, damage keeps 
+       * accumulating and is repaired once the client syncs.
+       */
+      if (c && c->ewmh_sync_is_waiting)
+	return;
+#endif
+
       if (c)
 	comp_engine_client_repair(w, c);
       else
@@ -1090,7 +1414,7 @@ _render_a_client(Wm           *w,
 
   client->get_coverage(client, &x, &y, &width, &height);  
 
-  winborder = client_border_size (w, client, x, y);
+  winborder = win_border_size (w, client->frame, x, y);
 
 
   /* Transparency only done for dialogs and overides */
@@ -1150,6 +1474,168 @@ _render_a_client(Wm           *w,
   XFixesDestroyRegion (w->dpy, winborder); /* XXX the leak plugged ? */
 }
 
+/* Like _render_a_client(), overrides never being lowlighted */
+static void
+_render_an_override(Wm *w, MBOverride *o, XserverRegion region)
+{
+  XserverRegion winborder;
+
+  if (o->picture == None)
+    return;
+
+  if (o->extents)
+    XFixesDestroyRegion (w->dpy, o->extents);
+
+  o->extents = override_win_extents (w, o);
+
+  winborder = win_border_size (w, o->window, o->x, o->y);
+
+  if (o->transparency == -1 && !o->is_argb32)
+    {
+      XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 0, 0, region);
+
+      XFixesSubtractRegion (w->dpy, region, region, winborder);
+
+      XRenderComposite (w->dpy, PictOpSrc, 
+			o->picture, 
+			None, w->root_buffer,
+			0, 0, 0, 0, o->x, o->y, o->width, o->height);
+    }
+
+  if (o->border_clip != None)
+    XFixesDestroyRegion (w->dpy, o->border_clip);
+
+  o->border_clip = XFixesCreateRegion (w->dpy, 0, 0);
+  XFixesCopyRegion (w->dpy, o->border_clip, region);
+
+  XFixesDestroyRegion (w->dpy, winborder);
+}
+
+/* Shadow, and for translucent windows the contents, of a window already
+ * clipped by _render_a_client() or _render_an_override() */
+static void
+_render_shadow(Wm           *w,
+	       Window        win,
+	       Picture       picture,
+	       XserverRegion border_clip,
+	       Bool          is_argb32,
+	       int           transparency,
+	       int           x,
+	       int           y,
+	       int           width,
+	       int           height)
+{
+  Picture shadow_pic;
+
+  if (w->config->shadow_style == SHADOW_STYLE_SIMPLE) 
+    {
+      XserverRegion shadow_region;
+
+      /* Grab 'shape' region of window */
+      shadow_region = win_border_size (w, win, x, y);
+
+      /* Offset it. */
+      XFixesTranslateRegion (w->dpy, shadow_region, 
+			     w->config->shadow_dx, 
+			     w->config->shadow_dy);
+
+      /* Intersect it, so only border remains */
+      XFixesIntersectRegion (w->dpy, shadow_region,
+			     border_clip, shadow_region );
+
+      XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 
+				  0, 0, shadow_region);
+
+      /* now paint them */
+
+      if (is_argb32 )
+	{
+	  XRenderComposite (w->dpy, PictOpOver, 
+			    w->black_picture,
+			    picture, 
+			    w->root_buffer,
+			    0, 0, 0, 0,
+			    x + w->config->shadow_dx,
+			    y + w->config->shadow_dy,
+			    width  + w->config->shadow_padding_width, 
+			    height + w->config->shadow_padding_height);
+
+	}
+      else
+	{
+	  XRenderComposite (w->dpy, PictOpOver, 
+			    w->black_picture, 
+			    None, 
+			    w->root_buffer,
+			    0, 0, 0, 0,
+			    x + w->config->shadow_dx,
+			    y + w->config->shadow_dy,
+			    width  + w->config->shadow_padding_width, 
+			    height + w->config->shadow_padding_height);
+	}
+
+      /* Paint any transparent window contents */
+      if (transparency != -1 || is_argb32 )
+	{
+	  XFixesDestroyRegion (w->dpy, shadow_region);
+
+	  shadow_region = win_border_size (w, win, x, y);
+
+	  XFixesIntersectRegion (w->dpy, shadow_region,
+				 border_clip, shadow_region );
+
+	  XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 
+				      0, 0, shadow_region);
+
+	  if (is_argb32)
+	    XRenderComposite (w->dpy, PictOpOver, 
+			      picture, None,
+			      w->root_buffer, 0, 0, 0, 0, 
+			      x, y, width, height);
+	  else
+	    XRenderComposite (w->dpy, PictOpOver, 
+			      picture, w->trans_picture,
+			      w->root_buffer, 0, 0, 0, 0, 
+			      x, y, width, height);
+	}
+
+      XFixesDestroyRegion (w->dpy, shadow_region);
+    }
+  else 		/* GAUSSIAN */
+    {
+
+      XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 
+				  0, 0, border_clip);
+
+      if (transparency != -1 || is_argb32 )
+	{
+	  /* No shadows currently for transparent windows */
+	  XRenderComposite (w->dpy, PictOpOver, 
+			    picture, w->trans_picture,
+			    w->root_buffer, 0, 0, 0, 0, 
+			    x, y, width, height);
+	} else {		  
+	  /* Combine pregenerated shadow tiles */
+
+	  shadow_pic 
+	    = shadow_gaussian_make_picture (w, 
+					    width + w->config->shadow_padding_width, 
+					    height + w->config->shadow_padding_height);
+
+	  XRenderComposite (w->dpy, PictOpOver, w->black_picture, 
+			    shadow_pic, 
+			    w->root_buffer,
+			    0, 0, 0, 0,
+			    x + w->config->shadow_dx,
+			    y + w->config->shadow_dy,
+			    width + w->config->shadow_padding_width, 
+			    height + w->config->shadow_padding_height);
+	  XRenderFreePicture (w->dpy, shadow_pic);
+
+	}
+    }
+}
+
 void
 comp_engine_destroy_root_buffer(Wm *w)
 {
@@ -1160,12 +1646,38 @@ comp_engine_destroy_root_buffer(Wm *w)
     }
 }
 
+/* Repaint an area on the next render, eg an output that changed */
+void
+comp_engine_damage_rect(Wm *w, int x, int y, int width, int height)
+{
+  XRectangle r;
+
+  if (!w->have_comp_engine) return;
+
+  r.x = x;
+  r.y = y;
+  r.width  = width;
+  r.height = height;
+
+  comp_engine_add_damage (w, XFixesCreateRegion (w->dpy, &r, 1));
+}
+
+/* Repaint everything on the next render, eg after a screen resize */
+void
+comp_engine_damage_all(Wm *w)
+{
+  comp_engine_damage_rect(w, 0, 0, w->dpy_width, w->dpy_height);
+}
+
 void
 comp_engine_render(Wm *w, XserverRegion region)
 {
-  Client       *client_top_app = NULL, *t = NULL;
+  Client       *t = NULL;
+  MBOverride   *o = NULL;
   int           x,y,width,height;
   int           lowlight = 0;
+  Bool          uncovered = False;
+  MBTraceTime   trace_start = trace_now();
 
   if (!w->have_comp_engine || stack_empty(w)) return;
 
@@ -1181,7 +1693,17 @@ comp_engine_render(Wm *w, XserverRegion region)
       region = XFixesCreateRegion (w->dpy, &r, 1);
     }
 
-  client_top_app = wm_get_visible_main_client(w);
+  /* Each output shows down to its own top app, one with none shows
+   * the bottom of the stack */
+  uncovered = comp_engine_outputs_top_update(w);
+
+  /* Anything back on show with damage put off while it was hidden,
+   * that goes into the region ( normally all_damage ) before it's
+   * used to clip. */
+  stack_enumerate_reverse(w, t) 
+    if (t->damaged && t->damage != None 
+	&& !comp_engine_client_is_covered(w, t))
+      _comp_engine_client_repair(w, t);
 
   if (!w->root_buffer)
     {
@@ -1212,6 +1734,7 @@ comp_engine_render(Wm *w, XserverRegion region)
       XRenderComposite (w->dpy, PictOpSrc, w->red_picture, 
 			None, w->root_picture,
 			0, 0, 0, 0, 0, 0, w->dpy_width, w->dpy_height);
+      STATS_ROUND_TRIP();
       XSync(w->dpy, False);
       /* return; */
     }
@@ -1222,28 +1745,29 @@ comp_engine_render(Wm *w, XserverRegion region)
   stack_enumerate_reverse(w, t) 
     {
       if (t->type == MBCLIENT_TYPE_DIALOG
-	  && t->flags & CLIENT_IS_MODAL_FLAG)
+	  && t->flags & CLIENT_IS_MODAL_FLAG
+	  && !comp_engine_client_is_covered(w, t))
 	{
 	  lowlight = ((t->win_modal_blocker) ? 2 : 1);
 	}
-
-      if (t == client_top_app)
-	break;
     }      
 
-  /* Render top -> bottom */
+  /* Render top -> bottom, the overrides being over everything */
+
+  for (o = w->override_top; o != NULL; o = o->below)
+    _render_an_override(w, o, region);
 
   stack_enumerate_reverse(w, t) 
     {
+      if (comp_engine_client_is_covered(w, t))
+	continue;
+
       dbg("%s() rendering %s\n", __func__, t->name);
 
       _render_a_client(w, t, region, lowlight);
-
-      if (t == client_top_app)
-	break;
     }
 
-  if (client_top_app == NULL)
+  if (uncovered)
     {
 
       /* Render block of boring black in case of no top app or desktop */
@@ -1255,8 +1779,6 @@ comp_engine_render(Wm *w, XserverRegion region)
 			w->dpy_width, w->dpy_height);
       
       XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 0, 0, None);
-
-      client_top_app = w->stack_bottom;
     }
 
 
@@ -1264,13 +1786,15 @@ comp_engine_render(Wm *w, XserverRegion region)
 
   /* Now render shadows but bottom -> top this time */
 
-  for ((t)=client_top_app; (t) != NULL; (t)=(t)->above) 
+  stack_enumerate(w, t)
     {
+      if (comp_engine_client_is_covered(w, t))
+	continue;
+
       dbg("%s() rendering shadow for %s\n", __func__, t->name);
 
       if ((t->type == MBCLIENT_TYPE_DIALOG && t->mapped) 
-	  || t->type == MBCLIENT_TYPE_TASK_MENU 
-	  || t->type == MBCLIENT_TYPE_OVERRIDE)
+	  || t->type == MBCLIENT_TYPE_TASK_MENU)
 	{
 
 	  dbg("%s() rendering shadow for %s\n", __func__, t->name);
@@ -1283,131 +1807,35 @@ comp_engine_render(Wm *w, XserverRegion region)
 	
 	  if (w->config->shadow_style)
 	    {
-	      Picture shadow_pic;
-	  
 	      t->get_coverage(t, &x, &y, &width, &height);  
 
-	  
-	      if (w->config->shadow_style == SHADOW_STYLE_SIMPLE) 
-		{
-		  XserverRegion shadow_region;
-
-		  /* Grab 'shape' region of window */
-		  shadow_region = client_border_size (w, t, x, y);
-		  
-		  /* Offset it. */
-		  XFixesTranslateRegion (w->dpy, shadow_region, 
-					 w->config->shadow_dx, 
-					 w->config->shadow_dy);
-		  
-		  /* Intersect it, so only border remains */
-		  XFixesIntersectRegion (w->dpy, shadow_region,
-					 t->border_clip, shadow_region );
-		  
-		  XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 
-					      0, 0, shadow_region);
-
-		  /* now paint them */
-
-		  if (t->is_argb32 )
-		    {
-		      XRenderComposite (w->dpy, PictOpOver, 
-					w->black_picture,
-					t->picture, 
- 					w->root_buffer,
-					0, 0, 0, 0,
-					x + w->config->shadow_dx,
-					y + w->config->shadow_dy,
-					width  + w->config->shadow_padding_width, 
-					height + w->config->shadow_padding_height);
-
-		    }
-		  else
-		    {
-		      XRenderComposite (w->dpy, PictOpOver, 
-					w->black_picture, 
-					None, 
-					w->root_buffer,
-					0, 0, 0, 0,
-					x + w->config->shadow_dx,
-					y + w->config->shadow_dy,
-					width  + w->config->shadow_padding_width, 
-					height + w->config->shadow_padding_height);
-		    }
-
-		  /* Paint any transparent window contents */
-		  if (t->transparency != -1 || t->is_argb32 )
-		    {
-		      XFixesDestroyRegion (w->dpy, shadow_region);
-
-		      shadow_region = client_border_size (w, t, x, y);
-
-		      XFixesIntersectRegion (w->dpy, shadow_region,
-					     t->border_clip, shadow_region );
-		      
-		      XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 
-						  0, 0, shadow_region);
-
-		      if (t->is_argb32)
-			XRenderComposite (w->dpy, PictOpOver, 
-					  t->picture, None,
-					  w->root_buffer, 0, 0, 0, 0, 
-					  x, y, width, height);
-		      else
-			XRenderComposite (w->dpy, PictOpOver, 
-					  t->picture, w->trans_picture,
-					  w->root_buffer, 0, 0, 0, 0, 
-					  x, y, width, height);
-		    }
-
-		  XFixesDestroyRegion (w->dpy, shadow_region);
-		}
-	      else 		/* GAUSSIAN */
-		{
-		  
-		  XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 
-					      0, 0, t->border_clip);
-
-		  if (t->transparency != -1 || t->is_argb32 )
-		    {
-		      /* No shadows currently for transparent windows */
-		      XRenderComposite (w->dpy, PictOpOver, 
-					t->picture, w->trans_picture,
-					w->root_buffer, 0, 0, 0, 0, 
-					x, y, width, height);
-		    } else {		  
-		      /* Combine pregenerated shadow tiles */
-
-		      shadow_pic 
-			= shadow_gaussian_make_picture (w, 
-							width + w->config->shadow_padding_width, 
-							height + w->config->shadow_padding_height);
-
-		      XRenderComposite (w->dpy, PictOpOver, w->black_picture, 
-					shadow_pic, 
-					w->root_buffer,
-					0, 0, 0, 0,
-					x + w->config->shadow_dx,
-					y + w->config->shadow_dy,
-					width + w->config->shadow_padding_width, 
-					height + w->config->shadow_padding_height);
-		      XRenderFreePicture (w->dpy, shadow_pic);
-
-		    }
-		}
-	      
+	      _render_shadow(w, t->frame, t->picture, t->border_clip,
+			     t->is_argb32, t->transparency, 
+			     x, y, width, height);
 	    }
-
 	}
     }
 
+  /* Then the overrides, over the lot */
+
+  for (o = w->override_bottom; o != NULL; o = o->above)
+    if (o->picture && w->config->shadow_style)
+      _render_shadow(w, o->window, o->picture, o->border_clip,
+		     o->is_argb32, o->transparency,
+		     o->x, o->y, o->width, o->height);
+
   
   XFixesSetPictureClipRegion (w->dpy, w->root_buffer, 0, 0, None);
 
   XRenderComposite (w->dpy, PictOpSrc, w->root_buffer, None, w->root_picture,
 		    0, 0, 0, 0, 0, 0, w->dpy_width, w->dpy_height);
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
+
+  w->stats.renders++;
+  stats_hist_add(w->stats.render_hist, 
+		 trace_record("comp_engine_render", trace_start, -1));
 }
 
 #endif
@@ -1426,6 +1854,7 @@ comp_engine_time(Wm *w)
 
 #ifdef USE_COMPOSITE
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
   gettimeofday(&tv_start, &tz);
   
@@ -1439,6 +1868,7 @@ comp_engine_time(Wm *w)
   XRenderComposite (w->dpy, PictOpSrc, w->root_buffer, None, w->root_picture,
 		    0, 0, 0, 0, 0, 0, w->dpy_width, w->dpy_height);
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
   gettimeofday(&tv_end, &tz);
   
@@ -1462,6 +1892,7 @@ comp_engine_time(Wm *w)
   attr.override_redirect = True;
   attr.event_mask = ChildMask|ButtonPressMask|ExposureMask;
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
   gettimeofday(&tv_start, &tz);
        
@@ -1509,6 +1940,7 @@ comp_engine_time(Wm *w)
 
   XMapRaised(w->dpy, win);  
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
   gettimeofday(&tv_end, &tz);
   
@@ -1518,6 +1950,7 @@ comp_engine_time(Wm *w)
   mb_pixbuf_img_free(w->pb, img);
   XFreePixmap(w->dpy, pxm_tmp);
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
 
   sleep(1);
@@ -63,12 +63,30 @@ comp_engine_client_repair (Wm *w, Client *client);
 void
 comp_engine_client_configure(Wm *w, Client *client);
 
+MBOverride*
+comp_engine_override_find(Wm *w, Window win);
+
+void
+comp_engine_override_add(Wm *w, Window win, XWindowAttributes *attr);
+
+void
+comp_engine_override_configure(Wm *w, MBOverride *o, XConfigureEvent *e);
+
+void
+comp_engine_override_remove(Wm *w, MBOverride *o);
+
 void
 comp_engine_handle_events(Wm *w, XEvent *ev);
 
 void
 comp_engine_destroy_root_buffer(Wm *w);
 
+void
+comp_engine_damage_rect(Wm *w, int x, int y, int width, int height);
+
+void
+comp_engine_damage_all(Wm *w);
+
 void
 comp_engine_render(Wm *w, XserverRegion region);
 
@@ -90,6 +108,8 @@ comp_engine_render(Wm *w, XserverRegion region);
 #define comp_engine_client_configure(w, c) ;
 #define comp_engine_handle_events(w, c) ;
 #define comp_engine_destroy_root_buffer(w) ;
+#define comp_engine_damage_rect(w, x, y, width, height) do {} while (0)
+#define comp_engine_damage_all(w) do {} while (0)
 #define comp_engine_render(w, r) ;
 #define comp_engine_get_argb32_visual(w) ;
 
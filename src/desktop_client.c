@@ -35,6 +35,7 @@ desktop_client_new(Wm *w, Window win)
 
    c = base_client_new(w, win); 
    c->type         = MBCLIENT_TYPE_DESKTOP;
+   stack_update_type(c);
    c->configure    = &desktop_client_configure;
    c->reparent     = &desktop_client_reparent;
    c->move_resize  = &desktop_client_move_resize;
@@ -44,7 +45,7 @@ desktop_client_new(Wm *w, Window win)
    c->hide         = &main_client_hide;
 
    if (w->stack_top_app && (w->flags & SINGLE_FLAG))
-     main_client_redraw(w->stack_top_app, False);
+     client_decor_queue_redraw(w->stack_top_app, DECOR_DIRTY_NORTH);
 
    w->client_desktop = c;
 
@@ -105,7 +106,7 @@ desktop_client_unmap(Client *c)
      {
        /* Needed to make sure app window task menu button gets updated */
        if (w->stack_top_app == stack_get_below(w->stack_top_app, MBCLIENT_TYPE_APP))
-	 main_client_redraw(w->stack_top_app, False);
+	 client_decor_queue_redraw(w->stack_top_app, DECOR_DIRTY_NORTH);
 
        wm_activate_client(w->stack_top_app);   
      }
@@ -21,7 +21,8 @@
 #include "dialog_client.h"
 
 static void dialog_client_check_for_state_hints(Client *c);
-static void dialog_client_drag(Client *c);
+static Bool dialog_client_drag(Client *c);
+static void dialog_client_static_reshow(Client *c);
 static void _get_mouse_position(Wm *w, int *x, int *y);
 
 Client*
@@ -33,6 +34,7 @@ dialog_client_new(Wm *w, Window win, Client *trans)
    if (!c) return NULL;
 
    c->type = MBCLIENT_TYPE_DIALOG;
+   stack_update_type(c);
    
    c->reparent     = &dialog_client_reparent;
    c->move_resize  = &dialog_client_move_resize;
@@ -47,6 +49,7 @@ dialog_client_new(Wm *w, Window win, Client *trans)
    dialog_client_check_for_state_hints(c);
 
    c->trans = trans;
+   stack_update_trans(c);
 
    return c;
 }
@@ -494,17 +497,19 @@ dialog_get_available_area(Client *c,
     }
   else
     {
-      Client *p = NULL, *main_client = wm_get_visible_main_client(w);
-      Bool    have_toolbar = False;
+      Client   *p = NULL, *main_client = wm_get_visible_main_client(w);
+      MBOutput *o = &w->outputs[c->output];
+      Bool      have_toolbar = False;
 
-     stack_enumerate(w, p)
+     stack_enumerate_type(w, p, MBCLIENT_TYPE_TOOLBAR)
       {
 	if (p->type == MBCLIENT_TYPE_TOOLBAR && p->mapped 
+	    && p->output == c->output
 	    && !(p->flags & CLIENT_IS_MINIMIZED))
 	  { have_toolbar = True; break; }
       }
 
-      *y = wm_get_offsets_size(w, NORTH, NULL, True);
+      *y = o->y + wm_get_offsets_size(w, NORTH, c, True);
 
       if (main_client && (main_client->flags & CLIENT_FULLSCREEN_FLAG))
 	{
@@ -515,9 +520,9 @@ dialog_get_available_area(Client *c,
            *      root ?
 	  */
 
-	  *height = w->dpy_height - *y;
-	  *x = 0;
-	  *width  = w->dpy_width;
+	  *height = o->y + o->height - *y;
+	  *x = o->x;
+	  *width  = o->width;
 
 	  /* This mainly for alt toolbars so dialogs get positioned ok
 	   * for fullscreen.    
@@ -538,15 +543,15 @@ dialog_get_available_area(Client *c,
 	  if (!have_toolbar)
 	    *y  += main_client_title_height(c->trans);
 	  
-	  *height = w->dpy_height - *y - wm_get_offsets_size(w, SOUTH, 
-							     NULL, True);
-	  *x      = wm_get_offsets_size(w, WEST, NULL, True);
-	  *width  = w->dpy_width - *x - wm_get_offsets_size(w, EAST, 
-							    NULL, True);
+	  *height = o->y + o->height - *y - wm_get_offsets_size(w, SOUTH, 
+								c, True);
+	  *x      = o->x + wm_get_offsets_size(w, WEST, c, True);
+	  *width  = o->x + o->width - *x - wm_get_offsets_size(w, EAST, 
+							       c, True);
 	}
 
       dbg("%s() (toolbar) offsets south is %i\n", 
-	  __func__, wm_get_offsets_size(w, SOUTH, NULL, True));
+	  __func__, wm_get_offsets_size(w, SOUTH, c, True));
 
 
     }
@@ -662,8 +667,9 @@ dialog_constrain_geometry(Client *c,
 void
 dialog_init_geometry(Client *c)      
 {
-  Wm  *w = c->wm;
-  int  avail_x, avail_y, avail_width, avail_height;
+  Wm       *w = c->wm;
+  MBOutput *o = &w->outputs[c->output];
+  int       avail_x, avail_y, avail_width, avail_height;
   int  bdr_south = 0, bdr_west = 0, bdr_east = 0, bdr_north = 0;
 
   /* Check if we actually want to perform any sizing intervention */
@@ -677,11 +683,11 @@ dialog_init_geometry(Client *c)
     {
       if ((c->flags & CLIENT_IS_SPLASH_WIN) && c->x == 0 && c->y == 0)
 	{
-	  if (c->height < w->dpy_height)
-	    c->y = (w->dpy_height - c->height)/2;
+	  if (c->height < o->height)
+	    c->y = o->y + (o->height - c->height)/2;
       
-	  if (c->width < w->dpy_width)
-	    c->x = (w->dpy_width - c->width)/2;
+	  if (c->width < o->width)
+	    c->x = o->x + (o->width - c->width)/2;
 	}
       return;
     }
@@ -702,28 +708,28 @@ dialog_init_geometry(Client *c)
   switch (c->gravity)
     {
     case NorthGravity:
-      c->y += (bdr_north + avail_y);
+      c->y += (bdr_north + avail_y - o->y);
       break;
     case NorthEastGravity:
-      c->y += (bdr_north + avail_y);
-      c->x -= (bdr_east + (w->dpy_width - (avail_x + avail_width)));
+      c->y += (bdr_north + avail_y - o->y);
+      c->x -= (bdr_east + (o->x + o->width - (avail_x + avail_width)));
       break;
     case WestGravity:
-      c->x += (bdr_west + avail_x);
+      c->x += (bdr_west + avail_x - o->x);
       break;
     case EastGravity:
-      c->x -= (bdr_east + (w->dpy_width - (avail_x + avail_width)));
+      c->x -= (bdr_east + (o->x + o->width - (avail_x + avail_width)));
       break;
     case SouthWestGravity:
-      c->y -= (bdr_south + (w->dpy_height - (avail_y + avail_height)));
-      c->x += (bdr_west + avail_x);
+      c->y -= (bdr_south + (o->y + o->height - (avail_y + avail_height)));
+      c->x += (bdr_west + avail_x - o->x);
       break;
     case SouthGravity:
-      c->y -= (bdr_south + (w->dpy_height - (avail_y + avail_height)));
+      c->y -= (bdr_south + (o->y + o->height - (avail_y + avail_height)));
       break;
     case SouthEastGravity:
-      c->x -= (bdr_east + (w->dpy_width - (avail_x + avail_width)));
-      c->y -= (bdr_south + (w->dpy_height - (avail_y + avail_height)));
+      c->x -= (bdr_east + (o->x + o->width - (avail_x + avail_width)));
+      c->y -= (bdr_south + (o->y + o->height - (avail_y + avail_height)));
       break;
     case CenterGravity:
     case NorthWestGravity:
@@ -739,12 +745,14 @@ dialog_init_geometry(Client *c)
     {
       int win_width  = c->width + bdr_east;
       int win_height = c->height + bdr_south;
+      int o_right    = o->x + o->width;
+      int o_bottom   = o->y + o->height;
 
-      if (c->x >= w->dpy_width) 
-	c->x = w->dpy_width - win_width - (c->x - w->dpy_width );
+      if (c->x >= o_right) 
+	c->x = o_right - win_width - (c->x - o_right );
 
-      if (c->y >= w->dpy_height) 
-	c->y = w->dpy_height - win_height - (c->y - w->dpy_height );
+      if (c->y >= o_bottom) 
+	c->y = o_bottom - win_height - (c->y - o_bottom );
 
       return;
     }
@@ -1050,19 +1058,10 @@ dialog_client_button_press(Client *c, XButtonEvent *e)
 	    
 	    XUnmapWindow(w->dpy, c->frame);
 
-	    dialog_client_drag(c);
-
-	    misc_trap_xerrors(); 
-	    XMapWindow(w->dpy, c->frame);
-
-	    if (w->focused_client == c)
-	      {
-		w->focused_client = NULL;
-		client_set_focus(c);
-	      }
-	    misc_untrap_xerrors(); 	    
+	    /* Mapped again when the button is let go */
+	    if (!dialog_client_drag(c))
+	      dialog_client_static_reshow(c);
 
-	    XSync(w->dpy, False);
 	    return;
 	  }
 
@@ -1072,118 +1071,127 @@ dialog_client_button_press(Client *c, XButtonEvent *e)
 }
 
 static void
+dialog_client_static_reshow(Client *c)
+{
+  Wm *w = c->wm;
+
+  misc_trap_xerrors(); 
+  XMapWindow(w->dpy, c->frame);
+
+  if (w->focused_client == c)
+    {
+      w->focused_client = NULL;
+      client_set_focus(c);
+    }
+  misc_untrap_xerrors(); 	    
+
+  STATS_ROUND_TRIP();
+  XSync(w->dpy, False);
+}
+
+/* Starts a drag, the pointer events are then fed through
+ * dialog_client_drag_handle_event() by the main loop so everything
+ * else ( composite repaints included ) carries on as normal. When
+ * compositing the frame itself is moved, otherwise an outline.
+ */
+static Bool
 dialog_client_drag(Client *c) /* drag box */
 {
   Wm                  *w = c->wm;
-  XEvent               ev;
   int                  offset_south = 0, offset_west = 0, offset_east = 0;
-  int                  x1, y1, old_cx = c->x, old_cy = c->y;
   int                  frm_size     = dialog_client_title_height(c);
   XSetWindowAttributes attr;
-  Window               win_outline;
   XRectangle           rects[1];
-  Bool                 done = False, client_removed = False;
 
   dbg("%s called\n", __func__);
 
+  if (w->drag_client != NULL)
+    return False;
+
   dialog_client_get_offsets(c, &offset_east, &offset_south, &offset_west);
 
+  STATS_ROUND_TRIP();
   if (XGrabPointer(c->wm->dpy, c->wm->root, False,
 		   (ButtonPressMask|ButtonReleaseMask|PointerMotionMask),
 		   GrabModeAsync,
 		   GrabModeAsync, None, c->wm->curs_drag, CurrentTime)
       != GrabSuccess)
-    return;
-
-  attr.override_redirect = True;
-  attr.background_pixel  = BlackPixel(w->dpy, w->screen);  
-
-  win_outline = XCreateWindow(w->dpy, 
-			      w->root,
-			      c->x - offset_west, c->y - frm_size,
-			      c->width + offset_west + offset_east,
-			      c->height + frm_size + offset_south,
-			      0,
-			      CopyFromParent, 
-			      CopyFromParent, 
-			      CopyFromParent,
-			      CWBackPixel|CWOverrideRedirect,
-			      &attr);
-
-  rects[0].x      = 2;  
-  rects[0].y      = 2;
-  rects[0].width  = c->width + offset_west + offset_east - 4;
-  rects[0].height = c->height + frm_size + offset_south  - 4;
-
-  XShapeCombineRectangles (w->dpy, win_outline,
-			   ShapeBounding,
-			   0, 0, rects, 1, ShapeSubtract, 0 );
-
-  XMapWindow (w->dpy, win_outline);
-  XSync (w->dpy, False);
+    return False;
 
-  comp_engine_client_show(c->wm, c); 
-
-  _get_mouse_position(c->wm, &x1, &y1);
+  w->drag_live = False;
+#ifdef USE_COMPOSITE
+  if (w->have_comp_engine && !w->comp_engine_disabled
+      && w->config->dialog_stratergy != WM_DIALOGS_STRATERGY_STATIC)
+    w->drag_live = True;
+#endif
 
-  XFlush(c->wm->dpy);
+  w->drag_outline = None;
 
-  while (!done) 
+  if (!w->drag_live)
     {
-      int wanted_x = 0, wanted_y = 0;
-
-      XMaskEvent(c->wm->dpy, 
-		 ButtonPressMask|ButtonReleaseMask
-		 |PointerMotionMask|SubstructureNotifyMask,
-		 &ev);
-
-    switch (ev.type) 
-      {
-      case MapRequest:
-	wm_handle_map_request(w, &ev.xmaprequest); 
-	break;
-
-      case UnmapNotify:
-	{
-	  if (wm_find_client(w, ev.xunmap.window, WINDOW) == c)
-	    {
-	      client_removed = True;
-	      done = True;
-	    }
+      attr.override_redirect = True;
+      attr.background_pixel  = BlackPixel(w->dpy, w->screen);  
+
+      w->drag_outline = XCreateWindow(w->dpy, 
+				      w->root,
+				      c->x - offset_west, c->y - frm_size,
+				      c->width + offset_west + offset_east,
+				      c->height + frm_size + offset_south,
+				      0,
+				      CopyFromParent, 
+				      CopyFromParent, 
+				      CopyFromParent,
+				      CWBackPixel|CWOverrideRedirect,
+				      &attr);
+
+      rects[0].x      = 2;  
+      rects[0].y      = 2;
+      rects[0].width  = c->width + offset_west + offset_east - 4;
+      rects[0].height = c->height + frm_size + offset_south  - 4;
+
+      XShapeCombineRectangles (w->dpy, w->drag_outline,
+			       ShapeBounding,
+			       0, 0, rects, 1, ShapeSubtract, 0 );
+
+      XMapWindow (w->dpy, w->drag_outline);
+    }
 
-	  wm_handle_unmap_event(w, &ev.xunmap); 
-	  break;
-	}
+  comp_engine_client_show(c->wm, c); 
 
-      case MotionNotify:
-	if (w->config->dialog_stratergy == WM_DIALOGS_STRATERGY_STATIC)
-	  break;
+  _get_mouse_position(c->wm, &w->drag_x1, &w->drag_y1);
 
-	wanted_x = (old_cx + (ev.xmotion.x - x1));
-	wanted_y = (old_cy + (ev.xmotion.y - y1));
+  w->drag_client = c;
+  w->drag_old_x  = c->x;
+  w->drag_old_y  = c->y;
 
-	c->x = wanted_x;
-	c->y = wanted_y;
+  return True;
+}
 
-	XMoveWindow(c->wm->dpy, win_outline, c->x-offset_west, c->y-frm_size);
-	break;
+/* Ends the drag, client_removed when the dialog went away under it */
+static void
+dialog_client_drag_end(Client *c, Bool client_removed)
+{
+  Wm *w = c->wm;
 
-      case ButtonRelease:
-	XMoveWindow(c->wm->dpy, c->frame, c->x - offset_west,
-		    c->y - dialog_client_title_height(c));
-	done = True;
-	break;
-      }
-    }
+  dbg("%s called\n", __func__);
 
+  w->drag_client = NULL;
 
   XUngrabPointer(w->dpy, CurrentTime);
 
   misc_trap_xerrors(); 
-  XDestroyWindow (w->dpy, win_outline);
+
+  if (w->drag_outline != None)
+    {
+      XDestroyWindow (w->dpy, w->drag_outline);
+      w->drag_outline = None;
+    }
 
   if (client_removed == False) 
     {
+      /* Could have been dragged onto another output */
+      c->output = wm_output_at(w, c->x + c->width/2, c->y + c->height/2);
+
       c->show(c);
       
       if (w->config->dialog_stratergy != WM_DIALOGS_STRATERGY_STATIC)
@@ -1194,8 +1202,78 @@ dialog_client_drag(Client *c) /* drag box */
     }
 
   misc_untrap_xerrors();
+
+  if (client_removed == False
+      && w->config->dialog_stratergy == WM_DIALOGS_STRATERGY_STATIC)
+    dialog_client_static_reshow(c);
 }
 
+/* Returns True if the event belonged to a drag in progress */
+Bool
+dialog_client_drag_handle_event(Wm *w, XEvent *ev)
+{
+  Client *c = w->drag_client;
+  XEvent  latest, next;
+  int     offset_south = 0, offset_west = 0, offset_east = 0;
+
+  switch (ev->type) 
+    {
+    case MotionNotify:
+      if (w->config->dialog_stratergy == WM_DIALOGS_STRATERGY_STATIC)
+	return True;
+
+      /* Only the newest position matters, but only skip motion that
+       * is next in the queue so we never jump past a ButtonRelease. */
+      latest = *ev;
+      while (XPending(w->dpy))
+	{
+	  XPeekEvent(w->dpy, &next);
+
+	  if (next.type != MotionNotify 
+	      || next.xmotion.window != latest.xmotion.window)
+	    break;
+
+	  XNextEvent(w->dpy, &latest);
+	}
+
+      dialog_client_get_offsets(c, &offset_east, &offset_south, &offset_west);
+
+      c->x = (w->drag_old_x + (latest.xmotion.x - w->drag_x1));
+      c->y = (w->drag_old_y + (latest.xmotion.y - w->drag_y1));
+
+      if (w->drag_live)
+	{
+	  XMoveWindow(w->dpy, c->frame, c->x - offset_west,
+		      c->y - dialog_client_title_height(c));
+	  comp_engine_client_configure(w, c);
+	  comp_engine_client_show(w, c);
+	}
+      else
+	XMoveWindow(w->dpy, w->drag_outline, c->x - offset_west, 
+		    c->y - dialog_client_title_height(c));
+      return True;
+
+    case ButtonRelease:
+      dialog_client_get_offsets(c, &offset_east, &offset_south, &offset_west);
+
+      XMoveWindow(w->dpy, c->frame, c->x - offset_west,
+		  c->y - dialog_client_title_height(c));
+
+      dialog_client_drag_end(c, False);
+      return True;
+
+    case ButtonPress:
+      return True;
+
+    case UnmapNotify:
+      /* Drop the drag, then let the wm handle the unmap as usual */
+      if (wm_find_client(w, ev->xunmap.window, WINDOW) == c)
+	dialog_client_drag_end(c, True);
+      break;
+    }
+
+  return False;
+}
 
 static void
 _get_mouse_position(Wm *w, int *x, int *y)
@@ -1204,6 +1282,7 @@ _get_mouse_position(Wm *w, int *x, int *y)
   int win_x, win_y;
   unsigned int mask;
   
+  STATS_ROUND_TRIP();
   XQueryPointer(w->dpy, w->root, &mouse_root, &mouse_win,
 		x, y, &win_x, &win_y, &mask);
 }
@@ -1300,6 +1379,9 @@ dialog_client_destroy(Client *c)
 {
   Client *d = NULL;
 
+  if (c->wm->drag_client == c)
+    dialog_client_drag_end(c, True);
+
   /* Focus the saved next or return a likely candidate if none found */
   d = dialog_client_set_focus_next(c);
 
@@ -62,6 +62,9 @@ dialog_client_iconize(Client *c);
 void 
 dialog_client_destroy (Client *c);
 
+Bool
+dialog_client_drag_handle_event (Wm *w, XEvent *ev);
+
 /* dialog only methods */
 
 int  
@@ -34,6 +34,7 @@ dockbar_client_new(Wm *w, Window win)
    if (!c) return NULL;
 
    c->type         = MBCLIENT_TYPE_PANEL;
+   stack_update_type(c);
    c->configure    = &dockbar_client_configure;
    c->show         = &dockbar_client_show;
    c->hide         = &dockbar_client_hide;
@@ -50,7 +51,8 @@ dockbar_client_new(Wm *w, Window win)
 static int
 dockbar_client_orientation_calc(Client *c)
 {
-  Wm *w = c->wm;
+  Wm       *w = c->wm;
+  MBOutput *o;
 
   dbg("%s() called, x:%i, y:%i, w:%i h:%i\n", __func__, 
       c->x, c->y, c->width, c->height);
@@ -72,16 +74,18 @@ dockbar_client_orientation_calc(Client *c)
 	}
     }
 
+  o = &w->outputs[c->output]; /* Edges are of the output its on */
+
   if (c->width > c->height)	/* Assume Horizonal north/south Dock */
     {
-      if (c->y < (w->dpy_height/2))
+      if (c->y - o->y < (o->height/2))
 	return CLIENT_DOCK_NORTH;
       else
 	return CLIENT_DOCK_SOUTH;
     }
   else
     {
-      if (c->x < (w->dpy_width/2))
+      if (c->x - o->x < (o->width/2))
 	return CLIENT_DOCK_WEST;
       else
 	return CLIENT_DOCK_EAST;
@@ -91,7 +95,8 @@ dockbar_client_orientation_calc(Client *c)
 void
 dockbar_client_configure(Client *c)
 {
-  Wm *w = c->wm;
+  Wm       *w = c->wm;
+  MBOutput *o = &w->outputs[c->output];
 
   int n_offset = wm_get_offsets_size(c->wm, NORTH, c, False);
   int s_offset = wm_get_offsets_size(c->wm, SOUTH, c, False);
@@ -104,33 +109,33 @@ dockbar_client_configure(Client *c)
 
    if (c->flags & CLIENT_DOCK_NORTH)
      {
-       c->y = n_offset;
-       c->x = w_offset;
-       c->width  = w->dpy_width - e_offset - w_offset;
+       c->y = o->y + n_offset;
+       c->x = o->x + w_offset;
+       c->width  = o->width - e_offset - w_offset;
      }
    else if (c->flags & CLIENT_DOCK_SOUTH)
      {
-       c->y = w->dpy_height - s_offset - c->height;
-       c->x = w_offset;
-       c->width  = w->dpy_width - e_offset - w_offset;
+       c->y = o->y + o->height - s_offset - c->height;
+       c->x = o->x + w_offset;
+       c->width  = o->width - e_offset - w_offset;
      }
    else if (c->flags & CLIENT_DOCK_WEST)
      {
-       c->y = 0;
-       c->x = w_offset;
-       c->height = w->dpy_height;
+       c->y = o->y;
+       c->x = o->x + w_offset;
+       c->height = o->height;
      }
    else if (c->flags & CLIENT_DOCK_EAST)
      {
-       c->y = 0;
-       c->x = w->dpy_width - e_offset - c->width;
-       c->height = w->dpy_height;
+       c->y = o->y;
+       c->x = o->x + o->width - e_offset - c->width;
+       c->height = o->height;
      }
    else if (c->flags & CLIENT_DOCK_TITLEBAR)
      {
        XRectangle rect;
 
-       mbtheme_get_titlebar_panel_rect(w->mbtheme, &rect, NULL);
+       mbtheme_get_titlebar_panel_rect(w->mbtheme, c->output, &rect, NULL);
  
        c->x      = rect.x + w_offset; 
        c->y      = rect.y + n_offset;
@@ -157,6 +162,8 @@ dockbar_client_move_resize(Client *c)
 
   base_client_move_resize(c);
 
+  wm_offsets_invalidate(w);
+
   dbg("%s() to %s  x: %i , y: %i w: %i h: %i \n", 
       __func__, c->name, c->x, c->y, c->width, c->height);
 
@@ -176,15 +183,11 @@ dockbar_client_show(Client *c) /*TODO: show and hide share common static func*/
   XGrabServer(w->dpy);
   
   c->mapped = True;
+
+  wm_offsets_invalidate(w);
   
-  if (c->flags & CLIENT_DOCK_EAST || c->flags & CLIENT_DOCK_WEST)
-    wm_update_layout(c->wm, c, - c->width);
-  else if ( c->flags & CLIENT_DOCK_NORTH )
-    {
-      wm_update_layout(c->wm, c, - c->height);
-    }
-  else if ( c->flags & CLIENT_DOCK_SOUTH )
-    wm_update_layout(c->wm, c, - c->height);
+  if (!(c->flags & CLIENT_DOCK_TITLEBAR))
+    wm_update_layout(c->wm, c->output);
   
   client_set_state(c, NormalState);
 
@@ -205,11 +208,11 @@ dockbar_client_hide(Client *c)
   client_set_state(c, IconicState);
   
   c->mapped = False; 		/* Same reasoning as toolbar_destroy */
+
+  wm_offsets_invalidate(w);
   
-  if (c->flags & CLIENT_DOCK_EAST || c->flags & CLIENT_DOCK_WEST)
-    wm_update_layout(c->wm, c, c->width);
-  else if (!(c->flags & CLIENT_DOCK_TITLEBAR))
-    wm_update_layout(c->wm, c, c->height);
+  if (!(c->flags & CLIENT_DOCK_TITLEBAR))
+    wm_update_layout(c->wm, c->output);
   
   base_client_hide(c);
   
@@ -224,11 +227,11 @@ dockbar_client_destroy(Client *c)
     w->have_titlebar_panel = NULL;
   
   c->mapped = False;
+
+  wm_offsets_invalidate(w);
   
-  if (c->flags & CLIENT_DOCK_EAST || c->flags & CLIENT_DOCK_WEST)
-    wm_update_layout(c->wm, c, c->width );
-  else if (!(c->flags & CLIENT_DOCK_TITLEBAR))
-    wm_update_layout(c->wm, c, c->height);
+  if (!(c->flags & CLIENT_DOCK_TITLEBAR))
+    wm_update_layout(c->wm, c->output);
   
   base_client_destroy(c);
 }
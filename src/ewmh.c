@@ -122,9 +122,17 @@ ewmh_init(Wm *w)
     "_NET_WM_WINDOW_TYPE_NOTIFICATION",
     "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU",
     "_NET_WM_WINDOW_TYPE_POPUP_MENU",
-    "_MB_NUM_SYSTEM_MODAL_WINDOWS_PRESENT"
+    "_MB_NUM_SYSTEM_MODAL_WINDOWS_PRESENT",
+    "_MB_DEBUG_THEME_FOOTPRINT",
+    "_MB_TRACE_FILE",
+    "_MB_STATS",
+    "_MB_RESTART_STATE",
+    "SM_CLIENT_ID",
+    "WM_CLIENT_LEADER",
+    "WM_WINDOW_ROLE"
   };
 
+  STATS_ROUND_TRIP();
   XInternAtoms (w->dpy, atom_names, ATOM_COUNT,
                 False, w->atoms);
 
@@ -317,74 +325,10 @@ ewmh_update_lists(Wm *w)
    Client        *c = NULL;
    Window        *wins = NULL;
    int            cnt = 0;
+   MBTraceTime    trace_start = trace_now();
    
    dbg("%s(): called %i\n", __func__, n_stack_items(w)); 
 
-#ifdef USE_LIBSN
-   unsigned char *bin_map_str = NULL; 
-   int  bin_map_cnt = 0;
-   SnCycle *current_cycle = w->sn_cycles;
-
-   dbg("%s() called\n", __func__);
-
-   while(current_cycle != NULL)
-     {
-       dbg("%s() checking cycle %s\n", __func__, current_cycle->bin_name);
-       if (current_cycle->xid != None)
-	{
-	  dbg("%s() has xid %li\n", __func__, current_cycle->xid);
-	  bin_map_cnt += (strlen(current_cycle->bin_name) + 32);
-	  dbg("%s(): bin_map_cnt : %i, name: %s\n", __func__, 
-	      bin_map_cnt, current_cycle->bin_name) ;
-	}
-       current_cycle = current_cycle->next;
-     }
-   
-  if (bin_map_cnt)
-    {
-      bin_map_str = malloc(sizeof(unsigned char)*bin_map_cnt);
-      memset( bin_map_str, 0, bin_map_cnt);
-      
-      current_cycle = w->sn_cycles;
-      
-      while(current_cycle != NULL)
-	{
-	  if (current_cycle->xid != None)
-	    {
-	      char str_tmp[256] = "";
-	      snprintf(str_tmp, 256, "%s=%li|", 
-		       current_cycle->bin_name, 
-		       current_cycle->xid);
-	      
-	      strcat(bin_map_str, str_tmp);
-	      
-	      dbg("%s(): bin_map_str : %s , str_tmp: %s \n", 
-		  __func__, bin_map_str, str_tmp) ;
-	    }
-	  current_cycle = current_cycle->next;
-	}
-      
-      if (bin_map_str) 
-	{
-	  XChangeProperty(w->dpy, w->root, w->atoms[MB_CLIENT_EXEC_MAP] ,
-			  XA_STRING, 8, PropModeReplace,
-			  (unsigned char *)bin_map_str, strlen(bin_map_str)
-			  );
-	  free(bin_map_str);
-	} else {
-	  dbg("%s() deleting MB_CLIENT_EXEC_MAP\n", __func__);
-	  XDeleteProperty(w->dpy, w->root, w->atoms[MB_CLIENT_EXEC_MAP]);
-	}
-      XFlush(w->dpy);
-    }
-  else
-    {
-      dbg("%s() deleting MB_CLIENT_EXEC_MAP\n", __func__);
-      XDeleteProperty(w->dpy, w->root, w->atoms[MB_CLIENT_EXEC_MAP]);
-    }
-
-#endif
-
   /* Root window client win lists */
 
   if (!stack_empty(w))
@@ -469,6 +413,8 @@ ewmh_update_lists(Wm *w)
 		      XA_CARDINAL, 32, PropModeReplace,
 		      (unsigned char *)&modal_blockers, 1);
     }
+
+  trace_record("ewmh_update_lists", trace_start, cnt);
 }
 
 void
@@ -486,13 +432,14 @@ ewmh_update_desktop_hint(Wm *w)
 void
 ewmh_update_rects(Wm *w)
 {
-  long val[4];
+  MBOutput *o = &w->outputs[0]; /* The primary, one area is all it has */
+  long      val[4];
 
-  val[0] = wm_get_offsets_size(w, WEST, NULL, True);
-  val[1] = wm_get_offsets_size(w, NORTH, NULL, True);
-  val[2] = w->dpy_width - wm_get_offsets_size(w, WEST, NULL, True)
+  val[0] = o->x + wm_get_offsets_size(w, WEST, NULL, True);
+  val[1] = o->y + wm_get_offsets_size(w, NORTH, NULL, True);
+  val[2] = o->width - wm_get_offsets_size(w, WEST, NULL, True)
     - wm_get_offsets_size(w, EAST, NULL, True);
-  val[3] = w->dpy_height - wm_get_offsets_size(w, NORTH, NULL, True)
+  val[3] = o->height - wm_get_offsets_size(w, NORTH, NULL, True)
     - wm_get_offsets_size(w, SOUTH, NULL, True);
 
   if (w->flags & DESKTOP_DECOR_FLAG)
@@ -506,6 +453,13 @@ ewmh_update_rects(Wm *w)
       val[3] -= theme_frame_defined_height_get(w->mbtheme, FRAME_MAIN); 
     }
 
+  w->work_area_dirty = False;
+
+  if (!memcmp(val, w->work_area, sizeof(val)))
+    return;
+
+  memcpy(w->work_area, val, sizeof(val));
+
   dbg("%s(): vals now is %li, %li, %li, %li ( root: %li )\n", 
       __func__, val[0], val[1], val[2], val[3], w->root );
 
@@ -564,11 +518,11 @@ state_check (Client *c, Atom check, Atom atom_state_wanted)
   int           format, status, i;
   Atom          realType, *value = NULL;
 
-  status = XGetWindowProperty(w->dpy, c->window,
-			      check,
-			      0L, 1000000L,
-			      0, XA_ATOM, &realType, &format,
-			      &n, &extra, (unsigned char **) &value);
+  status = stats_xget_window_property(w->dpy, c->window,
+				      check,
+				      0L, 1000000L,
+				      0, XA_ATOM, &realType, &format,
+				      &n, &extra, (unsigned char **) &value);
   if (status == Success)
     {
       if (realType == XA_ATOM && format == 32 && n > 0)
@@ -657,15 +611,15 @@ ewmh_get_user_time (Client *c)
   unsigned long items_read, items_left;
   int          *data = NULL, result = -1;
 
-  if (XGetWindowProperty(w->dpy, c->window,
-			 w->atoms[_NET_WM_USER_TIME], 
-			 0L, 2L, False,
-			 XA_CARDINAL, 
-			 &real_type, 
-			 &real_format,
-			 &items_read, 
-			 &items_left,
-			 (unsigned char **) &data) == Success
+  if (stats_xget_window_property(w->dpy, c->window,
+				 w->atoms[_NET_WM_USER_TIME], 
+				 0L, 2L, False,
+				 XA_CARDINAL, 
+				 &real_type, 
+				 &real_format,
+				 &items_read, 
+				 &items_left,
+				 (unsigned char **) &data) == Success
       && items_read)
     result = *data;
 
@@ -696,10 +650,27 @@ ewmh_set_current_app_window(Wm *w)
 }
 
 
+#ifndef NO_PING
+/* Runs every PING_CHECK_FREQ seconds while anything is being pinged */
+static void
+ewmh_ping_timeout (Wm *w, void *data)
+{
+  w->ping_timer = NULL;
+
+  ewmh_hung_app_check(w);
+
+  if (w->n_active_ping_clients && w->ping_timer == NULL)
+    w->ping_timer = timer_add(w, PING_CHECK_FREQ * 1000, 
+			      ewmh_ping_timeout, NULL);
+}
+#endif
+
 void
 ewmh_ping_client_start (Client *c)
 {
 #ifndef NO_PING
+  Wm *w = c->wm;
+
   if (c->has_ping_protocol && c->pings_pending == -1) 
     {
       c->pings_pending       = 0;
@@ -707,6 +678,10 @@ ewmh_ping_client_start (Client *c)
       c->ping_handler_called = False;
       c->wm->n_active_ping_clients++;
 
+      if (w->ping_timer == NULL)
+	w->ping_timer = timer_add(w, PING_CHECK_FREQ * 1000, 
+				  ewmh_ping_timeout, NULL);
+
       dbg("starting pinging '%s' , active: %i\n", 
 	  c->name, c->wm->n_active_ping_clients);
     }
@@ -725,6 +700,12 @@ ewmh_ping_client_stop (Client *c)
       c->pings_pending = -1;
       c->wm->n_active_ping_clients--;
 
+      if (!c->wm->n_active_ping_clients && c->wm->ping_timer)
+	{
+	  timer_remove(c->wm, c->wm->ping_timer);
+	  c->wm->ping_timer = NULL;
+	}
+
       dbg("stopping pinging '%s' , active: %i\n", 
 	  c->name, c->wm->n_active_ping_clients);
     }
@@ -765,6 +746,7 @@ ewmh_hung_app_check(Wm *w)
 	  */
 	  e.xclient.data.l[1] = c->window;
 	  XSendEvent(w->dpy, c->window, False, 0, &e);
+	  STATS_ROUND_TRIP();
 	  XSync(w->dpy, False);
 
 	  c->pings_sent++;
@@ -888,11 +870,11 @@ ewmh_get_utf8_prop(Wm *w, Window win, Atom req_atom)
 
   misc_trap_xerrors();
 
-  result =  XGetWindowProperty (w->dpy, win, req_atom,
-				0, 1024L,
-				False, w->atoms[UTF8_STRING],
-				&type, &format, &n_items,
-				&bytes_after, (unsigned char **)&str);
+  result =  stats_xget_window_property(w->dpy, win, req_atom,
+				       0, 1024L,
+				       False, w->atoms[UTF8_STRING],
+				       &type, &format, &n_items,
+				       &bytes_after, (unsigned char **)&str);
 
 
 
@@ -931,11 +913,11 @@ ewmh_get_icon_prop_data(Wm *w, Window win)
 
   misc_trap_xerrors();
 
-  result =  XGetWindowProperty (w->dpy, win, w->atoms[_NET_WM_ICON],
-				0, 100000L,
-				False, XA_CARDINAL,
-				&type, &format, &n_items,
-				&bytes_after, (unsigned char **)&data);
+  result =  stats_xget_window_property(w->dpy, win, w->atoms[_NET_WM_ICON],
+				       0, 100000L,
+				       False, XA_CARDINAL,
+				       &type, &format, &n_items,
+				       &bytes_after, (unsigned char **)&data);
 
   if (misc_untrap_xerrors() || result != Success || data == NULL)
     {
@@ -1054,9 +1036,54 @@ sync_value_increment (XSyncValue *value)
   XSyncValueAdd (value, *value, one, &overflow);
 }
 
+#define SYNC_ALARM_BUCKET(a) ((a) % EWMH_SYNC_ALARM_BUCKETS)
+
+static Client*
+sync_alarm_index_find(Wm *w, XSyncAlarm alarm)
+{
+  Client *client = w->sync_alarm_index[SYNC_ALARM_BUCKET(alarm)];
+
+  while (client != NULL && client->ewmh_sync_alarm != alarm)
+    client = client->ewmh_sync_next;
+
+  return client;
+}
+
+static void
+sync_alarm_index_add(Client *client)
+{
+  Wm  *w      = client->wm;
+  int  bucket = SYNC_ALARM_BUCKET(client->ewmh_sync_alarm);
+
+  client->ewmh_sync_next      = w->sync_alarm_index[bucket];
+  w->sync_alarm_index[bucket] = client;
+}
+
+static void
+sync_alarm_index_remove(Client *client)
+{
+  Wm      *w    = client->wm;
+  Client **link = &w->sync_alarm_index[SYNC_ALARM_BUCKET(client->ewmh_sync_alarm)];
+
+  while (*link != NULL)
+    {
+      if (*link == client)
+	{
+	  *link = client->ewmh_sync_next;
+	  break;
+	}
+      link = &(*link)->ewmh_sync_next;
+    }
+
+  client->ewmh_sync_next = NULL;
+}
+
 void
 ewmh_sync_init(Wm *w)
 {
+  memset(w->sync_alarm_index, 0, sizeof(w->sync_alarm_index));
+  w->n_sync_waiting = 0;
+
   if (!XSyncQueryExtension (w->dpy,
                             &w->sync_event_base,
                             &w->sync_error_base))
@@ -1069,29 +1096,79 @@ ewmh_sync_init(Wm *w)
   w->have_xsync = True;
 }
 
-void
-ewmh_sync_handle_event(Wm *w, XSyncAlarmNotifyEvent *ev)
+/* Client has painted at its new size ( or we gave up on it ). Let
+ * the compositor show what it drew and send on any resize that 
+ * queued up meanwhile - only the latest geometry matters.
+ */
+static void
+sync_client_done(Client *client)
 {
-  Client *client = NULL;
+  Wm *w = client->wm;
 
-  stack_enumerate(w, client)
+  if (!client->ewmh_sync_is_waiting)
+    return;
+
+  client->ewmh_sync_is_waiting = False;
+  w->n_sync_waiting--;
+
+  if (client->ewmh_sync_timer)
     {
-      if (client->ewmh_sync_alarm == ev->alarm)
-	break;
+      timer_remove(w, client->ewmh_sync_timer);
+      client->ewmh_sync_timer = NULL;
     }
 
-  if (client) 			/* XXX should check alarm matches */
+  comp_engine_client_repair(w, client);
+
+  if (client->ewmh_sync_pending)
     {
-      dbg("%s() found client %s\n", __func__, client->name);
+      dbg("%s() sending queued resize to %s\n", __func__, client->name);
+      client->ewmh_sync_pending = False;
       client->move_resize(client);
+      client_deliver_config(client);
     }
 }
 
+void
+ewmh_sync_handle_event(Wm *w, XSyncAlarmNotifyEvent *ev)
+{
+  Client *client = sync_alarm_index_find(w, ev->alarm);
+
+  if (client == NULL)
+    return;
+
+  /* Ignore stragglers from requests before the current one */
+  if (XSyncValueLessThan(ev->counter_value, client->ewmh_sync_value))
+    {
+      dbg("%s() stale alarm for %s\n", __func__, client->name);
+      return;
+    }
+
+  dbg("%s() found client %s\n", __func__, client->name);
+
+  sync_client_done(client);
+}
+
+/* Client never answered, show what it has anyway */
+static void
+sync_client_timeout(Wm *w, void *data)
+{
+  Client *client = (Client *)data;
+
+  dbg("%s() %s timed out on sync request\n", __func__, client->name);
+
+  client->ewmh_sync_timer = NULL; /* already gone */
+  sync_client_done(client);
+}
+
+/* Returns True if the resize has been queued behind a request the 
+ * client has not finished yet, caller should leave the windows be. 
+ * Otherwise a new request is sent and the caller resizes as usual.
+ */
 Bool
 ewmh_sync_client_move_resize(Client *client)
 {
   Wm *w = client->wm;
-  unsigned long highval, lowval;
+  XSyncAlarmAttributes values;
 
   if (!w->have_xsync) 
     return False;
@@ -1099,27 +1176,43 @@ ewmh_sync_client_move_resize(Client *client)
   if (!client->has_ewmh_sync)
     return False;
 
-  if (client->ewmh_sync_is_waiting)
-    return False; 		/* XXX WRONG XXX */
+  /* Unmapped or hidden clients never paint, so would never answer */
+  if (!client->mapped)
+    return False;
 
-  ewmh_sync_client_init_counter(client);
+  if (client->ewmh_sync_is_waiting)
+    {
+      dbg("%s() %s still painting, queueing resize\n", 
+	  __func__, client->name);
+      client->ewmh_sync_pending = True;
+      return True;
+    }
 
-  lowval  = XSyncValueLow32 (client->ewmh_sync_value);
-  highval = XSyncValueHigh32 (client->ewmh_sync_value);
+  if (!ewmh_sync_client_init_counter(client))
+    return False;
 
   sync_value_increment (&client->ewmh_sync_value);
 
+  values.trigger.wait_value = client->ewmh_sync_value;
+  XSyncChangeAlarm (w->dpy, client->ewmh_sync_alarm, XSyncCAValue, &values);
+
   dbg("%s() delivering _NET_WM_SYNC_REQUEST\n", __func__);
 
   client_deliver_message(client, 
 			 w->atoms[WM_PROTOCOLS], 
 			 w->atoms[_NET_WM_SYNC_REQUEST], 
-			 CurrentTime, lowval, highval,
+			 CurrentTime, 
+			 XSyncValueLow32 (client->ewmh_sync_value), 
+			 XSyncValueHigh32 (client->ewmh_sync_value),
 			 0);
   
+  client->ewmh_sync_timer = timer_add(w, EWMH_SYNC_TIMEOUT,
+				      sync_client_timeout, client);
+
   client->ewmh_sync_is_waiting = True;
+  w->n_sync_waiting++;
   
-  return True;
+  return False;
 }
 
 Bool
@@ -1130,8 +1223,8 @@ ewmh_sync_client_init_counter(Client *client)
   XSyncAlarmAttributes values;
   Atom                 type;
   int                  format, result;
-  long                 bytes_after, n_items;
-  XID                 *value;
+  unsigned long        bytes_after, n_items;
+  XID                 *value = NULL;
 
   if (!w->have_xsync) 
     return False;
@@ -1139,12 +1232,15 @@ ewmh_sync_client_init_counter(Client *client)
   if (!client->has_ewmh_sync)
     return False;
 
-  result =  XGetWindowProperty (w->dpy, client->window, 
-				w->atoms[_NET_WM_SYNC_REQUEST_COUNTER],
-				0, 1024L,
-				False, XA_CARDINAL,
-				&type, &format, &n_items,
-				&bytes_after, (unsigned char **)&value);
+  if (client->ewmh_sync_alarm != None) /* Already set up */
+    return True;
+
+  result =  stats_xget_window_property(w->dpy, client->window, 
+				       w->atoms[_NET_WM_SYNC_REQUEST_COUNTER],
+				       0, 1024L,
+				       False, XA_CARDINAL,
+				       &type, &format, &n_items,
+				       &bytes_after, (unsigned char **)&value);
 
   if (result != Success || value == NULL || format != 32)
     {
@@ -1156,15 +1252,20 @@ ewmh_sync_client_init_counter(Client *client)
   dbg("%s() creating alarm\n", __func__);
 
   client->ewmh_sync_counter = *value;
+  XFree (value);
+
+  misc_trap_xerrors();
 
+  /* ewmh_sync_value always holds the last value requested, the alarm
+   * is pointed at each new one in ewmh_sync_client_move_resize() 
+   */
   XSyncIntsToValue (&client->ewmh_sync_value, random(), 0);
   XSyncSetCounter (w->dpy, client->ewmh_sync_counter, client->ewmh_sync_value);
 
-  sync_value_increment (&client->ewmh_sync_value);
-
   values.events = True;
   values.trigger.counter    = client->ewmh_sync_counter;
   values.trigger.wait_value = client->ewmh_sync_value;
+  sync_value_increment (&values.trigger.wait_value);
   values.trigger.value_type = XSyncAbsolute;
   values.trigger.test_type  = XSyncPositiveComparison;
   XSyncIntToValue (&values.delta, 1);
@@ -1182,13 +1283,43 @@ ewmh_sync_client_init_counter(Client *client)
 					      | XSyncCADelta 
 					      | XSyncCAEvents,
 					      &values);
+  STATS_ROUND_TRIP();
   XSync (w->dpy, False);
 
-  /* XXX untrap error here */
+  if (misc_untrap_xerrors())
+    {
+      dbg("%s() bad counter, not syncing %s\n", __func__, client->name);
+      client->has_ewmh_sync   = False;
+      client->ewmh_sync_alarm = None;
+      return False;
+    }
+
+  sync_alarm_index_add(client);
 
   return True;
 }
 
+void
+ewmh_sync_client_destroy(Client *client)
+{
+  Wm *w = client->wm;
+
+  if (client->ewmh_sync_alarm == None)
+    return;
+
+  if (client->ewmh_sync_is_waiting)
+    {
+      w->n_sync_waiting--;
+      timer_remove(w, client->ewmh_sync_timer);
+      client->ewmh_sync_timer = NULL;
+    }
+
+  sync_alarm_index_remove(client);
+
+  XSyncDestroyAlarm (w->dpy, client->ewmh_sync_alarm);
+  client->ewmh_sync_alarm = None;
+}
+
 #endif
 
 
@@ -114,6 +114,10 @@ ewmh_sync_client_move_resize(Client *client);
 Bool
 ewmh_sync_client_init_counter(Client *client);
 
+void
+ewmh_sync_client_destroy(Client *client);
+
+
 #endif /* USE_XSYNC */
 
 #endif
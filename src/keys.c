@@ -20,6 +20,7 @@
 
 #include "structs.h"
 #include "keys.h"
+#include <X11/Xproto.h> /* X_GrabKey */
 
 #ifndef NO_KBD
 
@@ -204,6 +205,8 @@ keys_add_entry(Wm *w, char *keystr, int action, int idata, char *sdata)
       entry = entry->next_entry;
     }
 
+  memset(entry, 0, sizeof(MBConfigKbdEntry));
+
   entry->next_entry   = NULL;
   entry->action       = action;
   entry->ModifierMask = mask;
@@ -419,10 +422,13 @@ void
 keys_get_modifiers(Wm *w)
 {
   int mod_idx, mod_key, col, kpm;
-  XModifierKeymap *mod_map = XGetModifierMapping(w->dpy);
+  XModifierKeymap *mod_map;
 
   MBConfigKbd *kbd =  w->config->kb;
 
+  STATS_ROUND_TRIP();
+  mod_map = XGetModifierMapping(w->dpy);
+
   kbd->MetaMask = 0;
   kbd->HyperMask = 0;
   kbd->SuperMask = 0;
@@ -485,15 +491,92 @@ keys_get_modifiers(Wm *w)
 
 }
 
+/* Resolve each entry to the keycode it is grabbed on and chain them 
+ * up by it, so a KeyPress is just a table lookup. Needs redoing 
+ * whenever the keyboard mapping changes.
+ */
+static void
+keys_table_build(Wm *w)
+{
+  MBConfigKbd      *kb    = w->config->kb;
+  MBConfigKbdEntry *entry = NULL, *tail = NULL;
+
+  memset(kb->keycode_table, 0, sizeof(kb->keycode_table));
+
+  for (entry = kb->entrys; entry != NULL; entry = entry->next_entry)
+    {
+      entry->keycode            = XKeysymToKeycode(w->dpy, entry->key);
+      entry->next_keycode_entry = NULL;
+
+      if (entry->keycode == 0) 
+	continue;
+
+      /* Keep config file order, several entries can share a key */
+      if ((tail = kb->keycode_table[entry->keycode]) == NULL)
+	kb->keycode_table[entry->keycode] = entry;
+      else
+	{
+	  while (tail->next_keycode_entry != NULL)
+	    tail = tail->next_keycode_entry;
+	  tail->next_keycode_entry = entry;
+	}
+    }
+}
+
+MBConfigKbdEntry*
+keys_lookup(Wm *w, KeyCode keycode)
+{
+  return w->config->kb->keycode_table[keycode];
+}
+
+/* Grab failures are collected for the whole batch and matched back 
+ * to their entry by request serial once the server has caught up.
+ */
+static Wm *keys_grab_wm = NULL;
+
+static int
+keys_grab_xerror_handler(Display *dpy, XErrorEvent *e)
+{
+  MBConfigKbdEntry *entry = NULL, *culprit = NULL;
+
+  if (keys_grab_wm == NULL || e->request_code != X_GrabKey)
+    return 0;
+
+  for (entry = keys_grab_wm->config->kb->entrys; 
+       entry != NULL; 
+       entry = entry->next_entry)
+    if (entry->keycode && entry->grab_serial <= e->serial)
+      culprit = entry;
+
+  if (culprit) 
+    culprit->grab_error = e->error_code;
+
+  return 0;
+}
+
 void
 keys_grab(Wm *w, Bool ungrab)
 {
   MBConfigKbdEntry *entry =  w->config->kb->entrys;
+  int (*old_handler) (Display *d, XErrorEvent *e) = NULL;
+
+  if (!ungrab)
+    {
+      keys_grab_wm = w;
+      old_handler  = XSetErrorHandler(keys_grab_xerror_handler);
+    }
 
-  while (entry != NULL)
+  for (; entry != NULL; entry = entry->next_entry)
     {
       int ignored_mask = 0;
 
+      /* Would grab every key with this mask, see keys_add_entry() */
+      if (entry->keycode == 0)
+	continue;
+
+      entry->grab_serial = NextRequest(w->dpy);
+      entry->grab_error  = Success;
+
       /* Needed to grab all ignored combo's too */
       while (ignored_mask <= (int) w->config->kb->lock_mask)
 	{                                       
@@ -506,41 +589,44 @@ keys_grab(Wm *w, Bool ungrab)
 	  if (ungrab)
 	    {
 	      dbg("keys, ungrabbing %i , %i\n", 
-		  XKeysymToKeycode(w->dpy, entry->key), entry->ModifierMask);
-	      XUngrabKey(w->dpy, 
-			 XKeysymToKeycode(w->dpy, entry->key), 
+		  entry->keycode, entry->ModifierMask);
+	      XUngrabKey(w->dpy, entry->keycode,
 			 entry->ModifierMask | ignored_mask,
 			 w->root);
 	    } else {
-
-	      int result; 
-
-	      misc_trap_xerrors();
-
 	      dbg("keys, grabbing keycode: %i , mask: %i\n", 
-		  XKeysymToKeycode(w->dpy, entry->key), 
-		  entry->ModifierMask | ignored_mask);
+		  entry->keycode, entry->ModifierMask | ignored_mask);
 
-	      XGrabKey(w->dpy, XKeysymToKeycode(w->dpy, entry->key), 
+	      XGrabKey(w->dpy, entry->keycode,
 		       entry->ModifierMask | ignored_mask,
 		       w->root, True, GrabModeAsync, GrabModeAsync);
-
-	      result = misc_untrap_xerrors(); 
-	      if (result != Success)
-		{
-		  if (result == BadAccess)
-		    fprintf(stderr, "matchbox: Some other program is already using the key %s with modifiers %x as a binding\n",  
-			    (XKeysymToString(entry->key)) ? XKeysymToString (entry->key) : "unknown", 
-			    entry->ModifierMask | ignored_mask );
-		  else
-		    fprintf(stderr, "matchbox: Unable to grab the key %s with modifiers %x as a binding\n",  
-			    (XKeysymToString(entry->key)) ? XKeysymToString (entry->key) : "unknown", 
-			    entry->ModifierMask | ignored_mask );
-		}
 	    }
 	  ++ignored_mask;
 	}
-      entry = entry->next_entry;
+    }
+
+  if (ungrab) 
+    return;
+
+  /* One round trip for the lot */
+  STATS_ROUND_TRIP();
+  XSync(w->dpy, False);
+  XSetErrorHandler(old_handler);
+  keys_grab_wm = NULL;
+
+  for (entry = w->config->kb->entrys; entry != NULL; entry = entry->next_entry)
+    {
+      if (entry->keycode == 0 || entry->grab_error == Success)
+	continue;
+
+      if (entry->grab_error == BadAccess)
+	fprintf(stderr, "matchbox: Some other program is already using the key %s with modifiers %x as a binding\n",  
+		(XKeysymToString(entry->key)) ? XKeysymToString (entry->key) : "unknown", 
+		entry->ModifierMask );
+      else
+	fprintf(stderr, "matchbox: Unable to grab the key %s with modifiers %x as a binding\n",  
+		(XKeysymToString(entry->key)) ? XKeysymToString (entry->key) : "unknown", 
+		entry->ModifierMask );
     }
 }
 
@@ -558,6 +644,8 @@ keys_entries_free(Wm *w)
     }
 
   w->config->kb->entrys = NULL;
+  memset(w->config->kb->keycode_table, 0, 
+	 sizeof(w->config->kb->keycode_table));
 }
 
 static void
@@ -571,6 +659,7 @@ keys_load_and_grab(Wm *w)
       return;
     }
 
+  keys_table_build(w);
   keys_grab(w, False);
 }
 
@@ -582,10 +671,22 @@ keys_reinit(Wm *w)
   keys_load_and_grab(w);
 }
 
+/* Keyboard mapping changed under us, keysyms may now live on 
+ * different keycodes. Entries are kept, only the keycodes move. 
+ */
+void
+keys_remap(Wm *w)
+{
+  keys_grab(w, True);   /* ungrab uses the old keycodes */
+  keys_table_build(w);
+  keys_grab(w, False);
+}
+
 void
 keys_init(Wm *w)
 {
   w->config->kb = malloc(sizeof(MBConfigKbd));
+  memset(w->config->kb, 0, sizeof(MBConfigKbd));
 
   w->config->kb->entrys = NULL;
   
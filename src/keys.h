@@ -34,6 +34,10 @@ void keys_get_modifiers(Wm *w);
 
 void keys_reinit(Wm *w);
 
+void keys_remap(Wm *w);
+
+MBConfigKbdEntry* keys_lookup(Wm *w, KeyCode keycode);
+
 void keys_init(Wm *w);
 
 void keys_grab(Wm *w, Bool want_ungrab);
@@ -19,13 +19,13 @@
  */
 
 #include "list.h"
+#include "slab.h"
 
 struct list_item*
 list_new(int id, char *name, void *data)
 {
   struct list_item* list;
-  list = malloc(sizeof(struct list_item));
-  memset(list, 0, sizeof(struct list_item));
+  list = slab_alloc(&slab_list_items);
 
   if (name) list->name = strdup(name);
   if (id)   list->id   = id;
@@ -103,7 +103,7 @@ list_remove(struct list_item** head, void *data)
 	    *head = cur->next;
 	    
 	  if (cur->name) free (cur->name);
-	  free(cur);
+	  slab_free(&slab_list_items, cur);
 	  return;
 	}
       prev = cur;
@@ -120,7 +120,7 @@ list_destroy(struct list_item** head)
     {
       next = cur->next;
       if (cur->name) free (cur->name);
-      free(cur);
+      slab_free(&slab_list_items, cur);
       cur = next;
     }
   *head = NULL;
@@ -27,6 +27,7 @@ main(int argc, char **argv)
 {
    Wm *w;
    struct sigaction act;
+   char *replay_path;
    memset(&act, 0, sizeof(struct sigaction));
    
    act.sa_handler = sig_handler;
@@ -35,6 +36,8 @@ main(int argc, char **argv)
    sigaction(SIGINT, &act,  NULL);
    sigaction(SIGHUP, &act,  NULL);
    sigaction(SIGCHLD, &act, NULL);
+   sigaction(SIGUSR1, &act, NULL); /* dump trace ring */
+   sigaction(SIGUSR2, &act, NULL); /* restart, see restart.c */
 
    signal (SIGCHLD, SIG_IGN); 	/* as now we exec via keyboard */
 
@@ -43,8 +46,16 @@ main(int argc, char **argv)
    if (getenv("MB_SYNC")) 
      XSynchronize (w->dpy, True);
 
+   /* Replay needs the recorded startup windows there to manage */
+   if ((replay_path = getenv("MB_REPLAY_FILE")) != NULL
+       && !record_replay_open(w, replay_path))
+     exit(1);
+
    wm_init_existing(w);
 
+   if (replay_path != NULL)
+     exit(record_replay_run(w));
+
    wm_event_loop(w);
    
    return 1;
@@ -67,7 +67,8 @@ main_client_check_for_single(Client *c)
       /* There was only main client till this came along */
       w->flags ^= SINGLE_FLAG; /* turn off single flag */
       if (w->stack_top_app)
-	main_client_redraw(w->stack_top_app, False); /* update menu button */
+	client_decor_queue_redraw(w->stack_top_app, 
+				  DECOR_DIRTY_NORTH); /* update menu button */
     } else if (!w->stack_top_app) /* This must be the only client*/
       c->wm->flags |= SINGLE_FLAG; /* so turn on single flag */      
 }
@@ -110,9 +111,10 @@ main_client_manage_toolbars_for_fullscreen(Client *c, Bool main_client_showing)
   return 0;
 
 #else
-  Wm     *w = c->wm;
-  Client *p  = NULL;
-  int     south_panel_size = 0, south_total_size = 0;
+  Wm       *w = c->wm;
+  MBOutput *o = &w->outputs[c->output];
+  Client   *p  = NULL;
+  int       south_panel_size = 0, south_total_size = 0;
 
   if (main_client_showing 
       && (c->flags & CLIENT_TOOLBARS_MOVED_FOR_FULLSCREEN))
@@ -122,34 +124,37 @@ main_client_manage_toolbars_for_fullscreen(Client *c, Bool main_client_showing)
       && !(c->flags & CLIENT_TOOLBARS_MOVED_FOR_FULLSCREEN))
     return 0;
 
-  south_panel_size = wm_get_offsets_size(w, SOUTH, NULL, False); 
-  south_total_size = wm_get_offsets_size(w, SOUTH, NULL, True); 
+  south_panel_size = wm_get_output_offsets_size(w, c->output, SOUTH, 
+						NULL, False); 
+  south_total_size = wm_get_output_offsets_size(w, c->output, SOUTH, 
+						NULL, True); 
 
   c->flags ^= CLIENT_TOOLBARS_MOVED_FOR_FULLSCREEN;    
 
   if (south_total_size > south_panel_size) /* there are toolbars */
     {
-      stack_enumerate(w, p)
+      stack_enumerate_type(w, p, MBCLIENT_TYPE_TOOLBAR)
 	{
 	  /* move toolbar wins up/down over panels */
-	  if (p->type == MBCLIENT_TYPE_TOOLBAR && p->mapped) 
+	  if (p->type == MBCLIENT_TYPE_TOOLBAR && p->mapped 
+	      && p->output == c->output) 
 	    {
 	      if (main_client_showing)
 		{
 		  p->y += south_panel_size; 
 
 		  /* cover vertical panels */
-		  p->x = toolbar_win_offset(p);
-		  p->width = w->dpy_width - toolbar_win_offset(p);
+		  p->x = o->x + toolbar_win_offset(p);
+		  p->width = o->width - toolbar_win_offset(p);
 		}
 	      else
 		{
 		  /* uncover any vertical panels */
-		  p->x = toolbar_win_offset(p) 
-		    + wm_get_offsets_size(w, WEST,  NULL, False);
-		  p->width = w->dpy_width - toolbar_win_offset(p)
-		    - wm_get_offsets_size(w, WEST,  NULL, False)
-		    - wm_get_offsets_size(w, EAST,  NULL, False);
+		  p->x = o->x + toolbar_win_offset(p) 
+		    + wm_get_offsets_size(w, WEST,  p, False);
+		  p->width = o->width - toolbar_win_offset(p)
+		    - wm_get_offsets_size(w, WEST,  p, False)
+		    - wm_get_offsets_size(w, EAST,  p, False);
 
 
 		  p->y -= south_panel_size; 
@@ -158,10 +163,12 @@ main_client_manage_toolbars_for_fullscreen(Client *c, Bool main_client_showing)
 
 	      p->move_resize(p);
 	      XMapRaised(w->dpy, p->frame);
+	      stack_sync_invalidate(p);
 	    }
 	  else if (p->type == MBCLIENT_TYPE_PANEL && main_client_showing)
 	    {
 	      XLowerWindow(w->dpy, p->frame);
+	      stack_sync_invalidate(p);
 	    }
 	}
 
@@ -184,30 +191,31 @@ main_client_configure(Client *c)
   int offset_west  = theme_frame_defined_width_get(c->wm->mbtheme, 
 						   FRAME_MAIN_WEST );
 
-  int h = wm_get_offsets_size(w, SOUTH, NULL, True);
+  MBOutput *o = &w->outputs[c->output];
+  int       h = wm_get_offsets_size(w, SOUTH, c, True);
 
   if (c->flags & CLIENT_TITLE_HIDDEN_FLAG) /* Decorations */
     frm_size = offset_south = offset_east = offset_west = 0;
 
    if ( c->flags & CLIENT_FULLSCREEN_FLAG )
      { 
-       c->y = 0;  
-       c->x = 0;
-       c->width  = w->dpy_width;
-       c->height = w->dpy_height - main_client_manage_toolbars_for_fullscreen(c, True);
+       c->y = o->y;  
+       c->x = o->x;
+       c->width  = o->width;
+       c->height = o->height - main_client_manage_toolbars_for_fullscreen(c, True);
      }
    else
      {
-       c->y = wm_get_offsets_size(c->wm, NORTH, NULL, False) + frm_size;
-       c->x = wm_get_offsets_size(c->wm, WEST,  NULL, False) + offset_west;
-       c->width  = c->wm->dpy_width - ( offset_east + offset_west ) 
-	 - wm_get_offsets_size(c->wm, EAST,  NULL, False)
-	 - wm_get_offsets_size(c->wm, WEST,  NULL, False);
+       c->y = o->y + wm_get_offsets_size(c->wm, NORTH, c, False) + frm_size;
+       c->x = o->x + wm_get_offsets_size(c->wm, WEST,  c, False) + offset_west;
+       c->width  = o->width - ( offset_east + offset_west ) 
+	 - wm_get_offsets_size(c->wm, EAST,  c, False)
+	 - wm_get_offsets_size(c->wm, WEST,  c, False);
 
 #ifdef USE_ALT_INPUT_WIN
-       c->height = c->wm->dpy_height - c->y - h - offset_south - main_client_manage_toolbars_for_fullscreen(c, False);
+       c->height = o->y + o->height - c->y - h - offset_south - main_client_manage_toolbars_for_fullscreen(c, False);
 #else
-       c->height = c->wm->dpy_height - c->y - h - offset_south;
+       c->height = o->y + o->height - c->y - h - offset_south;
        main_client_manage_toolbars_for_fullscreen(c, False);
 #endif
      }
@@ -333,6 +341,12 @@ main_client_move_resize(Client *c)
   if (c->flags & CLIENT_TITLE_HIDDEN_FLAG)
     offset_south = offset_east = offset_west = 0; 
 
+#ifdef USE_XSYNC
+  /* Client still painting the last size, this one goes when its done */
+  if (ewmh_sync_client_move_resize(c))
+    return;
+#endif
+
   base_client_move_resize(c);
 
   XMoveResizeWindow(w->dpy, c->window, 
@@ -349,42 +363,6 @@ main_client_move_resize(Client *c)
 				  offset_west, offset_east, 
 				  main_client_title_height(c), offset_south);
 
-
-/*
- * Disabled _NET_WM_SYNC code ( Alternate to above XMove*'s )
- * Is unfinished and initial testing did not seem to improve things.
- * Maybe re-try again at a later date.
- *
- * if (!c->ewmh_sync_is_waiting)
- *  {
- *    XMoveResizeWindow(w->dpy, c->window, 
- *			offset_west, main_client_title_height(c), 
- *			c->width, c->height);
- *   }
- * 
- * if (ewmh_sync_client_move_resize(c))
- *   {
- *     dbg("%s() not resizing frame yet\n", __func__);
- *     return; 
- *   }
- *
- * XMoveWindow(w->dpy, c->window, offset_west, main_client_title_height(c));
- * 
- * XResizeWindow(w->dpy, c->title_frame, 
- *		c->width + (offset_east + offset_west),
- *		c->height + main_client_title_height(c) + offset_south);
- * 
- * XMoveResizeWindow(w->dpy, c->frame, 
- *		    c->x - offset_west,
- *		    c->y - main_client_title_height(c), 
- *		    c->width + ( offset_east + offset_west),
- *		    c->height + main_client_title_height(c) + offset_south);
- *
- *  dbg("%s() resizing frame\n", __func__);
- *
- * c->ewmh_sync_is_waiting = False;
- */
-
 }
 
 
@@ -423,9 +401,14 @@ main_client_redraw(Client *c, Bool use_cache)
   Bool is_shaped = False;
   int  width = 0, height = 0;
   int  offset_south, offset_east, offset_west;
+  int  frames = DECOR_DIRTY_ALL;
 
   dbg("%s() called on %s\n", __func__, c->name);
 
+  /* Called from client_decor_flush(), only paint what was dirtied */
+  if (c->decor_paint_mask)
+    frames = c->decor_paint_mask;
+
    if (!w->config->use_title || c->flags & CLIENT_TITLE_HIDDEN_FLAG)
      return;
    
@@ -452,20 +435,35 @@ main_client_redraw(Client *c, Bool use_cache)
    dbg("%s() cache failed, actual redraw on %s\n", __func__, c->name);
 
    if (is_shaped) 
-     client_init_backing_mask(c, c->width + offset_east + offset_west, 
-			      c->height, height , offset_south,
-			      width - offset_east, offset_west);
+     {
+       /* shape masks cover every side, so its all or nothing */
+       frames = DECOR_DIRTY_ALL;
+       client_init_backing_mask(c, c->width + offset_east + offset_west, 
+				c->height, height , offset_south,
+				width - offset_east, offset_west);
+     }
 
-   dbg("%s() calling theme_frame_paint()\n", __func__); 
+   /* Anything still queued is covered by this paint */
+   c->decor_dirty &= ~frames;
 
-   theme_frame_paint(w->mbtheme, c, FRAME_MAIN, width, height); 
+   dbg("%s() calling theme_frame_paint()\n", __func__); 
 
-   theme_frame_paint(w->mbtheme, c, FRAME_MAIN_WEST, offset_west, c->height); 
+   if (frames & DECOR_DIRTY_WEST)
+     theme_frame_paint(w->mbtheme, c, FRAME_MAIN_WEST, 
+		       offset_west, c->height); 
   
-   theme_frame_paint(w->mbtheme, c, FRAME_MAIN_EAST, offset_east, c->height); 
+   if (frames & DECOR_DIRTY_EAST)
+     theme_frame_paint(w->mbtheme, c, FRAME_MAIN_EAST, 
+		       offset_east, c->height); 
+
+   if (frames & DECOR_DIRTY_SOUTH)
+     theme_frame_paint(w->mbtheme, c, FRAME_MAIN_SOUTH, 
+		       c->width + offset_east + offset_west, offset_south); 
 
-   theme_frame_paint(w->mbtheme, c, FRAME_MAIN_SOUTH, 
-		     c->width + offset_east + offset_west, offset_south); 
+   if (!(frames & DECOR_DIRTY_NORTH))
+     return;
+
+   theme_frame_paint(w->mbtheme, c, FRAME_MAIN, width, height); 
 
    if (!(c->flags & CLIENT_IS_DESKTOP_FLAG))
      theme_frame_button_paint(w->mbtheme, c, BUTTON_ACTION_CLOSE, 
@@ -624,10 +622,7 @@ void main_client_button_press(Client *c, XButtonEvent *e)
 		     {
 		       /* initiate pinging the app anyway for close button */
 		       if (c->has_ping_protocol && c->pings_pending == -1) 
-			 {
-			   c->pings_pending = 0;
-			   w->n_active_ping_clients++;
-			 }
+			 ewmh_ping_client_start (c);
 		     }
 		   return;
 		 }
@@ -693,7 +688,7 @@ main_client_toggle_title_bar(Client *c)
 
   Client *p = NULL;
   int prev_height = main_client_title_height(c);
-  int y_offset = wm_get_offsets_size(c->wm, NORTH, NULL, False);
+  int y_offset;
 
   if (c->flags & CLIENT_TITLE_HIDDEN_FLAG)
     return;
@@ -706,9 +701,12 @@ main_client_toggle_title_bar(Client *c)
   
   theme_img_cache_clear( w->mbtheme,  FRAME_MAIN );
   
-  stack_enumerate(c->wm, p)
+  stack_enumerate_type(c->wm, p, MBCLIENT_TYPE_APP)
     if (p->type == MBCLIENT_TYPE_APP)
       {
+	y_offset = w->outputs[p->output].y
+	  + wm_get_output_offsets_size(w, p->output, NORTH, NULL, False);
+
 	if (w->flags & TITLE_HIDDEN_FLAG)
 	  {  /* hide */
 	    p->height += (prev_height - TITLE_HIDDEN_SZ );
@@ -729,11 +727,14 @@ main_client_toggle_title_bar(Client *c)
 	    
 	    if (w->have_titlebar_panel
 		&& mbtheme_has_titlebar_panel(w->mbtheme))
-	      XMapRaised(w->dpy, w->have_titlebar_panel->frame);
+	      {
+		XMapRaised(w->dpy, w->have_titlebar_panel->frame);
+		stack_sync_invalidate(w->have_titlebar_panel);
+	      }
 	    
 	  }
 	p->move_resize(p);
-	p->redraw(p, False);
+	client_decor_queue_redraw(p, DECOR_DIRTY_ALL);
       }
   
   XUngrabServer(w->dpy);
@@ -859,6 +860,17 @@ main_client_show(Client *c)
      }
 
    c->mapped = True;
+
+   /* Catch up on repaints skipped while we were hidden */
+   if (c->flags & CLIENT_DECOR_STALE_FLAG)
+     {
+       c->flags &= ~CLIENT_DECOR_STALE_FLAG;
+       client_buttons_delete_all(c); /* reposition for new width */
+       c->decor_dirty |= DECOR_DIRTY_ALL;
+     }
+
+   if (c->decor_dirty)
+     client_decor_flush(c);
 }
 
 void
@@ -920,7 +932,7 @@ main_client_unmap(Client *c)
      {
        dbg("%s() turning on single flag\n", __func__);
        w->flags |= SINGLE_FLAG; /* turn on single flag for menu button */
-       main_client_redraw(next_client, False);
+       client_decor_queue_redraw(next_client, DECOR_DIRTY_NORTH);
      }
 
    XUnmapWindow(w->dpy, c->frame); 
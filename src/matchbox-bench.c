@@ -0,0 +1,667 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  matchbox-bench - drives a running ( or spawned ) matchbox with
+ *  scripted synthetic clients and reports per scenario latencies and
+ *  window manager cpu time. Run via 'make bench'.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+#define _GNU_SOURCE
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+
+#define MB_CMD_SET_THEME 1
+
+#define BENCH_TIMEOUT    5000 	/* ms to wait on the wm before failing */
+#define BENCH_SETTLE     200000	/* us to let the wm go idle */
+
+/* Every sample is an action followed by a fence; an app window asking
+ * for its own size back. Matchbox answers that with a synthetic
+ * ConfigureNotify and handles events in order, so once it arrives
+ * the action has been fully processed. The 'fence' scenario times
+ * the fence alone.
+ */
+
+enum {
+  ATOM_NET_WM_NAME,
+  ATOM_UTF8_STRING,
+  ATOM_NET_WM_WINDOW_TYPE,
+  ATOM_NET_WM_WINDOW_TYPE_DIALOG,
+  ATOM_NET_WM_WINDOW_TYPE_TOOLBAR,
+  ATOM_NET_SUPPORTING_WM_CHECK,
+  ATOM_MB_COMMAND,
+  ATOM_MB_THEME,
+  ATOM_MB_THEME_NAME,
+  N_ATOMS
+};
+
+static char *atom_names[] = {
+  "_NET_WM_NAME",
+  "UTF8_STRING",
+  "_NET_WM_WINDOW_TYPE",
+  "_NET_WM_WINDOW_TYPE_DIALOG",
+  "_NET_WM_WINDOW_TYPE_TOOLBAR",
+  "_NET_SUPPORTING_WM_CHECK",
+  "_MB_COMMAND",
+  "_MB_THEME",
+  "_MB_THEME_NAME",
+};
+
+typedef struct Bench
+{
+  Display *dpy;
+  int      screen;
+  Window   root;
+  Atom     atoms[N_ATOMS];
+  pid_t    wm_pid;
+  int      iterations;
+  char    *themes[2];
+} Bench;
+
+typedef struct BenchResult
+{
+  double *samples;
+  int     n_samples;
+  int     n_failed;
+} BenchResult;
+
+static double
+now_ms(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (tv.tv_sec * 1000.0) + (tv.tv_usec / 1000.0);
+}
+
+/* utime + stime of the wm in ms, -1 if we cant tell ( not linux, or
+ * wm not ours )
+ */
+static double
+wm_cpu_ms(Bench *b)
+{
+  char           path[64], buf[1024], *p;
+  FILE          *fp;
+  unsigned long  utime = 0, stime = 0;
+
+  if (b->wm_pid <= 0)
+    return -1;
+
+  snprintf(path, sizeof(path), "/proc/%i/stat", (int)b->wm_pid);
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return -1;
+
+  if (fgets(buf, sizeof(buf), fp) == NULL)
+    {
+      fclose(fp);
+      return -1;
+    }
+
+  fclose(fp);
+
+  /* skip past the command name, it can contain spaces */
+  if ((p = strrchr(buf, ')')) == NULL)
+    return -1;
+
+  if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+	     &utime, &stime) != 2)
+    return -1;
+
+  return (utime + stime) * 1000.0 / sysconf(_SC_CLK_TCK);
+}
+
+typedef struct WaitSpec
+{
+  Window window;
+  int    type;
+  Atom   atom;
+  Bool   synthetic;
+} WaitSpec;
+
+static Bool
+wait_predicate(Display *dpy, XEvent *ev, XPointer data)
+{
+  WaitSpec *spec = (WaitSpec *)data;
+
+  if (ev->type != spec->type || ev->xany.window != spec->window)
+    return False;
+
+  if (spec->type == PropertyNotify && ev->xproperty.atom != spec->atom)
+    return False;
+
+  if (spec->synthetic && !ev->xany.send_event)
+    return False;
+
+  return True;
+}
+
+/* Wait for a specific event, True if it turned up in time */
+static Bool
+wait_for(Bench *b, Window win, int type, Atom atom, Bool synthetic)
+{
+  WaitSpec spec;
+  XEvent   ev;
+  double   deadline = now_ms() + BENCH_TIMEOUT;
+  int      fd = ConnectionNumber(b->dpy);
+
+  spec.window    = win;
+  spec.type      = type;
+  spec.atom      = atom;
+  spec.synthetic = synthetic;
+
+  XFlush(b->dpy);
+
+  while (!XCheckIfEvent(b->dpy, &ev, wait_predicate, (XPointer)&spec))
+    {
+      struct timeval tv;
+      fd_set         fds;
+      double         left = deadline - now_ms();
+
+      if (left <= 0)
+	return False;
+
+      tv.tv_sec  = (long)left / 1000;
+      tv.tv_usec = ((long)left % 1000) * 1000;
+
+      FD_ZERO(&fds);
+      FD_SET(fd, &fds);
+
+      if (XPending(b->dpy) == 0)
+	select(fd + 1, &fds, NULL, NULL, &tv);
+    }
+
+  return True;
+}
+
+static void
+settle(Bench *b)
+{
+  XEvent ev;
+
+  XSync(b->dpy, False);
+  usleep(BENCH_SETTLE);
+
+  while (XPending(b->dpy))
+    XNextEvent(b->dpy, &ev);
+}
+
+static void
+set_title(Bench *b, Window win, char *title)
+{
+  XStoreName(b->dpy, win, title);
+  XChangeProperty(b->dpy, win, b->atoms[ATOM_NET_WM_NAME],
+		  b->atoms[ATOM_UTF8_STRING], 8, PropModeReplace,
+		  (unsigned char *)title, strlen(title));
+}
+
+static Window
+window_new(Bench *b, char *title, int type_atom, Window trans_for)
+{
+  Window win;
+
+  win = XCreateSimpleWindow(b->dpy, b->root, 0, 0, 200, 100, 0,
+			    BlackPixel(b->dpy, b->screen),
+			    WhitePixel(b->dpy, b->screen));
+
+  XSelectInput(b->dpy, win, StructureNotifyMask|PropertyChangeMask);
+
+  set_title(b, win, title);
+
+  if (type_atom >= 0)
+    XChangeProperty(b->dpy, win, b->atoms[ATOM_NET_WM_WINDOW_TYPE],
+		    XA_ATOM, 32, PropModeReplace,
+		    (unsigned char *)&b->atoms[type_atom], 1);
+
+  if (trans_for != None)
+    XSetTransientForHint(b->dpy, win, trans_for);
+
+  return win;
+}
+
+static Bool
+window_map_and_wait(Bench *b, Window win)
+{
+  XMapWindow(b->dpy, win);
+  return wait_for(b, win, MapNotify, None, False);
+}
+
+static Bool
+fence(Bench *b, Window app)
+{
+  XWindowAttributes attr;
+  XWindowChanges    xwc;
+
+  XGetWindowAttributes(b->dpy, app, &attr);
+
+  xwc.width = attr.width;
+  XConfigureWindow(b->dpy, app, CWWidth, &xwc);
+
+  return wait_for(b, app, ConfigureNotify, None, True);
+}
+
+static void
+result_add(BenchResult *r, double t0, Bool ok)
+{
+  if (ok)
+    r->samples[r->n_samples++] = now_ms() - t0;
+  else
+    r->n_failed++;
+}
+
+/* -- Scenarios ------------------------------------------------------ */
+
+static void
+scenario_fence(Bench *b, Window app, BenchResult *r)
+{
+  int    i;
+  double t0;
+
+  for (i = 0; i < b->iterations; i++)
+    {
+      t0 = now_ms();
+      result_add(r, t0, fence(b, app));
+    }
+}
+
+static void
+scenario_map_storm(Bench *b, Window app, BenchResult *r)
+{
+  Window *wins = malloc(sizeof(Window) * b->iterations);
+  int     i;
+  double  t0;
+  char    title[64];
+
+  for (i = 0; i < b->iterations; i++)
+    {
+      snprintf(title, sizeof(title), "bench map %i", i);
+      wins[i] = window_new(b, title, -1, None);
+
+      t0 = now_ms();
+      result_add(r, t0, window_map_and_wait(b, wins[i]));
+    }
+
+  for (i = 0; i < b->iterations; i++)
+    XDestroyWindow(b->dpy, wins[i]);
+
+  free(wins);
+}
+
+static void
+scenario_title_churn(Bench *b, Window app, BenchResult *r)
+{
+  int    i;
+  double t0;
+  char   title[64];
+
+  for (i = 0; i < b->iterations; i++)
+    {
+      snprintf(title, sizeof(title), "bench title %i %s", i,
+	       (i % 2) ? "a longer title to reflow the buttons" : "");
+      t0 = now_ms();
+      set_title(b, app, title);
+      result_add(r, t0, fence(b, app));
+    }
+}
+
+static void
+scenario_dialog(Bench *b, Window app, BenchResult *r)
+{
+  Window dialog;
+  int    i;
+  double t0;
+
+  for (i = 0; i < b->iterations; i++)
+    {
+      dialog = window_new(b, "bench dialog",
+			  ATOM_NET_WM_WINDOW_TYPE_DIALOG, app);
+      t0 = now_ms();
+      XMapWindow(b->dpy, dialog);
+      XDestroyWindow(b->dpy, dialog);
+      result_add(r, t0, fence(b, app));
+    }
+}
+
+static void
+scenario_damage_flood(Bench *b, Window app, BenchResult *r)
+{
+  GC     gc = XCreateGC(b->dpy, app, 0, NULL);
+  int    i, j;
+  double t0;
+
+  for (i = 0; i < b->iterations; i++)
+    {
+      t0 = now_ms();
+
+      for (j = 0; j < 100; j++)
+	{
+	  XSetForeground(b->dpy, gc, (j % 2) ?
+			 BlackPixel(b->dpy, b->screen) :
+			 WhitePixel(b->dpy, b->screen));
+	  XFillRectangle(b->dpy, app, gc, (j * 7) % 150, (j * 3) % 80, 50, 20);
+	}
+
+      result_add(r, t0, fence(b, app));
+    }
+
+  XFreeGC(b->dpy, gc);
+}
+
+static void
+scenario_panel_resize(Bench *b, Window app, BenchResult *r)
+{
+  Window         toolbar;
+  XWindowChanges xwc;
+  int            i;
+  double         t0;
+
+  toolbar = window_new(b, "bench toolbar",
+		       ATOM_NET_WM_WINDOW_TYPE_TOOLBAR, None);
+
+  if (!window_map_and_wait(b, toolbar))
+    {
+      r->n_failed = b->iterations;
+      XDestroyWindow(b->dpy, toolbar);
+      return;
+    }
+
+  for (i = 0; i < b->iterations; i++)
+    {
+      xwc.height = (i % 2) ? 20 : 40;
+      t0 = now_ms();
+      XConfigureWindow(b->dpy, toolbar, CWHeight, &xwc);
+      result_add(r, t0, fence(b, app));
+    }
+
+  XDestroyWindow(b->dpy, toolbar);
+}
+
+static void
+scenario_theme_switch(Bench *b, Window app, BenchResult *r)
+{
+  XEvent ev;
+  int    i;
+  double t0;
+
+  if (b->themes[0] == NULL || b->themes[1] == NULL)
+    return;
+
+  XSelectInput(b->dpy, b->root, PropertyChangeMask);
+
+  for (i = 0; i < b->iterations; i++)
+    {
+      char *theme = b->themes[i % 2];
+
+      t0 = now_ms();
+
+      XChangeProperty(b->dpy, b->root, b->atoms[ATOM_MB_THEME], XA_STRING, 8,
+		      PropModeReplace, (unsigned char *)theme, strlen(theme));
+
+      memset(&ev, 0, sizeof(ev));
+      ev.xclient.type         = ClientMessage;
+      ev.xclient.window       = b->root;
+      ev.xclient.message_type = b->atoms[ATOM_MB_COMMAND];
+      ev.xclient.format       = 8;
+      ev.xclient.data.l[0]    = MB_CMD_SET_THEME;
+
+      XSendEvent(b->dpy, b->root, False,
+		 SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+
+      /* Theme loads can finish after the command is handled, so
+       * wait on the name being published rather than the fence.
+       */
+      result_add(r, t0, wait_for(b, b->root, PropertyNotify,
+				 b->atoms[ATOM_MB_THEME_NAME], False));
+    }
+
+  XSelectInput(b->dpy, b->root, NoEventMask);
+}
+
+/* -- Reporting ------------------------------------------------------ */
+
+static int
+compare_double(const void *a, const void *b)
+{
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static double
+percentile(BenchResult *r, double pc)
+{
+  int i;
+
+  if (r->n_samples == 0)
+    return -1;
+
+  i = (int)(pc * r->n_samples + 0.5) - 1;
+
+  if (i < 0) i = 0;
+  if (i >= r->n_samples) i = r->n_samples - 1;
+
+  return r->samples[i];
+}
+
+static void
+report(char *name, BenchResult *r, double wall_ms, double cpu_ms)
+{
+  qsort(r->samples, r->n_samples, sizeof(double), compare_double);
+
+  printf("{\"scenario\": \"%s\", \"samples\": %i, \"failed\": %i, "
+	 "\"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, "
+	 "\"max_ms\": %.3f, \"wall_ms\": %.3f, \"wm_cpu_ms\": %.3f}\n",
+	 name, r->n_samples, r->n_failed,
+	 percentile(r, 0.50), percentile(r, 0.90), percentile(r, 0.99),
+	 percentile(r, 1.0), wall_ms, cpu_ms);
+
+  fflush(stdout);
+}
+
+/* -- Setup ---------------------------------------------------------- */
+
+static Bool
+wm_wait_running(Bench *b)
+{
+  double deadline = now_ms() + BENCH_TIMEOUT;
+
+  while (now_ms() < deadline)
+    {
+      Atom           type;
+      int            format;
+      unsigned long  n = 0, extra;
+      unsigned char *data = NULL;
+
+      if (XGetWindowProperty(b->dpy, b->root,
+			     b->atoms[ATOM_NET_SUPPORTING_WM_CHECK],
+			     0, 1, False, XA_WINDOW, &type, &format,
+			     &n, &extra, &data) == Success && data)
+	{
+	  XFree(data);
+	  if (n) return True;
+	}
+
+      usleep(50000);
+    }
+
+  return False;
+}
+
+static pid_t
+wm_spawn(char **argv)
+{
+  pid_t pid = fork();
+
+  switch (pid)
+    {
+    case 0:
+      execvp(argv[0], argv);
+      fprintf(stderr, "matchbox-bench: failed to exec %s\n", argv[0]);
+      _exit(1);
+    case -1:
+      fprintf(stderr, "matchbox-bench: fork failed\n");
+      exit(1);
+    }
+
+  return pid;
+}
+
+static void
+usage(char *progname)
+{
+   printf("Usage: %s [options...] [-- wm-command [wm-args...]]\n", progname);
+   printf("Options:\n");
+   printf("  -display <display>       X display to use\n");
+   printf("  -n <iterations>          samples per scenario ( default 50 )\n");
+   printf("  -pid <pid>               already running wm, for cpu time\n");
+   printf("  -themes <name> <name>    themes to switch between\n");
+   printf("  -h  this help\n\n");
+   printf("Results are printed one JSON object per scenario.\n");
+   exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct {
+    char  *name;
+    void (*func)(Bench *b, Window app, BenchResult *r);
+  } scenarios[] = {
+    { "fence",        scenario_fence },
+    { "map_storm",    scenario_map_storm },
+    { "title_churn",  scenario_title_churn },
+    { "dialog",       scenario_dialog },
+    { "damage_flood", scenario_damage_flood },
+    { "panel_resize", scenario_panel_resize },
+    { "theme_switch", scenario_theme_switch },
+    { NULL, NULL }
+  };
+
+  char   *display_name = getenv("DISPLAY");
+  char  **wm_argv = NULL;
+  Bench   bench;
+  Window  app;
+  int     i;
+
+  memset(&bench, 0, sizeof(bench));
+  bench.iterations = 50;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp(argv[i], "--"))
+	{
+	  if (argv[i+1]) wm_argv = &argv[i+1];
+	  break;
+	}
+      else if (!strcmp(argv[i], "-display") && argv[i+1])
+	display_name = argv[++i];
+      else if (!strcmp(argv[i], "-n") && argv[i+1])
+	bench.iterations = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-pid") && argv[i+1])
+	bench.wm_pid = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-themes") && argv[i+1] && argv[i+2])
+	{
+	  bench.themes[0] = argv[++i];
+	  bench.themes[1] = argv[++i];
+	}
+      else usage(argv[0]);
+    }
+
+  if (bench.iterations <= 0) usage(argv[0]);
+
+  if ((bench.dpy = XOpenDisplay(display_name)) == NULL)
+    {
+      fprintf(stderr, "matchbox-bench: cant connect to display: %s\n",
+	      display_name ? display_name : "(null)");
+      exit(1);
+    }
+
+  bench.screen = DefaultScreen(bench.dpy);
+  bench.root   = RootWindow(bench.dpy, bench.screen);
+
+  XInternAtoms(bench.dpy, atom_names, N_ATOMS, False, bench.atoms);
+
+  if (wm_argv)
+    {
+      if (display_name) setenv("DISPLAY", display_name, 1);
+      bench.wm_pid = wm_spawn(wm_argv);
+    }
+
+  if (!wm_wait_running(&bench))
+    {
+      fprintf(stderr, "matchbox-bench: no window manager came up\n");
+      if (wm_argv) kill(bench.wm_pid, SIGTERM);
+      exit(1);
+    }
+
+  app = window_new(&bench, "bench app", -1, None);
+
+  if (!window_map_and_wait(&bench, app))
+    {
+      fprintf(stderr, "matchbox-bench: app window never mapped\n");
+      if (wm_argv) kill(bench.wm_pid, SIGTERM);
+      exit(1);
+    }
+
+  settle(&bench);
+
+  for (i = 0; scenarios[i].name != NULL; i++)
+    {
+      BenchResult result;
+      double      cpu_start, wall_start, cpu_end;
+
+      memset(&result, 0, sizeof(result));
+      result.samples = malloc(sizeof(double) * bench.iterations);
+
+      cpu_start  = wm_cpu_ms(&bench);
+      wall_start = now_ms();
+
+      scenarios[i].func(&bench, app, &result);
+
+      cpu_end = wm_cpu_ms(&bench);
+
+      if (result.n_samples || result.n_failed)
+	report(scenarios[i].name, &result, now_ms() - wall_start,
+	       (cpu_start >= 0 && cpu_end >= 0) ? cpu_end - cpu_start : -1);
+
+      free(result.samples);
+
+      settle(&bench);
+    }
+
+  XDestroyWindow(bench.dpy, app);
+  XSync(bench.dpy, False);
+
+  if (wm_argv)
+    {
+      kill(bench.wm_pid, SIGTERM);
+      waitpid(bench.wm_pid, NULL, 0);
+    }
+
+  XCloseDisplay(bench.dpy);
+
+  return 0;
+}
@@ -37,6 +37,9 @@
 #define MB_CMD_MISC          7
 #define MB_CMD_COMPOSITE     8
 #define MB_CMB_KEYS_RELOAD   9
+#define MB_CMD_TRACE_DUMP    10
+#define MB_CMD_STATS         11
+#define MB_CMD_RESTART       12
 
 #define MB_CMD_PANEL_TOGGLE_VISIBILITY 1
 #define MB_CMD_PANEL_SIZE              2
@@ -174,6 +177,50 @@ mbcommand(int cmd_id, char *data) {
 
 }
 
+/* Ask the wm to write out its stats and print them once they land */
+static void
+print_stats(void)
+{
+   Window         root = DefaultRootWindow(dpy);
+   Atom           stats_prop, realType;
+   XEvent         ev;
+   Bool           have_stats = False;
+   unsigned long  n, extra;
+   int            format, i;
+   char          *value = NULL;
+
+   stats_prop = XInternAtom(dpy, "_MB_STATS", False);
+
+   XSelectInput(dpy, root, PropertyChangeMask);
+
+   mbcommand(MB_CMD_STATS, NULL);
+   XFlush(dpy);
+
+   for (i = 0; i < 200 && !have_stats; i++) /* ~2 seconds */
+     {
+       while (XCheckTypedWindowEvent(dpy, root, PropertyNotify, &ev))
+	 if (ev.xproperty.atom == stats_prop)
+	   have_stats = True;
+
+       if (!have_stats) 
+	 usleep(10000);
+     }
+
+   if (!have_stats)
+     {
+       fprintf(stderr, "matchbox-remote: no stats from window manager\n");
+       exit(1);
+     }
+
+   if (XGetWindowProperty(dpy, root, stats_prop, 0L, 65536L, False,
+			  XA_STRING, &realType, &format, &n, &extra, 
+			  (unsigned char **) &value) == Success && value)
+     {
+       fputs(value, stdout);
+       XFree(value);
+     }
+}
+
 void
 send_input_manager_request(int show)
 {
@@ -217,6 +264,9 @@ usage(char *progname)
    printf("  -input-toggle [1|0]      Toggle Input method ( requires input-manager )\n");
    printf("  -composite-toggle        Toggle Compositing Engine ( if enabled )\n");
    printf("  -keys-reload             Reload key shortcut config ( if enabled )\n");
+   printf("  -trace-dump              Dump matchbox trace ring ( path in _MB_TRACE_FILE )\n");
+   printf("  -stats                   Print matchbox runtime statistics\n");
+   printf("  -restart                 Restart matchbox, keeping its windows as they are\n");
 
 
    /*
@@ -247,14 +297,30 @@ int main(int argc, char* argv[])
 	switch (arg[1]) 
 	{
 	case 't' :
+	  if (!strcmp(arg+1, "trace-dump"))
+	    {
+	      mbcommand(MB_CMD_TRACE_DUMP, NULL);
+	      break;
+	    }
 	  if (argv[i+1] != NULL)
 	    mbcommand(MB_CMD_SET_THEME, argv[i+1]);
 	  i++;
 	  break;
 	case 'r' :
+	  if (!strcmp(arg+1, "restart"))
+	    {
+	      mbcommand(MB_CMD_RESTART, NULL);
+	      break;
+	    }
 	  getRootProperty("_MB_THEME", False);
 	  i++;
 	  break;
+	case 's':
+	  if (!strcmp(arg+1, "stats"))
+	    print_stats();
+	  else
+	    usage(argv[0]);
+	  break;
 	case 'e':
 	  mbcommand(MB_CMD_EXIT, NULL);
 	  break;
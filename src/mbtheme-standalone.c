@@ -66,6 +66,7 @@ font_load (Wm                   *w,
 	   return True; 
 	 }
 #else
+       STATS_ROUND_TRIP();
        if ((*font = XLoadQueryFont(w->dpy, token)) != NULL)
 	 { 
 	   if (orig) free(orig);  
@@ -498,6 +499,7 @@ theme_frame_paint( MBTheme *theme,
   Wm    *w = theme->wm;
   int    decor_idx = 0;
   Pixmap pxm_backing  = None; 
+  MBTraceTime   trace_start = trace_now();
 
   pxm_backing = XCreatePixmap(theme->wm->dpy, theme->wm->root, dw, dh, 
 			      DefaultDepth(theme->wm->dpy, theme->wm->screen));
@@ -617,10 +619,15 @@ theme_frame_paint( MBTheme *theme,
   XSetWindowBackgroundPixmap(w->dpy, c->frames_decor[decor_idx], 
 			     pxm_backing);
   XClearWindow(w->dpy, c->frames_decor[decor_idx]);
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
 
   XFreePixmap(w->dpy, pxm_backing);
 
+  w->stats.paints++;
+  stats_hist_add(w->stats.paint_hist,
+		 trace_record("theme_frame_paint", trace_start, frame_ref));
+
   return True;
 }
 
@@ -744,6 +751,7 @@ theme_frame_menu_paint(MBTheme* theme, Client *c)
    XSetWindowBackgroundPixmap(w->dpy, c->frame, drw.pxm);
 
    XClearWindow(w->dpy, c->frame);
+   STATS_ROUND_TRIP();
    XSync(w->dpy, False);
 
    XFreePixmap(w->dpy, drw.pxm);
@@ -831,6 +839,7 @@ mbtheme_new(Wm *w)
       fprintf(stderr, "matchbox: failed to parse color %s\n", THEME_FG_COLOR);
       exit(1);
     } else {
+      STATS_ROUND_TRIP();
       XAllocColor(w->dpy, DefaultColormap(w->dpy, w->screen), &t->col_fg);
     }
 
@@ -841,6 +850,7 @@ mbtheme_new(Wm *w)
 	      THEME_FG_HIGHLIGHT_COLOR);
       exit(1);
     } else {
+      STATS_ROUND_TRIP();
       XAllocColor(w->dpy, DefaultColormap(w->dpy, w->screen), 
 		  &t->col_fg_highlight);
     }
@@ -852,6 +862,7 @@ mbtheme_new(Wm *w)
 	      THEME_FG_LOWLIGHT_COLOR);
       exit(1);
     } else {
+      STATS_ROUND_TRIP();
       XAllocColor(w->dpy, DefaultColormap(w->dpy, w->screen), 
 		  &t->col_fg_lowlight);
     }
@@ -863,6 +874,7 @@ mbtheme_new(Wm *w)
 	      THEME_TEXT_COLOR);
       exit(1);
     } else {
+      STATS_ROUND_TRIP();
       XAllocColor(w->dpy, DefaultColormap(w->dpy, w->screen), &t->col_text);
     }
 
@@ -944,13 +956,14 @@ mbtheme_has_titlebar_panel(MBTheme *theme)
 
 Bool
 mbtheme_get_titlebar_panel_rect(MBTheme    *theme, 
+				int         output,
 				XRectangle *rect,
 				Client     *ignore_client)
 {
   if (!theme->wm->have_toolbar_panel) return False;
 
-  rect->x      = theme->wm->toolbar_panel_x;
-  rect->y      = theme->wm->toolbar_panel_y;
+  rect->x      = theme->wm->outputs[output].x + theme->wm->toolbar_panel_x;
+  rect->y      = theme->wm->outputs[output].y + theme->wm->toolbar_panel_y;
   rect->width  = theme->wm->toolbar_panel_w;
   rect->height = theme->wm->toolbar_panel_h;
 
@@ -246,6 +246,7 @@ theme_frame_button_get_x_pos (MBTheme       *theme,
 
 Bool
 mbtheme_get_titlebar_panel_rect(MBTheme    *theme, 
+				int         output,
 				XRectangle *rect,
 				Client     *ignore_client);
 
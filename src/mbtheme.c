@@ -24,6 +24,17 @@
 #include <X11/Xcursor/Xcursor.h>
 #endif
 
+#define DO_TIMINGS 0 		/* enable this for theme lookup timings */
+
+#if DO_TIMINGS
+#include <sys/time.h>
+#include <time.h>
+#endif
+
+#ifndef MAXPATHLEN
+#define MAXPATHLEN 256
+#endif
+
 #define GET_INT_ATTR(n,k,v) \
     { if (get_attr((n), (k))) (v) = atoi(get_attr((n), (k))); else (v) = 0; }
 
@@ -107,6 +118,10 @@ static int param_get( MBThemeFrame *frame, MBThemeParam *p, int max );
 static void show_parse_error(Wm *w, XMLNode *node, 
 			     char *theme_file, int err_num);
 
+#ifdef USE_THEME_THREAD
+static Bool mbtheme_loader_start(Wm *w, char *theme_name);
+#endif
+
 
 /* ---------------------------------------------------- Painting Code -- */
 
@@ -142,6 +157,7 @@ void theme_frame_icon_paint(MBTheme *t, Client *c,
 	  Window       win_foo;
 	  int          foo;
 	  unsigned int icon_w, icon_h, ufoo;
+	  STATS_ROUND_TRIP();
 	  XGetGeometry(t->wm->dpy, c->icon, &win_foo, &foo, &foo, 
 		       &icon_w, &icon_h, &ufoo, &ufoo);
 	  img = mb_pixbuf_img_new_from_drawable(t->wm->pb, 
@@ -184,7 +200,7 @@ theme_frame_button_paint(MBTheme *theme,
   MBList       *theme_button_list  = NULL;      /* Theme button defs   */
   int           button_x, button_y, button_w, button_h;
 
-  frame = (MBThemeFrame *)list_find_by_id(theme->frames, frame_type);
+  frame = mbtheme_frame(theme, frame_type);
 
   dbg("%s called\n", __func__);
 
@@ -376,7 +392,7 @@ theme_frame_wants_shaped_window( MBTheme *theme, int frame_type)
 {
   MBThemeFrame *frame = NULL;
 
-  if ((frame = (MBThemeFrame *)list_find_by_id(theme->frames, frame_type)) == NULL)
+  if ((frame = mbtheme_frame(theme, frame_type)) == NULL)
     return False;
 
   return frame->wants_shape;
@@ -385,8 +401,7 @@ theme_frame_wants_shaped_window( MBTheme *theme, int frame_type)
 Bool
 theme_has_message_decor( MBTheme *theme )
 {
-  MBThemeFrame *frame = (MBThemeFrame *)list_find_by_id(theme->frames, 
-							FRAME_MSG);
+  MBThemeFrame *frame = mbtheme_frame(theme, FRAME_MSG);
   if (frame == NULL) 
     return False;
   else
@@ -396,8 +411,7 @@ theme_has_message_decor( MBTheme *theme )
 Bool
 theme_has_borders_only_decor( MBTheme *theme )
 {
-  MBThemeFrame *frame = (MBThemeFrame *)list_find_by_id(theme->frames, 
-							FRAME_DIALOG_NT_NORTH);
+  MBThemeFrame *frame = mbtheme_frame(theme, FRAME_DIALOG_NT_NORTH);
   if (frame == NULL) 
     return False;
   else
@@ -588,12 +602,12 @@ _theme_paint_core( MBTheme       *theme,
     }
 }
 
-Bool
-theme_frame_paint( MBTheme *theme, 
-		   Client  *c, 
-		   int      frame_type, 
-		   int      dw, 
-		   int      dh )
+static Bool
+_theme_frame_paint( MBTheme *theme, 
+		    Client  *c, 
+		    int      frame_type, 
+		    int      dw, 
+		    int      dh )
 {
   Wm *w = c->wm;
 
@@ -610,7 +624,7 @@ theme_frame_paint( MBTheme *theme,
   if (dw == 0 || dh == 0)
     return False;
 
-  frame = (MBThemeFrame *)list_find_by_id(theme->frames, frame_type);
+  frame = mbtheme_frame(theme, frame_type);
 
   if (frame == NULL) return False;
 
@@ -656,13 +670,22 @@ theme_frame_paint( MBTheme *theme,
       || frame_type == FRAME_MAIN_EAST
       || frame_type == FRAME_MAIN_WEST)
     {
+      /* Sizes change on rotation, only what still fits is kept */
+      if (theme->app_win_pxm_cache[decor_idx] != None
+	  && (theme->app_win_pxm_cache_w[decor_idx] != dw
+	      || theme->app_win_pxm_cache_h[decor_idx] != dh))
+	theme_pixmap_cache_clear(theme, decor_idx);
+
       if (theme->app_win_pxm_cache[decor_idx] != None)
 	{
 	  dbg("%s() getting pixmap frame from cache\n", __func__);
 
+	  w->stats.theme_cache_hits++;
+
 	  XSetWindowBackgroundPixmap(w->dpy, c->frames_decor[decor_idx], 
 				     theme->app_win_pxm_cache[decor_idx]);
 	  XClearWindow(w->dpy, c->frames_decor[decor_idx]);
+	  STATS_ROUND_TRIP();
 	  XSync(w->dpy, False);
 	  return True;
 	}
@@ -672,15 +695,25 @@ theme_frame_paint( MBTheme *theme,
 
    /* Cacheing */
 
-  if (frame_type == FRAME_MAIN && theme->img_caches[frame_type] != NULL)
+  if (frame_type == FRAME_MAIN && theme->img_caches[frame_type] != NULL
+      && theme->img_caches[frame_type]->width  == dw
+      && theme->img_caches[frame_type]->height == dh)
     {
       /* We only reuse app titlebar images. 
        */
       img = theme->img_caches[frame_type];
       have_img_cached = True;
+      w->stats.theme_cache_hits++;
     }
   else
     {
+      /* Only app frames are cached, see above */
+      if (frame_type == FRAME_MAIN 
+	  || frame_type == FRAME_MAIN_SOUTH 
+	  || frame_type == FRAME_MAIN_EAST
+	  || frame_type == FRAME_MAIN_WEST)
+	w->stats.theme_cache_misses++;
+
       /* Other window decors are just kept around whilst the client exists 
        * so things like buttons can composite onto them.  
       */
@@ -698,7 +731,7 @@ theme_frame_paint( MBTheme *theme,
       img = theme->img_caches[frame_type];
     }
 
-  layer_label = (MBThemeLayer*)list_find_by_id(frame->layers, LAYER_LABEL);
+  layer_label = mbtheme_frame_layer(frame, LAYER_LABEL);
 
   /* Figure out text alignment + positioning */
 
@@ -737,8 +770,7 @@ theme_frame_paint( MBTheme *theme,
   
   /* Icons - are a pain as we cant cache them */
   
-  if ((layer_icon = (MBThemeLayer*)list_find_by_id(frame->layers, 
-						   LAYER_ICON)) != NULL)
+  if ((layer_icon = mbtheme_frame_layer(frame, LAYER_ICON)) != NULL)
     {
       MBPixbufImage *img_tmp = NULL;
       dbg("%s() painting icon\n", __func__);
@@ -854,6 +886,7 @@ theme_frame_paint( MBTheme *theme,
   XSetWindowBackgroundPixmap(w->dpy, c->frames_decor[decor_idx], 
 			     mb_drawable_pixmap(drawable));
   XClearWindow(w->dpy, c->frames_decor[decor_idx]);
+  STATS_ROUND_TRIP();
   XSync(c->wm->dpy, False);
 
   /* Cache the pixmaps of these frame types.  
@@ -868,6 +901,10 @@ theme_frame_paint( MBTheme *theme,
       theme->app_win_pxm_cache[decor_idx] 
 	= XCreatePixmap(w->dpy, mb_drawable_pixmap(drawable), 
 			dw, dh, DefaultDepth(w->dpy, w->screen));
+      theme->app_win_pxm_cache_w[decor_idx] = dw;
+      theme->app_win_pxm_cache_h[decor_idx] = dh;
+      theme->app_win_pxm_cache_bytes 
+	+= dw * dh * ((DefaultDepth(w->dpy, w->screen) > 16) ? 4 : 2);
       XCopyArea(w->dpy, mb_drawable_pixmap(drawable), 
 		theme->app_win_pxm_cache[decor_idx], theme->gc, 
 		0, 0, dw, dh, 0, 0);
@@ -878,6 +915,25 @@ theme_frame_paint( MBTheme *theme,
   return True;
 }
 
+Bool
+theme_frame_paint( MBTheme *theme, 
+		   Client  *c, 
+		   int      frame_type, 
+		   int      dw, 
+		   int      dh )
+{
+  MBTraceTime   trace_start = trace_now();
+  Bool          result;
+
+  result = _theme_frame_paint(theme, c, frame_type, dw, dh);
+
+  theme->wm->stats.paints++;
+  stats_hist_add(theme->wm->stats.paint_hist,
+		 trace_record("theme_frame_paint", trace_start, frame_type));
+
+  return result;
+}
+
 /**** Task list painting *******/
 
 Bool
@@ -889,7 +945,7 @@ theme_frame_menu_get_dimentions(MBTheme* theme, int *w, int *h)
 
   space_avail = theme->wm->dpy_width - theme->wm->config->use_icons - 16;
 
-  frame =  (MBThemeFrame*)list_find_by_id(theme->frames, FRAME_MENU );
+  frame =  mbtheme_frame(theme, FRAME_MENU);
 
   if (frame == NULL)       return False; 
   if (frame->font == NULL) return False;
@@ -981,7 +1037,7 @@ theme_frame_menu_highlight_entry(Client         *c,
   Client        *entry = (Client *)button->data;
   int            offset, item_h;
 
-  frame = (MBThemeFrame *)list_find_by_id(theme->frames, FRAME_MENU);
+  frame = mbtheme_frame(theme, FRAME_MENU);
 
   if (frame == NULL) 
     return;
@@ -1063,6 +1119,7 @@ theme_frame_menu_highlight_entry(Client         *c,
 
     }
 
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
 
   /* XXX
@@ -1096,7 +1153,7 @@ theme_frame_menu_paint(MBTheme* theme, Client *c)
   int             item_h, item_x, item_current_y, item_text_w, icon_offset = 0;
 
 
-  frame = (MBThemeFrame *)list_find_by_id(theme->frames, FRAME_MENU);
+  frame = mbtheme_frame(theme, FRAME_MENU);
 
   if (frame == NULL) return;
 
@@ -1253,6 +1310,7 @@ theme_frame_menu_paint(MBTheme* theme, Client *c)
 
   XSetWindowBackgroundPixmap(w->dpy, c->frame, mb_drawable_pixmap(drawable));
   XClearWindow(w->dpy, c->frame);
+  STATS_ROUND_TRIP();
   XSync(c->wm->dpy, False);
 
   mb_drawable_unref(drawable);
@@ -1267,11 +1325,10 @@ theme_frame_supports_button_type(MBTheme *theme,
 				 int frame_type, 
 				 int button_type)
 {
-  MBThemeFrame* frame = (MBThemeFrame*)list_find_by_id(theme->frames, 
-						       frame_type );
+  MBThemeFrame* frame = mbtheme_frame(theme, frame_type);
   if (frame == NULL) return False;
 
-  if (list_find_by_id(frame->buttons, button_type))
+  if (mbtheme_frame_button(frame, button_type))
     return True;
   else
     return False;
@@ -1280,7 +1337,7 @@ theme_frame_supports_button_type(MBTheme *theme,
 Bool
 theme_has_frame_type_defined(MBTheme *theme, int frame_type)
 {
-  if (list_find_by_id (theme->frames, frame_type))
+  if (mbtheme_frame(theme, frame_type))
     return True;
   else
     return False;
@@ -1295,12 +1352,11 @@ theme_frame_button_get_x_pos(MBTheme *theme,
   MBThemeFrame *frame;
   MBThemeButton *button;
 
-  frame = (MBThemeFrame*)list_find_by_id(theme->frames, frame_type );
+  frame = mbtheme_frame(theme, frame_type);
 
   if (frame)
     {
-      button = (MBThemeButton *)list_find_by_id(frame->buttons, 
-						button_type );
+      button = mbtheme_frame_button(frame, button_type);
       return param_get( frame, button->x, width);
     }
 
@@ -1316,7 +1372,7 @@ theme_frame_defined_width_get( MBTheme *theme, int frame_type )
       && ( frame_type == FRAME_MAIN_EAST || frame_type == FRAME_MAIN_WEST))
     return 0;
 
-  frame = (MBThemeFrame *)list_find_by_id(theme->frames, frame_type);
+  frame = mbtheme_frame(theme, frame_type);
   if (frame) 
     {
       return frame->set_width;
@@ -1334,7 +1390,7 @@ theme_frame_defined_height_get( MBTheme *theme, int frame_type )
     return 0;
 
 
-  frame = (MBThemeFrame *)list_find_by_id(theme->frames, frame_type);
+  frame = mbtheme_frame(theme, frame_type);
   if (frame) 
     {
       return frame->set_height;
@@ -1351,18 +1407,33 @@ theme_img_cache_clear( MBTheme *theme,  int frame_ref )
   theme->img_caches[frame_ref] = NULL;
 } 
 
+void
+theme_pixmap_cache_clear( MBTheme *theme, int decor_idx )
+{
+  int bytes = (DefaultDepth(theme->wm->dpy, theme->wm->screen) > 16) ? 4 : 2;
+
+  if (theme->app_win_pxm_cache[decor_idx] == None)
+    return;
+
+  dbg("%s() clearing pixmap cache %i\n", __func__, decor_idx);
+
+  XFreePixmap(theme->wm->dpy, theme->app_win_pxm_cache[decor_idx]);
+  theme->app_win_pxm_cache[decor_idx] = None;
+
+  theme->app_win_pxm_cache_bytes 
+    -= theme->app_win_pxm_cache_w[decor_idx] 
+       * theme->app_win_pxm_cache_h[decor_idx] * bytes;
+}
+
 void
 theme_pixmap_cache_clear_all( MBTheme *theme )
 {
   int i;
 
   for (i=0; i < 3; i++)
-    if (theme->app_win_pxm_cache[i] != None)
-      {
-	dbg("%s() clearing pixmap cache\n", __func__);
-	XFreePixmap(theme->wm->dpy, theme->app_win_pxm_cache[i]);
-	theme->app_win_pxm_cache[i] = None;
-      }
+    theme_pixmap_cache_clear(theme, i);
+
+  theme->app_win_pxm_cache_bytes = 0;
 }
 
 void
@@ -1373,9 +1444,164 @@ theme_img_cache_clear_all( MBTheme *theme )
     theme_img_cache_clear( theme, i );
 }
 
+void
+mbtheme_memory_usage(MBTheme       *theme, 
+		     unsigned long *arena, 
+		     unsigned long *images, 
+		     unsigned long *pixmaps)
+{
+  int i;
+
+  *arena   = theme->arena_bytes_reserved;
+  *images  = 0;
+  *pixmaps = theme->app_win_pxm_cache_bytes;
+
+  for (i=0; i < N_FRAME_TYPES; i++)
+    if (theme->img_caches[i] != NULL)
+      *images += theme->img_caches[i]->width * theme->img_caches[i]->height
+	         * (theme->img_caches[i]->has_alpha ? 4 : 3);
+}
+
 
 /* ------------------------------------------ Creation / Parsing Code -- */
 
+/* Theme arena. Blocks are never shrunk or individually freed, everything 
+ * goes in mbtheme_arena_free() when the theme does. 
+ */
+
+#define THEME_ARENA_BLOCK_SIZE 4096
+#define THEME_ARENA_ALIGN(n) (((n) + (2*sizeof(void*)) - 1) \
+			      & ~((2*sizeof(void*)) - 1))
+
+static void *
+mbtheme_arena_alloc(MBTheme *theme, size_t size)
+{
+  MBThemeArenaBlock *block = theme->arena;
+  size_t             hdr   = THEME_ARENA_ALIGN(sizeof(MBThemeArenaBlock));
+  void              *ptr;
+
+  size = THEME_ARENA_ALIGN(size);
+
+  if (block == NULL || block->used + size > block->size)
+    {
+      size_t block_size = THEME_ARENA_BLOCK_SIZE;
+
+      if (size > block_size - hdr)
+	block_size = hdr + size; 	/* oversized, give it its own block */
+
+      if ((block = malloc(block_size)) == NULL)
+	return NULL;
+
+      block->size = block_size;
+      block->used = hdr;
+
+      /* Keep the block with most room at the head, oversized ones 
+       * are full anyway so go behind it. 
+       */
+      if (theme->arena && block->size - hdr == size)
+	{
+	  block->next = theme->arena->next;
+	  theme->arena->next = block;
+	}
+      else
+	{
+	  block->next = theme->arena;
+	  theme->arena = block;
+	}
+
+      theme->arena_bytes_reserved += block_size;
+    }
+
+  ptr = (char *)block + block->used;
+  block->used += size;
+  theme->arena_bytes_used += size;
+
+  memset(ptr, 0, size);
+
+  return ptr;
+}
+
+static char *
+mbtheme_arena_strdup(MBTheme *theme, const char *str)
+{
+  char *dup;
+
+  if (str == NULL) return NULL;
+
+  if ((dup = mbtheme_arena_alloc(theme, strlen(str) + 1)) != NULL)
+    strcpy(dup, str);
+
+  return dup;
+}
+
+/* Like list_add(), but the node and its name live in the theme arena.
+ * Lists built with this must never be passed to list_remove() or 
+ * list_destroy(). Returns False if out of memory.
+ */
+static Bool
+mbtheme_arena_list_add(MBTheme           *theme,
+		       struct list_item **head, 
+		       char              *name, 
+		       int                id, 
+		       void              *data)
+{
+  struct list_item *item, *tmp = *head;
+
+  if ((item = mbtheme_arena_alloc(theme, sizeof(struct list_item))) == NULL)
+    return False;
+
+  item->name = mbtheme_arena_strdup(theme, name);
+  item->id   = id;
+  item->data = data;
+
+  if (name && item->name == NULL)
+    return False;		/* left unlinked, freed with the arena */
+
+  if (tmp == NULL)
+    {
+      *head = item;
+      return True;
+    }
+
+  while (tmp->next != NULL) tmp = tmp->next;
+  tmp->next = item;
+
+  return True;
+}
+
+static void
+mbtheme_arena_free(MBTheme *theme)
+{
+  MBThemeArenaBlock *block = theme->arena, *next;
+
+  dbg("%s() releasing %li bytes ( %li reserved )\n", __func__, 
+      (long)theme->arena_bytes_used, (long)theme->arena_bytes_reserved);
+
+  while (block != NULL)
+    {
+      next = block->next;
+      free(block);
+      block = next;
+    }
+
+  theme->arena                = NULL;
+  theme->arena_bytes_used     = 0;
+  theme->arena_bytes_reserved = 0;
+}
+
+/* Debug aid, lets xprop show how much a theme costs us */
+static void
+mbtheme_publish_footprint(Wm *w, MBTheme *theme)
+{
+  unsigned long val[2];
+
+  val[0] = theme->arena_bytes_used;
+  val[1] = theme->arena_bytes_reserved;
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_DEBUG_THEME_FOOTPRINT], 
+		  XA_CARDINAL, 32, PropModeReplace, (unsigned char *)val, 2);
+}
+
 static char *
 get_attr(XMLNode *node, char *key)
 {
@@ -1392,14 +1618,17 @@ get_attr(XMLNode *node, char *key)
 /* Parsing calls */
 
 static MBThemeParam *
-param_parse(char *def_str)
+param_parse(MBTheme *theme, char *def_str)
 {
    MBThemeParam *g;
    char *p = def_str;
    
    if (def_str == NULL) return NULL;
 
-   g = (MBThemeParam *)malloc(sizeof(MBThemeParam));
+   g = (MBThemeParam *)mbtheme_arena_alloc(theme, sizeof(MBThemeParam));
+
+   if (g == NULL) return NULL;
+
    g->offset = 0;
    
    if (!strncmp(def_str,"object",5))
@@ -1517,13 +1746,14 @@ mbtheme_button_new (MBTheme *theme,
 		    int  inactive_blend,
 		    char *options)
 {
-  MBThemeButton *button = malloc(sizeof(MBThemeButton));
-  memset(button, 0, sizeof(MBThemeButton));
+  MBThemeButton *button = mbtheme_arena_alloc(theme, sizeof(MBThemeButton));
+
+  if (button == NULL) return NULL;
 
-  if ( (button->x = param_parse(x)) == NULL) return NULL;
-  if ( (button->y = param_parse(y)) == NULL) return NULL;
-  if ( (button->w = param_parse(w)) == NULL) return NULL;
-  if ( (button->h = param_parse(h)) == NULL) return NULL;
+  if ( (button->x = param_parse(theme, x)) == NULL) return NULL;
+  if ( (button->y = param_parse(theme, y)) == NULL) return NULL;
+  if ( (button->w = param_parse(theme, w)) == NULL) return NULL;
+  if ( (button->h = param_parse(theme, h)) == NULL) return NULL;
 
   dbg("%s() params parsed ok\n", __func__);
 
@@ -1626,7 +1856,13 @@ parse_frame_button_tag(MBTheme *theme, MBThemeFrame *frame, XMLNode *inode)
 
   dbg("%s() adding new button with action : %i\n", __func__, action_id);
 
-  list_add(&frame->buttons, NULL, action_id, (void *)button_new);
+  if (!mbtheme_arena_list_add(theme, &frame->buttons, NULL, action_id, 
+			      (void *)button_new))
+    return ERROR_LOADING_RESOURCE;
+
+  if (mbtheme_frame_button(frame, action_id) == NULL
+      && action_id > 0 && action_id < N_BUTTON_ACTIONS)
+    frame->button_index[action_id] = button_new;
 
   return 1;
 
@@ -1638,8 +1874,7 @@ mbtheme_label_new(MBTheme* theme,
 		  char*    col_id, 
 		  char*    justify)
 {
-   MBThemeLabel *label = malloc(sizeof(MBThemeLabel));
-   memset(label, 0, sizeof(MBThemeLabel));
+   MBThemeLabel *label = mbtheme_arena_alloc(theme, sizeof(MBThemeLabel));
 
    if      (!strcmp(justify, "left"))   { label->justify = ALIGN_LEFT;   }
    else if (!strcmp(justify, "center")) { label->justify = ALIGN_CENTER; }
@@ -1658,10 +1893,9 @@ mbtheme_label_new(MBTheme* theme,
 MBThemeLabel *
 mbtheme_sublabel_new(MBTheme* theme, char* sublabel_label_clip_w)
 {
-   MBThemeLabel *label = malloc(sizeof(MBThemeLabel));
-   memset(label, 0, sizeof(MBThemeLabel));
+   MBThemeLabel *label = mbtheme_arena_alloc(theme, sizeof(MBThemeLabel));
 
-   label->sublabel_label_clip_w = param_parse(sublabel_label_clip_w);
+   label->sublabel_label_clip_w = param_parse(theme, sublabel_label_clip_w);
 
    return label;
 }
@@ -1684,13 +1918,14 @@ mbtheme_layer_new (MBTheme *theme,
 		   char    *w, 
 		   char    *h )
 {
-  MBThemeLayer *layer = malloc(sizeof(MBThemeLayer));
-  memset(layer, 0, sizeof(MBThemeLayer));
+  MBThemeLayer *layer = mbtheme_arena_alloc(theme, sizeof(MBThemeLayer));
 
-  if ( (layer->x = param_parse(x)) == NULL) return NULL;
-  if ( (layer->y = param_parse(y)) == NULL) return NULL;
-  if ( (layer->w = param_parse(w)) == NULL) return NULL;
-  if ( (layer->h = param_parse(h)) == NULL) return NULL;
+  if (layer == NULL) return NULL;
+
+  if ( (layer->x = param_parse(theme, x)) == NULL) return NULL;
+  if ( (layer->y = param_parse(theme, y)) == NULL) return NULL;
+  if ( (layer->w = param_parse(theme, w)) == NULL) return NULL;
+  if ( (layer->h = param_parse(theme, h)) == NULL) return NULL;
 
   return layer;
 }
@@ -1718,7 +1953,13 @@ parse_frame_layer_tag (MBTheme      *theme,
 
   if (layer_new == NULL || type_id == 0) return ERROR_INCORRECT_PARAMS;
   
-  list_add(&frame->layers, NULL, type_id, (void *)layer_new);
+  if (!mbtheme_arena_list_add(theme, &frame->layers, NULL, type_id, 
+			      (void *)layer_new))
+    return ERROR_LOADING_RESOURCE;
+
+  if (mbtheme_frame_layer(frame, type_id) == NULL
+      && type_id > 0 && type_id < N_LAYER_TYPES)
+    frame->layer_index[type_id] = layer_new;
 
   switch (type_id)
     {
@@ -1781,8 +2022,8 @@ mbtheme_frame_new (MBTheme *theme,
 {
   MBThemeFrame *frame = NULL;
 
-  frame = malloc(sizeof(MBThemeFrame));
-  memset(frame, 0, sizeof(MBThemeFrame));
+  if ((frame = mbtheme_arena_alloc(theme, sizeof(MBThemeFrame))) == NULL)
+    return NULL;
 
   frame->type = lookup_frame_type(name);
 
@@ -1792,63 +2033,13 @@ mbtheme_frame_new (MBTheme *theme,
 
   if (options) 
     {
-      frame->options = strdup(options);
+      frame->options = mbtheme_arena_strdup(theme, options);
       if (strstr(options, "shaped")) frame->wants_shape = True;
     }
 
   return frame;
 }
 
-void
-mbtheme_frame_free (MBTheme      *theme, 
-		    MBThemeFrame *frame)
-{
-  struct list_item* next = NULL, *cur = NULL;
-
-  cur = frame->layers;
-  while (cur != NULL)
-    {
-      MBThemeLayer *layer;
-      next = cur->next;
-      
-      layer = (MBThemeLayer *)cur->data;
-
-      if (layer->label) free(layer->label);
-      free(layer->x);
-      free(layer->y);
-      free(layer->w);
-      free(layer->h);
-      free(layer);
-      free(cur);
-
-      cur = next;
-    }
-  frame->layers = NULL;
-
-  cur = frame->buttons;
-  while (cur != NULL)
-    {
-      MBThemeButton *button;
-      next = cur->next;
-      
-      button = (MBThemeButton *)cur->data;
-      free(button->x);
-      free(button->y);
-      free(button->w);
-      free(button->h);
-      free(button);
-      free(cur);
-
-      cur = next;
-    }
-
-  frame->buttons = NULL;
-
-  if (frame->options) free(frame->options);
-
-  free(frame);
-}
-
 static int
 parse_frame_tag (MBTheme *theme, 
 		 XMLNode *node, 
@@ -1927,7 +2118,13 @@ parse_frame_tag (MBTheme *theme,
 	 }
      }
 
-   list_add(&theme->frames, NULL, frame_type, (void *)frame_new);
+   if (!mbtheme_arena_list_add(theme, &theme->frames, NULL, frame_type, 
+			       (void *)frame_new))
+     return ERROR_LOADING_RESOURCE;
+
+   if (mbtheme_frame(theme, frame_type) == NULL
+       && frame_type > 0 && frame_type < N_FRAME_TYPES)
+     theme->frame_index[frame_type] = frame_new;
    
    for(n = node->kids; n != NULL; n = n->next)
      {
@@ -1999,7 +2196,8 @@ parse_color_tag (MBTheme *theme,
        mb_col_blue(color),
        mb_col_alpha(color));
 
-   list_add(&theme->colors, id, 0, (void *)color);
+   if (!mbtheme_arena_list_add(theme, &theme->colors, id, 0, (void *)color))
+     return ERROR_LOADING_RESOURCE;
 
    return 1;
 }
@@ -2023,7 +2221,8 @@ parse_font_tag (MBTheme *theme,
   dbg("%s() got font family: %s size: %i\n", 
       __func__, mb_font_get_family(font), mb_font_get_point_size(font));
 
-  list_add(&theme->fonts, id, 0, (void *)font);
+  if (!mbtheme_arena_list_add(theme, &theme->fonts, id, 0, (void *)font))
+    return ERROR_LOADING_RESOURCE;
 
   return 1;
 }
@@ -2038,10 +2237,27 @@ parse_pixmap_tag (MBTheme *theme,
 
   if ( id == NULL || filename == NULL ) return ERROR_MISSING_PARAMS;
 
-  if ((img = mb_pixbuf_img_new_from_file(theme->wm->pb, filename)) == NULL)
+  /* Images decoded ahead of time by the loader thread come in document 
+   * order, so we only ever need to look at the head. 
+   */
+  if (theme->preloaded_images != NULL
+      && theme->preloaded_images->name != NULL
+      && !strcmp(theme->preloaded_images->name, id))
+    {
+      img = (MBPixbufImage *)theme->preloaded_images->data;
+      theme->preloaded_images->data = NULL;
+      theme->preloaded_images = theme->preloaded_images->next;
+    }
+
+  if (img == NULL
+      && (img = mb_pixbuf_img_new_from_file(theme->wm->pb, filename)) == NULL)
     return ERROR_LOADING_RESOURCE;
 
-  list_add(&theme->images, id, 0, (void *)img);  
+  if (!mbtheme_arena_list_add(theme, &theme->images, id, 0, (void *)img))
+    {
+      mb_pixbuf_img_free(theme->wm->pb, img);
+      return ERROR_LOADING_RESOURCE;
+    }
 
   return 1;
 }
@@ -2064,10 +2280,10 @@ parse_panel_tag (MBTheme *theme,
 
   theme->have_toolbar_panel = True;
 
-  theme->toolbar_panel_x = param_parse(x);
-  theme->toolbar_panel_y = param_parse(y);
-  theme->toolbar_panel_w = param_parse(w);
-  theme->toolbar_panel_h = param_parse(h);
+  theme->toolbar_panel_x = param_parse(theme, x);
+  theme->toolbar_panel_y = param_parse(theme, y);
+  theme->toolbar_panel_w = param_parse(theme, w);
+  theme->toolbar_panel_h = param_parse(theme, h);
 
   return 1;
 }
@@ -2237,57 +2453,31 @@ void
 mbtheme_free (Wm      *w, 
 	      MBTheme *theme)
 {
-  struct list_item* next = NULL, *cur = NULL;
+  struct list_item *cur = NULL;
 
-  if (theme->toolbar_panel_x) free(theme->toolbar_panel_x);
-  if (theme->toolbar_panel_y) free(theme->toolbar_panel_y);
-  if (theme->toolbar_panel_w) free(theme->toolbar_panel_w);
-  if (theme->toolbar_panel_h) free(theme->toolbar_panel_h);
-
-  cur = theme->frames;
-  while (cur != NULL)
-    {
-      next = cur->next;
-      if (cur->name) free(cur->name);
-      mbtheme_frame_free (theme, (MBThemeFrame*)cur->data);
-      free(cur);
-      cur = next;
-    }
-  theme->frames = NULL;
+  /* Only the externally allocated resources need releasing one by one,
+   * the list nodes, frames, layers etc all go with the arena.
+   */
 
-  cur = theme->images;
-  while (cur != NULL)
-    {
-      next = cur->next;
-      if (cur->name) free(cur->name);
-      mb_pixbuf_img_free(w->pb, (MBPixbufImage *)cur->data);
-      free(cur);
-      cur = next;
-    }
+  list_enumerate(theme->images, cur)
+    mb_pixbuf_img_free(w->pb, (MBPixbufImage *)cur->data);
   theme->images = NULL;
 
-  cur = theme->colors;
-  while (cur != NULL)
-    {
-      next = cur->next;
-      if (cur->name) free(cur->name);
-      mb_col_unref((MBColor*)cur->data);
-      free(cur);
-      cur = next;
-    }
+  list_enumerate(theme->colors, cur)
+    mb_col_unref((MBColor*)cur->data);
   theme->colors = NULL;
 
-  cur = theme->fonts;
-  while (cur != NULL)
-    {
-      next = cur->next;
-      if (cur->name) free(cur->name);
-      mb_font_unref((MBFont*)cur->data);
-      free(cur);
-      cur = next;
-    }
+  list_enumerate(theme->fonts, cur)
+    mb_font_unref((MBFont*)cur->data);
   theme->fonts = NULL;
 
+  theme->frames = NULL;
+
+  theme->toolbar_panel_x = theme->toolbar_panel_y = NULL;
+  theme->toolbar_panel_w = theme->toolbar_panel_h = NULL;
+
+  mbtheme_arena_free(theme);
+
   if (theme->gc) XFreeGC(w->dpy, theme->gc);
   if (theme->band_gc) XFreeGC(w->dpy, theme->band_gc);
   if (theme->mask_gc) XFreeGC(w->dpy, theme->mask_gc);
@@ -2298,23 +2488,18 @@ mbtheme_free (Wm      *w,
 
   free(theme);
 
-  w->mbtheme = NULL;
+  if (w->mbtheme == theme)
+    w->mbtheme = NULL;
 }
 
-void
-mbtheme_switch (Wm   *w, 
-		char *new_theme_name)
+/* Resize ( due to new frames ) and repaint everything for the freshly 
+ * loaded theme. Expects the server to be grabbed and releases it.
+ */
+static void
+mbtheme_redecorate_all (Wm *w)
 {
   Client *p = NULL;
 
-  XGrabServer(w->dpy);
-
-  /* now the fun part */
-  mbtheme_free(w, w->mbtheme);
-
-  /* load the new theme */
-  mbtheme_init(w, new_theme_name);
-
   theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
 
   /* sort having titlebar panel, no theme defintion */
@@ -2332,8 +2517,6 @@ mbtheme_switch (Wm   *w,
 	}
     }
 
-  /* Now resize ( due to new frames ) + repaint everything */
-
   stack_enumerate(w, p)
     {
       client_buttons_delete_all(p);
@@ -2372,8 +2555,10 @@ mbtheme_switch (Wm   *w,
       p->redraw(p, False);
     }
 
+  wm_offsets_invalidate(w);
   ewmh_update_rects(w); /* theme *could* affect this */
     
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
 
   XUngrabServer(w->dpy);
@@ -2382,6 +2567,26 @@ mbtheme_switch (Wm   *w,
 }
 
 
+void
+mbtheme_switch (Wm   *w, 
+		char *new_theme_name)
+{
+#ifdef USE_THEME_THREAD
+  if (mbtheme_loader_start(w, new_theme_name))
+    return;
+#endif
+
+  XGrabServer(w->dpy);
+
+  /* now the fun part */
+  mbtheme_free(w, w->mbtheme);
+
+  /* load the new theme */
+  mbtheme_init(w, new_theme_name);
+
+  mbtheme_redecorate_all(w);
+}
+
 static void
 show_parse_error (Wm *w,
 		  XMLNode *node, 
@@ -2431,25 +2636,15 @@ file_exists(char *filename)
   return True;
 }
 
-void
-mbtheme_init (Wm   *w, 
-	      char *theme_name)
+/* Work out the theme.xml path for a theme name, falling back to the
+ * default theme if it cant be found.
+ */
+static void
+mbtheme_resolve_filename (char *theme_name, 
+			  char *theme_filename)
 {
-  int err = 0;
-  XMLNode *root_node, *cnode;
-  Nlist *n;
-
-  XMLParser *parser = xml_parser_new();
-
-  char theme_filename[255] = DEFAULTTHEME;
-  char *theme_path = NULL;
-
-#ifndef MAXPATHLEN
-#define MAXPATHLEN 256
-#endif
+  strncpy(theme_filename, DEFAULTTHEME, 255);
 
-  char orig_wd[MAXPATHLEN];
-  
   if (theme_name != NULL) { 
     if (theme_name[0] == '/')
       strncpy(theme_filename, theme_name, 255);
@@ -2463,7 +2658,7 @@ mbtheme_init (Wm   *w,
 		     DATADIR, theme_name);
 	  }
       }
-  } else { theme_name = DEFAULTTHEMENAME; }
+  }
   
   if (!file_exists(theme_filename))
     {
@@ -2473,6 +2668,43 @@ mbtheme_init (Wm   *w,
       if (!file_exists(DEFAULTTHEME)) exit(1);
       strncpy(theme_filename, DEFAULTTHEME, 255);
     }
+}
+
+/* If loader is set, the theme file has already been parsed ( and its 
+ * pixmaps decoded ) by the loader thread, otherwise we do it all here.
+ */
+static void
+_mbtheme_init (Wm            *w, 
+	       char          *theme_name,
+	       MBThemeLoader *loader)
+{
+  int err = 0;
+  XMLNode *root_node = NULL, *cnode;
+  Nlist *n;
+
+  XMLParser *parser = NULL;
+
+  char theme_filename[255];
+  char *theme_path = NULL;
+
+  char orig_wd[MAXPATHLEN];
+
+  if (loader != NULL)
+    {
+      /* We take over the parse results */
+      strncpy(theme_filename, loader->theme_filename, 255);
+      parser    = loader->parser;
+      root_node = loader->root_node;
+      loader->parser    = NULL;
+      loader->root_node = NULL;
+    }
+  else
+    {
+      mbtheme_resolve_filename(theme_name, theme_filename);
+      parser = xml_parser_new();
+    }
+
+  if (theme_name == NULL) theme_name = DEFAULTTHEMENAME;
   
   if (getcwd(orig_wd, MAXPATHLEN) == (char *)NULL)
     {
@@ -2495,7 +2727,8 @@ mbtheme_init (Wm   *w,
 
   comp_engine_set_defualts(w);
 
-  root_node = xml_parse_file_dom(parser, theme_filename);
+  if (loader == NULL)
+    root_node = xml_parse_file_dom(parser, theme_filename);
 
   if (root_node == NULL)
     {
@@ -2524,6 +2757,9 @@ mbtheme_init (Wm   *w,
 
    w->mbtheme = mbtheme_new(w);
 
+   if (loader != NULL)
+     w->mbtheme->preloaded_images = loader->images;
+
    if (get_attr(root_node, "cache") 
        && !strcasecmp(get_attr(root_node, "cache"), "false"))
      {
@@ -2640,10 +2876,298 @@ mbtheme_init (Wm   *w,
 
    xml_parser_free(parser, root_node); 
 
+   w->mbtheme->preloaded_images = NULL;
+
+   mbtheme_publish_footprint(w, w->mbtheme);
+
    comp_engine_theme_init(w);
 
 }
 
+#if DO_TIMINGS
+
+/* Compares the lookups done for every decoration paint - the frame, its
+ * label and icon layers and each button action - through the old list
+ * walks against the direct indexes. 
+ */
+static void
+mbtheme_time_lookups (MBTheme *theme)
+{
+  struct timeval   tv_start, tv_end;
+  struct timezone  tz;
+  long             diff_list, diff_index;
+  int              i, type, action, n_lookups = 0;
+  volatile void   *res;
+  MBThemeFrame    *frame;
+
+#define LOOKUP_ITERATIONS 10000
+
+  gettimeofday(&tv_start, &tz);
+
+  for (i = 0; i < LOOKUP_ITERATIONS; i++)
+    for (type = 1; type < N_FRAME_TYPES; type++)
+      {
+	res = frame = list_find_by_id(theme->frames, type);
+	if (frame == NULL) continue;
+	res = list_find_by_id(frame->layers, LAYER_LABEL);
+	res = list_find_by_id(frame->layers, LAYER_ICON);
+	for (action = 1; action < N_BUTTON_ACTIONS; action++)
+	  res = list_find_by_id(frame->buttons, action);
+      }
+
+  gettimeofday(&tv_end, &tz);
+
+  diff_list = ((tv_end.tv_sec * 1000000) + tv_end.tv_usec) 
+    - ((tv_start.tv_sec * 1000000) + tv_start.tv_usec);
+
+  gettimeofday(&tv_start, &tz);
+
+  for (i = 0; i < LOOKUP_ITERATIONS; i++)
+    for (type = 1; type < N_FRAME_TYPES; type++)
+      {
+	res = frame = mbtheme_frame(theme, type);
+	n_lookups++;
+	if (frame == NULL) continue;
+	res = mbtheme_frame_layer(frame, LAYER_LABEL);
+	res = mbtheme_frame_layer(frame, LAYER_ICON);
+	for (action = 1; action < N_BUTTON_ACTIONS; action++)
+	  res = mbtheme_frame_button(frame, action);
+	n_lookups += 2 + N_BUTTON_ACTIONS - 1;
+      }
+
+  gettimeofday(&tv_end, &tz);
+
+  diff_index = ((tv_end.tv_sec * 1000000) + tv_end.tv_usec) 
+    - ((tv_start.tv_sec * 1000000) + tv_start.tv_usec);
+
+  fprintf(stderr, "THEME LOOKUP TIMING: %i lookups, list %li us, index %li us\n",
+	  n_lookups, diff_list, diff_index); 
+}
+
+#endif
+
+void
+mbtheme_init (Wm   *w, 
+	      char *theme_name)
+{
+  _mbtheme_init (w, theme_name, NULL);
+
+#if DO_TIMINGS
+  mbtheme_time_lookups (w->mbtheme);
+#endif
+}
+
+#ifdef USE_THEME_THREAD
+
+/* Background theme loading. 
+ *
+ * The loader thread parses theme.xml and decodes its pixmaps, the slow 
+ * part of a switch, while the main loop keeps on managing windows. It 
+ * must make no X calls. When done it pokes a pipe the event loop selects
+ * on, and mbtheme_switch_complete() then builds the rest of the theme 
+ * ( colors, fonts, frames ), swaps it in and repaints in one go.
+ */
+
+/* list_new() takes its nodes from the unlocked slab_list_items pool the
+ * main thread is using, so the loader mallocs its own and 
+ * mbtheme_loader_free() hands them back with free().
+ */
+static Bool
+mbtheme_loader_image_add (struct list_item **tail, 
+			  char               *id, 
+			  MBPixbufImage      *img)
+{
+  struct list_item *item;
+
+  if ((item = malloc(sizeof(struct list_item))) == NULL)
+    return False;
+
+  memset(item, 0, sizeof(struct list_item));
+
+  if ((item->name = strdup(id)) == NULL)
+    {
+      free(item);
+      return False;
+    }
+
+  item->data = (void *)img;
+  *tail      = item;
+
+  return True;
+}
+
+static void *
+mbtheme_loader_thread (void *data)
+{
+  MBThemeLoader     *loader = (MBThemeLoader *)data;
+  struct list_item **tail   = &loader->images;
+  XMLNode           *cnode;
+  Nlist             *n;
+  char           theme_path[MAXPATHLEN], img_path[MAXPATHLEN];
+
+  strncpy(theme_path, loader->theme_filename, MAXPATHLEN);
+  theme_path[MAXPATHLEN-1] = '\0';
+  theme_path[strlen(theme_path)-9] = '\0'; /* strip theme.xml */
+
+  loader->root_node = xml_parse_file_dom(loader->parser, 
+					 loader->theme_filename);
+
+  if (loader->root_node != NULL)
+    {
+      for (n = loader->root_node->kids; n != NULL; n = n->next)
+	{
+	  MBPixbufImage *img;
+	  char          *id, *filename;
+
+	  cnode = n->data;
+
+	  if (strcmp("pixmap", cnode->tag))
+	    continue;
+
+	  id       = get_attr(cnode, "id");
+	  filename = get_attr(cnode, "filename");
+
+	  if (id == NULL || filename == NULL)
+	    break;
+
+	  if (filename[0] == '/')
+	    strncpy(img_path, filename, MAXPATHLEN);
+	  else
+	    snprintf(img_path, MAXPATHLEN, "%s%s", theme_path, filename);
+
+	  /* Leave failures to the main thread so they get reported */
+	  if ((img = mb_pixbuf_img_new_from_file(loader->wm->pb, 
+						 img_path)) == NULL)
+	    break;
+
+	  if (!mbtheme_loader_image_add(tail, id, img))
+	    {
+	      mb_pixbuf_img_free(loader->wm->pb, img);
+	      break;
+	    }
+
+	  tail = &(*tail)->next;
+	}
+    }
+
+  write(loader->pipe_fds[1], "", 1);
+
+  return NULL;
+}
+
+static void
+mbtheme_loader_free (MBThemeLoader *loader)
+{
+  struct list_item *cur, *next;
+
+  for (cur = loader->images; cur != NULL; cur = next)
+    {
+      next = cur->next;
+      if (cur->data)
+	mb_pixbuf_img_free(loader->wm->pb, (MBPixbufImage *)cur->data);
+      free(cur->name);
+      free(cur);
+    }
+
+  loader->images = NULL;
+
+  if (loader->parser)
+    xml_parser_free(loader->parser, loader->root_node);
+
+  close(loader->pipe_fds[0]);
+  close(loader->pipe_fds[1]);
+
+  if (loader->theme_name)   free(loader->theme_name);
+  if (loader->pending_name) free(loader->pending_name);
+
+  free(loader);
+}
+
+static Bool
+mbtheme_loader_start (Wm   *w, 
+		      char *theme_name)
+{
+  MBThemeLoader *loader;
+
+  if (w->theme_loader != NULL)
+    {
+      /* Already loading, just remember the latest request */
+      loader = w->theme_loader;
+
+      if (loader->pending_name) free(loader->pending_name);
+      loader->pending_name = strdup(theme_name ? theme_name 
+				    : DEFAULTTHEMENAME);
+      return True;
+    }
+
+  loader = malloc(sizeof(MBThemeLoader));
+  memset(loader, 0, sizeof(MBThemeLoader));
+
+  if (pipe(loader->pipe_fds))
+    {
+      free(loader);
+      return False;
+    }
+
+  loader->wm = w;
+
+  if (theme_name)
+    loader->theme_name = strdup(theme_name);
+
+  mbtheme_resolve_filename(theme_name, loader->theme_filename);
+
+  loader->parser = xml_parser_new();
+
+  if (pthread_create(&loader->thread, NULL, mbtheme_loader_thread, loader))
+    {
+      dbg("%s() failed to start loader thread\n", __func__);
+      mbtheme_loader_free(loader);
+      return False;
+    }
+
+  dbg("%s() loading %s in background\n", __func__, loader->theme_filename);
+
+  w->theme_loader = loader;
+
+  return True;
+}
+
+void
+mbtheme_switch_complete (Wm *w)
+{
+  MBThemeLoader *loader = w->theme_loader;
+  MBTheme       *old_theme;
+  char           byte;
+
+  if (loader == NULL) return;
+
+  read(loader->pipe_fds[0], &byte, 1);
+  pthread_join(loader->thread, NULL);
+
+  w->theme_loader = NULL;
+
+  dbg("%s() swapping in %s\n", __func__, loader->theme_filename);
+
+  XGrabServer(w->dpy);
+
+  /* Old theme stays live until the new one is fully built */
+  old_theme = w->mbtheme;
+
+  _mbtheme_init(w, loader->theme_name, loader);
+
+  if (old_theme)
+    mbtheme_free(w, old_theme);
+
+  mbtheme_redecorate_all(w);
+
+  if (loader->pending_name)
+    mbtheme_switch(w, loader->pending_name);
+
+  mbtheme_loader_free(loader);
+}
+
+#endif
+
 Bool
 mbtheme_has_titlebar_panel(MBTheme *theme)
 {
@@ -2653,25 +3177,29 @@ mbtheme_has_titlebar_panel(MBTheme *theme)
 
 Bool
 mbtheme_get_titlebar_panel_rect(MBTheme    *theme, 
+				int         output,
 				XRectangle *rect,
 				Client     *ignore_client)
 {
+  Wm           *w = theme->wm;
   MBThemeFrame *frame;
   int width, height;
 
   if (!theme->have_toolbar_panel) return False;
 
-  frame = (MBThemeFrame*)list_find_by_id(theme->frames, FRAME_MAIN );
+  frame = mbtheme_frame(theme, FRAME_MAIN);
 
   if (!frame) return False;
 
   height = theme_frame_defined_height_get(theme, FRAME_MAIN);
-  width  = theme->wm->dpy_width 
-    - wm_get_offsets_size(theme->wm, EAST,  ignore_client, True)
-    - wm_get_offsets_size(theme->wm, WEST,  ignore_client, True);
-
-  rect->x = param_get( frame, theme->toolbar_panel_x, width );
-  rect->y = param_get( frame, theme->toolbar_panel_y, height );
+  width  = w->outputs[output].width 
+    - wm_get_output_offsets_size(w, output, EAST, ignore_client, True)
+    - wm_get_output_offsets_size(w, output, WEST, ignore_client, True);
+
+  rect->x = w->outputs[output].x 
+    + param_get( frame, theme->toolbar_panel_x, width );
+  rect->y = w->outputs[output].y 
+    + param_get( frame, theme->toolbar_panel_y, height );
   rect->width  = param_get( frame, theme->toolbar_panel_w, width );
   rect->height = param_get( frame, theme->toolbar_panel_h, height );
 
@@ -26,6 +26,10 @@
 #include "wm.h"
 #include "list.h"
 
+#ifdef USE_THEME_THREAD
+#include <pthread.h>
+#endif
+
 #define ERROR_MISSING_PARAMS   -1
 #define ERROR_INCORRECT_PARAMS -2
 #define ERROR_LOADING_RESOURCE -3
@@ -57,6 +61,7 @@ enum {
   LAYER_PICTURE_TILED,
   LAYER_ICON,
   LAYER_SUB_LABEL,
+  N_LAYER_TYPES
 
 } MBThemeLayerType;
 
@@ -147,9 +152,28 @@ typedef struct _mb_theme_frame
 
   int                   fixed_width;
   int                   fixed_x;
+
+  /* Direct lookup of the first layer / button of each type, mirrors 
+   * the lists above. See mbtheme_frame_layer() etc.
+   */
+  MBThemeLayer          *layer_index[N_LAYER_TYPES];
+  MBThemeButton         *button_index[N_BUTTON_ACTIONS];
    
 } MBThemeFrame;
 
+/* Theme lifetime objects ( frames, layers, buttons, labels, params and
+ * the list nodes holding them ) are carved out of a chain of blocks owned
+ * by the theme, so a theme switch releases them all in one go rather than
+ * fragmenting the heap with hundreds of small frees.
+ */
+typedef struct _mb_theme_arena_block 
+{
+  struct _mb_theme_arena_block *next;
+  size_t                        size;
+  size_t                        used;
+
+} MBThemeArenaBlock;
+
 typedef struct _mbtheme {
 
   struct list_item* frames;
@@ -160,6 +184,8 @@ typedef struct _mbtheme {
 
   GC                gc, mask_gc, band_gc; /* for drag window  */
 
+  MBThemeFrame*     frame_index[N_FRAME_TYPES]; /* first frame of each type */
+
   MBPixbufImage* img_caches[N_FRAME_TYPES];
 
   /* For toolbar in panel */
@@ -176,15 +202,59 @@ typedef struct _mbtheme {
   /* App side decoration pixmap cache */
 
   Pixmap app_win_pxm_cache[3];
+  int    app_win_pxm_cache_w[3], app_win_pxm_cache_h[3];
+  unsigned long app_win_pxm_cache_bytes; /* roughly, for the stats */
 
   /* disable cacheing, not recommened */
   Bool           disable_pixbuf_cache;
 
+  /* Pixmaps already decoded by the loader thread, only set while parsing */
+  struct list_item  *preloaded_images;
+
+  /* Arena for theme lifetime allocations, see above */
+  MBThemeArenaBlock *arena;
+  size_t             arena_bytes_used;
+  size_t             arena_bytes_reserved;
+
   struct _wm    *wm;
    
 } MBTheme;
 
 
+/* State for a theme being loaded in the background, see 
+ * mbtheme_switch_complete() 
+ */
+typedef struct _mb_theme_loader
+{
+  struct _wm        *wm;
+  char              *theme_name;
+  char               theme_filename[255];
+  char              *pending_name; /* switch requested while we loaded */
+
+  XMLParser         *parser;
+  XMLNode           *root_node;
+  struct list_item  *images;
+
+#ifdef USE_THEME_THREAD
+  pthread_t          thread;
+#endif
+  int                pipe_fds[2];
+
+} MBThemeLoader;
+
+/* Constant time replacements for list_find_by_id() on the theme frame,
+ * layer and button lists. The lists are still kept for enumeration.
+ */
+#define mbtheme_frame(t, type)                                     \
+  (((type) > 0 && (type) < N_FRAME_TYPES) ? (t)->frame_index[(type)] : NULL)
+
+#define mbtheme_frame_layer(f, type)                               \
+  (((type) > 0 && (type) < N_LAYER_TYPES) ? (f)->layer_index[(type)] : NULL)
+
+#define mbtheme_frame_button(f, action)                            \
+  (((action) > 0 && (action) < N_BUTTON_ACTIONS) ?                 \
+   (f)->button_index[(action)] : NULL)
+
 void     
 theme_paint_rgba_icon (MBTheme       *t,
 		       Client        *c,
@@ -237,6 +307,15 @@ theme_img_cache_clear_all (MBTheme       *theme );
 void
 theme_pixmap_cache_clear_all( MBTheme *theme );
 
+void
+theme_pixmap_cache_clear( MBTheme *theme, int decor_idx );
+
+void
+mbtheme_memory_usage(MBTheme       *theme, 
+		     unsigned long *arena, 
+		     unsigned long *images, 
+		     unsigned long *pixmaps);
+
 
 void     
 theme_frame_button_paint (MBTheme       *theme,
@@ -279,6 +358,11 @@ void
 mbtheme_init (Wm            *w,
 	      char          *theme_conf);
 
+#ifdef USE_THEME_THREAD
+void
+mbtheme_switch_complete (Wm            *w);
+#endif
+
 int      
 theme_frame_button_get_x_pos (MBTheme       *theme,
 			      int            frame_type,
@@ -287,6 +371,7 @@ theme_frame_button_get_x_pos (MBTheme       *theme,
 
 Bool
 mbtheme_get_titlebar_panel_rect(MBTheme    *theme, 
+				int         output,
 				XRectangle *rect,
 				Client     *ignore_client);
 
@@ -72,6 +72,10 @@ sig_handler(int signal)
 	  exit(1); break;
         case SIGCHLD:
           wait(NULL); break;
+        case SIGUSR1:
+	  trace_dump_requested = 1; break;
+        case SIGUSR2:
+	  restart_requested = 1; break;
     }
 }
 
@@ -156,10 +160,11 @@ mwm_get_decoration_flags(Wm *w, Window win)
   PropMotifWmHints *hints = NULL;
   unsigned long n_items, bytes_after;
 
-  if (XGetWindowProperty (w->dpy, win, w->atoms[_MOTIF_WM_HINTS],
-                          0, PROP_MOTIF_WM_HINTS_ELEMENTS,
-                          False, AnyPropertyType, &type, &format, &n_items,
-                          &bytes_after, (unsigned char **)&hints) != Success ||
+  if (stats_xget_window_property(w->dpy, win, w->atoms[_MOTIF_WM_HINTS],
+				 0, PROP_MOTIF_WM_HINTS_ELEMENTS,
+				 False, AnyPropertyType, &type, &format, 
+				 &n_items, &bytes_after, 
+				 (unsigned char **)&hints) != Success ||
       type == None)
     {
       dbg("MWM xgetwinprop failed\n");
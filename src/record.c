@@ -0,0 +1,620 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "record.h"
+#include "wm.h"
+
+FILE *record_fp        = NULL;
+Bool  record_replaying = False;
+
+static MBTraceTime       record_last = 0;
+
+/* Replay state */
+static FILE             *replay_fp = NULL;
+static Window            replay_root = None;
+static MBRecordHeader    replay_hdr;
+static unsigned char    *replay_payload = NULL;
+static Bool              replay_have_next = False;
+static struct list_item *replay_windows = NULL; /* recorded id -> ours */
+
+/* Property replies recorded for the event currently being replayed */
+static MBRecordProperty *replay_props = NULL;
+static unsigned char   **replay_props_data = NULL;
+static Bool             *replay_props_used = NULL;
+static int               replay_n_props = 0, replay_props_size = 0;
+
+static int
+record_event_size(int type)
+{
+  switch (type)
+    {
+    case KeyPress:
+    case KeyRelease:       return sizeof(XKeyEvent);
+    case ButtonPress:
+    case ButtonRelease:    return sizeof(XButtonEvent);
+    case MotionNotify:     return sizeof(XMotionEvent);
+    case EnterNotify:
+    case LeaveNotify:      return sizeof(XCrossingEvent);
+    case FocusIn:
+    case FocusOut:         return sizeof(XFocusChangeEvent);
+    case Expose:           return sizeof(XExposeEvent);
+    case CreateNotify:     return sizeof(XCreateWindowEvent);
+    case DestroyNotify:    return sizeof(XDestroyWindowEvent);
+    case UnmapNotify:      return sizeof(XUnmapEvent);
+    case MapNotify:        return sizeof(XMapEvent);
+    case MapRequest:       return sizeof(XMapRequestEvent);
+    case ReparentNotify:   return sizeof(XReparentEvent);
+    case ConfigureNotify:  return sizeof(XConfigureEvent);
+    case ConfigureRequest: return sizeof(XConfigureRequestEvent);
+    case PropertyNotify:   return sizeof(XPropertyEvent);
+    case ClientMessage:    return sizeof(XClientMessageEvent);
+    case MappingNotify:    return sizeof(XMappingEvent);
+    default:               return sizeof(XEvent);
+    }
+}
+
+static unsigned long
+record_property_data_size(int format, unsigned long nitems)
+{
+  switch (format)
+    {
+    case 8:  return nitems;
+    case 16: return nitems * sizeof(short);
+    case 32: return nitems * sizeof(long); /* Xlib hands back longs */
+    default: return 0;
+    }
+}
+
+static void
+record_write(int kind, void *payload, int len, void *extra, int extra_len)
+{
+  MBRecordHeader hdr;
+  MBTraceTime    now = trace_now();
+
+  hdr.kind  = kind;
+  hdr.len   = len + extra_len;
+  hdr.delta = now - record_last;
+
+  record_last = now;
+
+  if (fwrite(&hdr, sizeof(hdr), 1, record_fp) != 1
+      || fwrite(payload, len, 1, record_fp) != 1
+      || (extra_len && fwrite(extra, extra_len, 1, record_fp) != 1))
+    {
+      fprintf(stderr, "matchbox: recording failed, stopping\n");
+      fclose(record_fp);
+      record_fp = NULL;
+    }
+}
+
+static void
+record_window(Wm *w, Window win)
+{
+  XWindowAttributes attr;
+  MBRecordWindow    rw;
+
+  misc_trap_xerrors();
+
+  STATS_ROUND_TRIP();
+  if (!XGetWindowAttributes(w->dpy, win, &attr) || misc_untrap_xerrors())
+    return;
+
+  memset(&rw, 0, sizeof(rw));
+
+  rw.win               = win;
+  rw.x                 = attr.x;
+  rw.y                 = attr.y;
+  rw.width             = attr.width;
+  rw.height            = attr.height;
+  rw.override_redirect = attr.override_redirect;
+  rw.map_state         = attr.map_state;
+
+  record_write(RECORD_WINDOW, &rw, sizeof(rw), NULL, 0);
+}
+
+/* Called from wm_new(), before any clients are managed so the
+ * windows already there are in the log for replay to recreate.
+ */
+void
+record_init(Wm *w)
+{
+  MBRecordFileHeader  hdr;
+  Window              root_ret, parent_ret, *children = NULL;
+  unsigned int        n_children = 0, i;
+  char               *path;
+
+  if ((path = getenv("MB_RECORD_FILE")) == NULL)
+    return;
+
+  if ((record_fp = fopen(path, "w")) == NULL)
+    {
+      fprintf(stderr, "matchbox: unable to record to %s\n", path);
+      return;
+    }
+
+  memset(&hdr, 0, sizeof(hdr));
+
+  memcpy(hdr.magic, RECORD_MAGIC, sizeof(hdr.magic));
+  hdr.version    = RECORD_VERSION;
+  hdr.dpy_width  = w->dpy_width;
+  hdr.dpy_height = w->dpy_height;
+  hdr.root       = w->root;
+
+  fwrite(&hdr, sizeof(hdr), 1, record_fp);
+
+  record_last = trace_now();
+
+  STATS_ROUND_TRIP();
+  if (XQueryTree(w->dpy, w->root, &root_ret, &parent_ret,
+		 &children, &n_children))
+    {
+      for (i = 0; i < n_children && record_fp; i++)
+	record_window(w, children[i]);
+
+      if (children) XFree(children);
+    }
+
+  dbg("%s() recording to %s, %i existing windows\n",
+      __func__, path, n_children);
+}
+
+void
+record_event(Wm *w, XEvent *ev)
+{
+  /* Need the geometry to fake the window up on replay */
+  if (ev->type == MapRequest)
+    record_window(w, ev->xmaprequest.window);
+
+  if (record_fp)
+    record_write(RECORD_EVENT, ev, record_event_size(ev->type), NULL, 0);
+}
+
+/* Called by the XGetWindowProperty wrapper in stats.c */
+void
+record_property(MBRecordProperty *rp, unsigned char *data)
+{
+  int len = 0;
+
+  if (data != NULL)
+    len = record_property_data_size(rp->actual_format, rp->nitems);
+
+  record_write(RECORD_PROPERTY, rp, sizeof(MBRecordProperty), data, len);
+}
+
+/* Replay */
+
+static Bool
+replay_read(void)
+{
+  if (replay_payload)
+    free(replay_payload);
+
+  replay_payload   = NULL;
+  replay_have_next = False;
+
+  if (fread(&replay_hdr, sizeof(replay_hdr), 1, replay_fp) != 1)
+    return False;
+
+  if (replay_hdr.len > RECORD_MAX_LEN)
+    {
+      fprintf(stderr, "matchbox: corrupt replay log, record of %u bytes\n",
+	      replay_hdr.len);
+      return False;
+    }
+
+  if ((replay_payload = malloc(replay_hdr.len + 1)) == NULL)
+    return False;
+
+  if (replay_hdr.len
+      && fread(replay_payload, replay_hdr.len, 1, replay_fp) != 1)
+    {
+      fprintf(stderr, "matchbox: truncated replay log\n");
+      return False;
+    }
+
+  replay_have_next = True;
+
+  return True;
+}
+
+/* Doesnt fake up unknown windows, they just wont match */
+static Window
+replay_find_window(Wm *w, Window win)
+{
+  Window ours;
+
+  if (win == replay_root)
+    return w->root;
+
+  if ((ours = (Window)list_find_by_id(replay_windows, (int)win)) != None)
+    return ours;
+
+  return win;
+}
+
+static Window
+replay_stand_in(Wm *w, MBRecordWindow *rw)
+{
+  XSetWindowAttributes attr;
+  Window               win;
+
+  attr.override_redirect = rw->override_redirect;
+  attr.background_pixel  = w->grey_col.pixel;
+
+  win = XCreateWindow(w->dpy, w->root, rw->x, rw->y,
+		      rw->width  ? rw->width  : 1,
+		      rw->height ? rw->height : 1, 0,
+		      CopyFromParent, InputOutput, CopyFromParent,
+		      CWOverrideRedirect|CWBackPixel, &attr);
+
+  /* Xids fit in the id, top 3 bits are always clear */
+  list_add(&replay_windows, NULL, (int)rw->win, (void*)win);
+
+  if (rw->map_state == IsViewable)
+    XMapWindow(w->dpy, win);
+
+  return win;
+}
+
+static Window
+replay_translate_window(Wm *w, Window win)
+{
+  MBRecordWindow rw;
+  Window         ours;
+
+  if (win == None)
+    return None;
+
+  if (win == replay_root)
+    return w->root;
+
+  if ((ours = (Window)list_find_by_id(replay_windows, (int)win)) != None)
+    return ours;
+
+  /* Never saw its creation, fake something up */
+  memset(&rw, 0, sizeof(rw));
+  rw.win = win;
+
+  return replay_stand_in(w, &rw);
+}
+
+static void
+replay_translate_event(Wm *w, XEvent *ev)
+{
+  ev->xany.display = w->dpy;
+  ev->xany.window  = replay_translate_window(w, ev->xany.window);
+
+  switch (ev->type)
+    {
+    case CreateNotify:
+      if (!list_find_by_id(replay_windows, (int)ev->xcreatewindow.window))
+	{
+	  MBRecordWindow rw;
+
+	  memset(&rw, 0, sizeof(rw));
+
+	  rw.win               = ev->xcreatewindow.window;
+	  rw.x                 = ev->xcreatewindow.x;
+	  rw.y                 = ev->xcreatewindow.y;
+	  rw.width             = ev->xcreatewindow.width;
+	  rw.height            = ev->xcreatewindow.height;
+	  rw.override_redirect = ev->xcreatewindow.override_redirect;
+
+	  replay_stand_in(w, &rw);
+	}
+      ev->xcreatewindow.window
+	= replay_translate_window(w, ev->xcreatewindow.window);
+      break;
+    case DestroyNotify:
+      ev->xdestroywindow.window
+	= replay_translate_window(w, ev->xdestroywindow.window);
+      break;
+    case UnmapNotify:
+      ev->xunmap.window = replay_translate_window(w, ev->xunmap.window);
+      break;
+    case MapNotify:
+      ev->xmap.window = replay_translate_window(w, ev->xmap.window);
+      break;
+    case MapRequest:
+      ev->xmaprequest.window
+	= replay_translate_window(w, ev->xmaprequest.window);
+      break;
+    case ReparentNotify:
+      ev->xreparent.window = replay_translate_window(w, ev->xreparent.window);
+      ev->xreparent.parent = replay_translate_window(w, ev->xreparent.parent);
+      break;
+    case ConfigureNotify:
+      ev->xconfigure.window = replay_translate_window(w, ev->xconfigure.window);
+      ev->xconfigure.above  = replay_translate_window(w, ev->xconfigure.above);
+      break;
+    case ConfigureRequest:
+      ev->xconfigurerequest.window
+	= replay_translate_window(w, ev->xconfigurerequest.window);
+      ev->xconfigurerequest.above
+	= replay_translate_window(w, ev->xconfigurerequest.above);
+      break;
+    case ButtonPress:
+    case ButtonRelease:
+      ev->xbutton.root      = w->root;
+      ev->xbutton.subwindow = replay_translate_window(w, ev->xbutton.subwindow);
+      break;
+    case KeyPress:
+    case KeyRelease:
+      ev->xkey.root      = w->root;
+      ev->xkey.subwindow = replay_translate_window(w, ev->xkey.subwindow);
+      break;
+    }
+}
+
+static void
+replay_props_clear(void)
+{
+  int i;
+
+  for (i = 0; i < replay_n_props; i++)
+    if (replay_props_data[i])
+      free(replay_props_data[i]);
+
+  replay_n_props = 0;
+}
+
+static void
+replay_props_add(Wm *w, MBRecordProperty *rp, unsigned char *data, int len)
+{
+  if (replay_n_props == replay_props_size)
+    {
+      replay_props_size = replay_props_size ? replay_props_size * 2 : 16;
+
+      replay_props = realloc(replay_props,
+			     replay_props_size * sizeof(MBRecordProperty));
+      replay_props_data = realloc(replay_props_data,
+				  replay_props_size * sizeof(unsigned char*));
+      replay_props_used = realloc(replay_props_used,
+				  replay_props_size * sizeof(Bool));
+    }
+
+  replay_props[replay_n_props]     = *rp;
+  replay_props[replay_n_props].win = replay_find_window(w, rp->win);
+  replay_props_used[replay_n_props] = False;
+  replay_props_data[replay_n_props] = NULL;
+
+  if (rp->status == Success && rp->actual_type != None)
+    {
+      /* Extra nul like Xlib, so string props can be used as is */
+      replay_props_data[replay_n_props] = malloc(len + 1);
+      memcpy(replay_props_data[replay_n_props], data, len);
+      replay_props_data[replay_n_props][len] = '\0';
+    }
+
+  replay_n_props++;
+}
+
+/* Called by the XGetWindowProperty wrapper, hands back what the
+ * recorded session got rather than what the stand-ins have.
+ */
+Bool
+record_replay_property(Window win, Atom property, long offset,
+		       long length, Atom req_type, int *status,
+		       Atom *actual_type, int *actual_format,
+		       unsigned long *nitems, unsigned long *bytes_after,
+		       unsigned char **prop)
+{
+  int i;
+
+  for (i = 0; i < replay_n_props; i++)
+    {
+      MBRecordProperty *rp = &replay_props[i];
+
+      if (replay_props_used[i] || rp->win != win
+	  || rp->property != property || rp->offset != offset
+	  || rp->req_type != req_type)
+	continue;
+
+      replay_props_used[i] = True;
+
+      *status        = rp->status;
+      *actual_type   = rp->actual_type;
+      *actual_format = rp->actual_format;
+      *nitems        = rp->nitems;
+      *bytes_after   = rp->bytes_after;
+      *prop          = replay_props_data[i]; /* caller XFree()'s it */
+
+      replay_props_data[i] = NULL;
+
+      return True;
+    }
+
+  return False;
+}
+
+/* Handles the records following an event, leaving the next event
+ * ( if any ) read ahead.
+ */
+static void
+replay_read_aux(Wm *w)
+{
+  while (replay_read() && replay_hdr.kind != RECORD_EVENT)
+    {
+      switch (replay_hdr.kind)
+	{
+	case RECORD_PROPERTY:
+	  {
+	    MBRecordProperty *rp = (MBRecordProperty *)replay_payload;
+	    unsigned long     len;
+
+	    if (replay_hdr.len < sizeof(MBRecordProperty))
+	      break;
+
+	    len = replay_hdr.len - sizeof(MBRecordProperty);
+
+	    /* Callers index the reply by nitems, it must all be there */
+	    if (rp->status == Success && rp->actual_type != None
+		&& len < record_property_data_size(rp->actual_format, 
+						   rp->nitems))
+	      {
+		dbg("%s() short property record, skipping\n", __func__);
+		break;
+	      }
+
+	    replay_props_add(w, rp, replay_payload + sizeof(MBRecordProperty),
+			     len);
+	  }
+	  break;
+	case RECORD_WINDOW:
+	  {
+	    MBRecordWindow *rw = (MBRecordWindow *)replay_payload;
+
+	    if (replay_hdr.len < sizeof(MBRecordWindow))
+	      break;
+
+	    if (!list_find_by_id(replay_windows, (int)rw->win))
+	      replay_stand_in(w, rw);
+	  }
+	  break;
+	default:
+	  dbg("%s() unknown record kind %i\n", __func__, replay_hdr.kind);
+	  break;
+	}
+    }
+}
+
+/* Creates stand-ins for the windows there when recording started,
+ * call before wm_init_existing() so they get managed like they were.
+ */
+Bool
+record_replay_open(Wm *w, char *path)
+{
+  MBRecordFileHeader hdr;
+
+  if ((replay_fp = fopen(path, "r")) == NULL)
+    {
+      fprintf(stderr, "matchbox: unable to open replay log %s\n", path);
+      return False;
+    }
+
+  if (fread(&hdr, sizeof(hdr), 1, replay_fp) != 1
+      || memcmp(hdr.magic, RECORD_MAGIC, sizeof(hdr.magic))
+      || hdr.version != RECORD_VERSION)
+    {
+      fprintf(stderr, "matchbox: %s is not a matchbox event log\n", path);
+      fclose(replay_fp);
+      replay_fp = NULL;
+      return False;
+    }
+
+  if (hdr.dpy_width != w->dpy_width || hdr.dpy_height != w->dpy_height)
+    fprintf(stderr, "matchbox: WARNING: log recorded at %ix%i, "
+	    "replaying at %ix%i\n", hdr.dpy_width, hdr.dpy_height,
+	    w->dpy_width, w->dpy_height);
+
+  replay_root      = hdr.root;
+  record_replaying = True;
+
+  /* Startup windows and the replies read managing them */
+  replay_read_aux(w);
+
+  return True;
+}
+
+/* Dispatches every recorded event as fast as possible, timing each
+ * including the decoration and composite work it triggers. Returns
+ * an exit code.
+ */
+int
+record_replay_run(Wm *w)
+{
+  unsigned long count[LASTEvent], total[LASTEvent], max[LASTEvent];
+  MBTraceTime   start, all_start;
+  unsigned long dur, n_events = 0, n_skipped = 0;
+  XEvent        ev;
+  int           i;
+
+  if (replay_fp == NULL)
+    return 1;
+
+  memset(count, 0, sizeof(count));
+  memset(total, 0, sizeof(total));
+  memset(max,   0, sizeof(max));
+
+  replay_props_clear();
+  STATS_ROUND_TRIP();
+  XSync(w->dpy, True);
+
+  all_start = trace_now();
+
+  while (replay_have_next)
+    {
+      memset(&ev, 0, sizeof(XEvent));
+      memcpy(&ev, replay_payload,
+	     replay_hdr.len < sizeof(XEvent) ? replay_hdr.len : sizeof(XEvent));
+
+      if (ev.type <= 0 || ev.type >= LASTEvent)
+	{
+	  n_skipped++;
+	  replay_read_aux(w);
+	  continue;
+	}
+
+      replay_translate_event(w, &ev);
+
+      /* The replies this event's handling read */
+      replay_read_aux(w);
+
+      start = trace_now();
+
+      wm_handle_event(w, &ev);
+      wm_flush_pending(w);
+      STATS_ROUND_TRIP();
+      XSync(w->dpy, False); 	/* include the server side */
+
+      dur = trace_now() - start;
+
+      trace_record("replay", start, ev.type);
+
+      count[ev.type]++;
+      total[ev.type] += dur;
+      if (dur > max[ev.type])
+	max[ev.type] = dur;
+
+      n_events++;
+
+      /* What our own requests generated isnt part of the session */
+      STATS_ROUND_TRIP();
+      XSync(w->dpy, True);
+      replay_props_clear();
+    }
+
+  dur = trace_now() - all_start;
+
+  printf("%-20s %8s %12s %10s %10s\n",
+	 "event", "count", "total_us", "mean_us", "max_us");
+
+  for (i = 0; i < LASTEvent; i++)
+    if (count[i])
+      printf("%-20s %8lu %12lu %10lu %10lu\n", stats_event_name(i),
+	     count[i], total[i], total[i] / count[i], max[i]);
+
+  printf("\n%lu events in %lu us, %lu skipped\n",
+	 n_events, dur, n_skipped);
+
+  fclose(replay_fp);
+  replay_fp        = NULL;
+  record_replaying = False;
+
+  return 0;
+}
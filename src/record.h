@@ -0,0 +1,115 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MB_RECORD_H_
+#define _MB_RECORD_H_
+
+#include "structs.h"
+
+/* Event stream recording and replay.
+ *
+ *  MB_RECORD_FILE=path  - log every event wm_event_loop() handles,
+ *                         plus the property replies read handling it.
+ *  MB_REPLAY_FILE=path  - feed a log back through the dispatch code
+ *                         ( against e.g Xvfb ), print per event type
+ *                         handler timings and exit.
+ *
+ * The log is host byte order, replay on the arch it was recorded on.
+ * Recorded client windows are recreated as plain stand-in windows,
+ * events on windows the wm itself created ( frames etc ) wont match
+ * anything and extension events ( damage, sync alarms ) are skipped.
+ */
+
+#define RECORD_MAGIC   "MBREC\0\0\0"
+#define RECORD_VERSION 2
+#define RECORD_MAX_LEN (16 * 1024 * 1024) /* larger means a corrupt log */
+
+#define RECORD_EVENT    1
+#define RECORD_PROPERTY 2
+#define RECORD_WINDOW   3
+
+typedef struct MBRecordFileHeader
+{
+  char           magic[8];
+  unsigned int   version;
+  int            dpy_width, dpy_height;
+  Window         root;
+
+} MBRecordFileHeader;
+
+typedef struct MBRecordHeader
+{
+  unsigned int   kind;
+  unsigned int   len;		/* payload bytes following */
+  unsigned int   delta;		/* usecs since previous record */
+
+} MBRecordHeader;
+
+/* RECORD_PROPERTY payload, followed by the reply data */
+typedef struct MBRecordProperty
+{
+  Window         win;
+  Atom           property;
+  Atom           req_type;
+  long           offset, length;
+  int            status;
+  Atom           actual_type;
+  int            actual_format;
+  unsigned long  nitems, bytes_after;
+
+} MBRecordProperty;
+
+/* RECORD_WINDOW payload, written for windows we'll need to fake */
+typedef struct MBRecordWindow
+{
+  Window         win;
+  int            x, y, width, height;
+  int            override_redirect;
+  int            map_state;
+
+} MBRecordWindow;
+
+/* Non NULL when recording, checked inline by the event loop */
+extern FILE *record_fp;
+
+/* True while replaying, checked by the property wrapper */
+extern Bool  record_replaying;
+
+void
+record_init(Wm *w);
+
+void
+record_event(Wm *w, XEvent *ev);
+
+void
+record_property(MBRecordProperty *rp, unsigned char *data);
+
+Bool
+record_replay_property(Window win, Atom property, long offset,
+		       long length, Atom req_type, int *status,
+		       Atom *actual_type, int *actual_format,
+		       unsigned long *nitems, unsigned long *bytes_after,
+		       unsigned char **prop);
+
+Bool
+record_replay_open(Wm *w, char *path);
+
+int
+record_replay_run(Wm *w);
+
+#endif
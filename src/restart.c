@@ -0,0 +1,291 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "restart.h"
+#include "wm.h"
+
+volatile sig_atomic_t restart_requested = 0;
+
+/* Worked out again by the new wm, not carried over */
+#define RESTART_VOLATILE_FLAGS (CLIENT_DECOR_STALE_FLAG                 \
+				|CLIENT_TOOLBARS_MOVED_FOR_FULLSCREEN   \
+				|CLIENT_IS_MOVING                       \
+				|CLIENT_DELAY_MAPPING                   \
+				|CLIENT_NEW_FOR_DESKTOP)
+
+#define RESTART_SAVED_TYPES (MBCLIENT_TYPE_APP|MBCLIENT_TYPE_DIALOG     \
+			     |MBCLIENT_TYPE_TOOLBAR|MBCLIENT_TYPE_PANEL \
+			     |MBCLIENT_TYPE_DESKTOP)
+
+static Client*
+restart_find_client(Wm *w, long win)
+{
+  if (win == None)
+    return NULL;
+
+  return wm_find_client(w, (Window)win, WINDOW);
+}
+
+static int
+restart_client_age(Wm *w, Client *c)
+{
+  MBList *item;
+  int     age = 0;
+
+  list_enumerate(w->client_age_list, item)
+    {
+      if ((Client*)item->data == c)
+	break;
+      age++;
+    }
+
+  return age;
+}
+
+/* Saves the state, hands the clients back to the root in stack order
+ * and execs argv[0] over us. Only returns if the exec fails, which
+ * leaves nothing to carry on with, so exits.
+ */
+void
+restart_exec(Wm *w)
+{
+  Client *c;
+  long   *state, *rec;
+  int     n = 0;
+
+  restart_requested = 0;
+
+  dbg("%s() restarting as '%s'\n", __func__, w->argv[0]);
+
+  state = malloc(sizeof(long) * (RESTART_HDR_LEN
+				 + RESTART_REC_LEN * w->stack_n_items));
+
+  state[RESTART_HDR_MAGIC]   = RESTART_MAGIC;
+  state[RESTART_HDR_VERSION] = RESTART_VERSION;
+  state[RESTART_HDR_FOCUSED] = w->focused_client ?
+                                 w->focused_client->window : None;
+
+  XGrabServer(w->dpy);
+
+  misc_trap_xerrors();
+
+  stack_enumerate(w, c)
+    {
+      if (!(c->type & RESTART_SAVED_TYPES))
+	continue;
+
+      rec = state + RESTART_HDR_LEN + (n * RESTART_REC_LEN);
+
+      rec[RESTART_REC_WINDOW] = c->window;
+      rec[RESTART_REC_TYPE]   = c->type;
+      rec[RESTART_REC_FLAGS]  = c->flags;
+      rec[RESTART_REC_TRANS]  = c->trans ? c->trans->window : None;
+      rec[RESTART_REC_FOCUS]  = c->next_focused_client ?
+                                  c->next_focused_client->window : None;
+      rec[RESTART_REC_AGE]    = restart_client_age(w, c);
+      rec[RESTART_REC_MAPPED] = (client_get_state(c) != IconicState);
+
+      /* Dont let iconized ones flash up on the root meanwhile */
+      if (!rec[RESTART_REC_MAPPED])
+	XUnmapWindow(w->dpy, c->window);
+
+      /* Bottom to top, so they keep their order on the root */
+      XReparentWindow(w->dpy, c->window, w->root, c->x, c->y);
+
+      n++;
+    }
+
+  state[RESTART_HDR_N] = n;
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_RESTART_STATE],
+		  XA_CARDINAL, 32, PropModeReplace, (unsigned char *)state,
+		  RESTART_HDR_LEN + (n * RESTART_REC_LEN));
+
+  STATS_ROUND_TRIP();
+  XSync(w->dpy, False);
+
+  misc_untrap_xerrors();
+
+  XUngrabServer(w->dpy);
+
+  free(state);
+
+  /* Releases the root for the new one, frames and all go with it */
+  XCloseDisplay(w->dpy);
+
+  execvp(w->argv[0], w->argv);
+
+  fprintf(stderr, "matchbox-wm: failed to restart as '%s'\n", w->argv[0]);
+  exit(1);
+}
+
+/* Rebuilds the clients saved by restart_exec(), oldest first so the
+ * age list comes out the same, then puts the stack and focus back as
+ * they were. Returns False if there was nothing ( usable ) saved.
+ */
+Bool
+restart_restore(Wm *w)
+{
+  Atom           type;
+  int            format, n, i, j, next;
+  unsigned long  n_items, bytes_after;
+  long          *state = NULL, *rec;
+  Client       **clients, *c, *prev = NULL, *top = NULL;
+  Bool          *done;
+  MBTraceTime    trace_start = trace_now();
+
+  /* Deleted as its read, a restore gone wrong shouldn't repeat */
+  if (stats_xget_window_property(w->dpy, w->root, w->atoms[_MB_RESTART_STATE],
+				 0L, 1000000L, True, XA_CARDINAL, 
+				 &type, &format, &n_items, &bytes_after,
+				 (unsigned char **)&state) != Success
+      || state == NULL)
+    return False;
+
+  if (type != XA_CARDINAL || format != 32 || n_items < RESTART_HDR_LEN
+      || state[RESTART_HDR_MAGIC] != RESTART_MAGIC
+      || state[RESTART_HDR_VERSION] != RESTART_VERSION
+      || n_items != RESTART_HDR_LEN
+                    + (RESTART_REC_LEN * state[RESTART_HDR_N]))
+    {
+      dbg("%s() ignoring bad restart state\n", __func__);
+      XFree(state);
+      return False;
+    }
+
+  n = state[RESTART_HDR_N];
+
+  dbg("%s() restoring %i clients\n", __func__, n);
+
+  clients = malloc(sizeof(Client*) * (n + 1));
+  memset(clients, 0, sizeof(Client*) * (n + 1));
+  done = malloc(sizeof(Bool) * (n + 1));
+  memset(done, 0, sizeof(Bool) * (n + 1));
+
+  XGrabServer(w->dpy);
+
+  for (j = 0; j < n; j++)
+    {
+      /* Records are in stack order, pick the oldest left */
+      next = -1;
+
+      for (i = 0; i < n; i++)
+	{
+	  rec = state + RESTART_HDR_LEN + (i * RESTART_REC_LEN);
+
+	  if (!done[i] && (next < 0 || rec[RESTART_REC_AGE]
+			   < state[RESTART_HDR_LEN + (next * RESTART_REC_LEN)
+				   + RESTART_REC_AGE]))
+	    next = i;
+	}
+
+      done[next] = True;
+
+      rec = state + RESTART_HDR_LEN + (next * RESTART_REC_LEN);
+
+      switch (rec[RESTART_REC_TYPE])
+	{
+	case MBCLIENT_TYPE_APP:
+	  c = main_client_new(w, rec[RESTART_REC_WINDOW]);
+	  break;
+	case MBCLIENT_TYPE_DIALOG:
+	  c = dialog_client_new(w, rec[RESTART_REC_WINDOW],
+				restart_find_client(w, rec[RESTART_REC_TRANS]));
+	  break;
+	case MBCLIENT_TYPE_TOOLBAR:
+	  c = toolbar_client_new(w, rec[RESTART_REC_WINDOW]);
+	  break;
+	case MBCLIENT_TYPE_PANEL:
+	  c = dockbar_client_new(w, rec[RESTART_REC_WINDOW]);
+	  break;
+	case MBCLIENT_TYPE_DESKTOP:
+	  c = desktop_client_new(w, rec[RESTART_REC_WINDOW]);
+	  break;
+	default:
+	  c = NULL;
+	  break;
+	}
+
+      if (c == NULL) 		/* Went away meanwhile */
+	continue;
+
+      /* toolbar_client_new() can fall back to an app */
+      if (c->type == rec[RESTART_REC_TYPE])
+	c->flags = (rec[RESTART_REC_FLAGS] & ~RESTART_VOLATILE_FLAGS);
+
+      if (c->type == MBCLIENT_TYPE_APP && !rec[RESTART_REC_MAPPED])
+	c->flags |= CLIENT_IS_MINIMIZED; /* wm_manage_client() iconizes */
+
+      wm_manage_client(w, c);
+
+      if (rec[RESTART_REC_MAPPED])
+	{
+	  /* Reparenting it into the frame unmapped it */
+#ifdef USE_COMPOSITE
+	  c->ignore_unmap = 2;
+#else
+	  c->ignore_unmap++;
+#endif
+	}
+      else if (c->type == MBCLIENT_TYPE_PANEL)
+	c->hide(c);
+      else if (c->type != MBCLIENT_TYPE_APP)
+	c->iconize(c);
+
+      clients[next] = c;
+    }
+
+  XUngrabServer(w->dpy);
+
+  /* Now back into the saved order, and what was on top back on top */
+  for (i = 0; i < n; i++)
+    if ((c = clients[i]) != NULL)
+      {
+	stack_move_above_client(c, prev);
+	prev = c;
+
+	rec = state + RESTART_HDR_LEN + (i * RESTART_REC_LEN);
+
+	if ((c->type & (MBCLIENT_TYPE_APP|MBCLIENT_TYPE_DESKTOP))
+	    && rec[RESTART_REC_MAPPED])
+	  top = c;
+      }
+
+  if (top)
+    wm_activate_client(top);
+
+  if ((c = restart_find_client(w, state[RESTART_HDR_FOCUSED])) != NULL
+      && c != top && c->mapped)
+    client_set_focus(c);
+
+  for (i = 0; i < n; i++)
+    if ((c = clients[i]) != NULL)
+      {
+	rec = state + RESTART_HDR_LEN + (i * RESTART_REC_LEN);
+	c->next_focused_client = restart_find_client(w,
+						     rec[RESTART_REC_FOCUS]);
+      }
+
+  free(clients);
+  free(done);
+  XFree(state);
+
+  trace_record("restart_restore", trace_start, n);
+
+  return True;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MB_RESTART_H_
+#define _MB_RESTART_H_
+
+#include "structs.h"
+
+/* Hot restart, via matchbox-remote -restart or SIGUSR2.
+ *
+ * The stack, client types, flags, transients, focus history and age
+ * order are left on the root in _MB_RESTART_STATE, clients put back on
+ * the root and the wm re-exec'd. The new one picks the state up in
+ * wm_init_existing() and rebuilds the clients from it directly, rather
+ * than querying the tree and working out every window's type again.
+ */
+
+#define RESTART_MAGIC   0x4d425253 /* 'MBRS' */
+#define RESTART_VERSION 1
+
+/* Header then per client records, all CARD32 */
+#define RESTART_HDR_MAGIC   0
+#define RESTART_HDR_VERSION 1
+#define RESTART_HDR_N       2
+#define RESTART_HDR_FOCUSED 3 	/* focused window */
+#define RESTART_HDR_LEN     4
+
+#define RESTART_REC_WINDOW  0
+#define RESTART_REC_TYPE    1
+#define RESTART_REC_FLAGS   2
+#define RESTART_REC_TRANS   3	/* window, or None */
+#define RESTART_REC_FOCUS   4	/* next_focused_client window, or None */
+#define RESTART_REC_AGE     5	/* position in client_age_list */
+#define RESTART_REC_MAPPED  6	/* window left mapped on the root */
+#define RESTART_REC_LEN     7
+
+/* Set from the SIGUSR2 handler, checked by the event loop */
+extern volatile sig_atomic_t restart_requested;
+
+void
+restart_exec(Wm *w);
+
+Bool
+restart_restore(Wm *w);
+
+#endif
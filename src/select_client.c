@@ -67,15 +67,13 @@ select_client_new(Wm *w)
      MBThemeButton *button;
      MBThemeLayer  *layer;
 
-     frame = (MBThemeFrame*)list_find_by_id(w->mbtheme->frames, FRAME_MAIN );
-     frame_menu = (MBThemeFrame*)list_find_by_id(w->mbtheme->frames, FRAME_MENU );
+     frame = mbtheme_frame(w->mbtheme, FRAME_MAIN);
+     frame_menu = mbtheme_frame(w->mbtheme, FRAME_MENU);
 
      if (frame)
        {
-	 button = (MBThemeButton *)list_find_by_id(frame->buttons, 
-						   BUTTON_ACTION_MENU );
-	 layer = (MBThemeLayer*)list_find_by_id(frame->layers, 
-						LAYER_LABEL);
+	 button = mbtheme_frame_button(frame, BUTTON_ACTION_MENU);
+	 layer = mbtheme_frame_layer(frame, LAYER_LABEL);
 
 	 /* Also handle fixed X positions */
 	 if (frame_menu && frame_menu->fixed_x != -1)
@@ -96,6 +94,7 @@ select_client_new(Wm *w)
    }
 #endif
 
+   STATS_ROUND_TRIP();
    if (XGrabPointer(w->dpy, w->root, True,
 		    (ButtonPressMask|ButtonReleaseMask),
 		    GrabModeAsync,
@@ -103,6 +102,7 @@ select_client_new(Wm *w)
        != GrabSuccess)
       return NULL;
 
+   STATS_ROUND_TRIP();
    XGrabKeyboard(w->dpy, w->root, True, GrabModeAsync, 
 		 GrabModeAsync, CurrentTime);
    
@@ -122,6 +122,7 @@ select_client_new(Wm *w)
 
    c = base_client_new(w, win);
    c->type = MBCLIENT_TYPE_TASK_MENU;
+   stack_update_type(c);
    client_title_frame(c) = c->frame = c->window;
 
    comp_engine_client_init(w, c); 
@@ -20,7 +20,452 @@
 
 #include "session.h"
 
-#if USE_SM
+#if USE_SM || defined(SESSION_TEST_MAIN)
+
+#define SM_STATE_VERSION 1
+
+/* Strings are written as single words, anything that'd break that
+ * escaped as %XX. "-" is NULL.
+ */
+static void
+sm_state_write_str(FILE *fp, const char *str)
+{
+  if (str == NULL || *str == '\0')
+    {
+      fputs(" -", fp);
+      return;
+    }
+
+  fputc(' ', fp);
+
+  for (; *str; str++)
+    {
+      unsigned char ch = *str;
+
+      if (ch <= ' ' || ch == '%' || ch == '-' || ch == 0x7f)
+	fprintf(fp, "%%%02X", ch);
+      else
+	fputc(ch, fp);
+    }
+}
+
+static char*
+sm_state_read_str(char *word)
+{
+  char *str, *out;
+  int   ch;
+
+  if (word == NULL || !strcmp(word, "-"))
+    return NULL;
+
+  str = out = malloc(strlen(word) + 1);
+
+  while (*word)
+    {
+      if (*word == '%' && sscanf(word + 1, "%2x", &ch) == 1)
+	{
+	  *out++ = ch;
+	  word  += 3;
+	}
+      else
+	*out++ = *word++;
+    }
+
+  *out = '\0';
+
+  return str;
+}
+
+static Bool
+sm_str_equal(const char *a, const char *b)
+{
+  if (a && *a == '\0') a = NULL;
+  if (b && *b == '\0') b = NULL;
+
+  if (a == NULL || b == NULL)
+    return (a == b);
+
+  return !strcmp(a, b);
+}
+
+static void
+sm_entry_free_strings(MBSessionEntry *entry)
+{
+  if (entry->client_id) free(entry->client_id);
+  if (entry->res_name)  free(entry->res_name);
+  if (entry->res_class) free(entry->res_class);
+  if (entry->role)      free(entry->role);
+}
+
+void
+sm_entry_free(MBSessionEntry *entry)
+{
+  sm_entry_free_strings(entry);
+  free(entry);
+}
+
+/* Written to a new file and moved over, so a crash half way through
+ * cant leave a truncated session behind. */
+Bool
+sm_state_save(const char *path, MBList *entries)
+{
+  MBList         *item;
+  MBSessionEntry *e;
+  FILE           *fp;
+  char           *tmp_path;
+  Bool            result = False;
+
+  tmp_path = malloc(strlen(path) + 5);
+  sprintf(tmp_path, "%s.new", path);
+
+  if ((fp = fopen(tmp_path, "w")) != NULL)
+    {
+      fprintf(fp, "# matchbox session %i\n", SM_STATE_VERSION);
+
+      list_enumerate(entries, item)
+	{
+	  e = (MBSessionEntry *)item->data;
+
+	  fprintf(fp, "%i %i %li %i %i", 
+		  e->stack_pos, e->type, e->flags, e->x, e->y);
+	  sm_state_write_str(fp, e->client_id);
+	  sm_state_write_str(fp, e->res_name);
+	  sm_state_write_str(fp, e->res_class);
+	  sm_state_write_str(fp, e->role);
+	  fputc('\n', fp);
+	}
+
+      if (fclose(fp) == 0 && rename(tmp_path, path) == 0)
+	result = True;
+      else
+	unlink(tmp_path);
+    }
+
+  free(tmp_path);
+
+  return result;
+}
+
+MBList*
+sm_state_load(const char *path)
+{
+  MBList         *entries = NULL;
+  MBSessionEntry *e;
+  FILE           *fp;
+  char            line[2048], *words[4], *cur;
+  int             version, consumed, i;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return NULL;
+
+  if (fgets(line, sizeof(line), fp) == NULL
+      || sscanf(line, "# matchbox session %i", &version) != 1
+      || version != SM_STATE_VERSION)
+    {
+      dbg("%s() %s isnt a session we know\n", __func__, path);
+      fclose(fp);
+      return NULL;
+    }
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      e = malloc(sizeof(MBSessionEntry));
+      memset(e, 0, sizeof(MBSessionEntry));
+
+      consumed = 0;
+
+      if (sscanf(line, "%i %i %li %i %i %n", &e->stack_pos, &e->type, 
+		 &e->flags, &e->x, &e->y, &consumed) < 5 || !consumed)
+	{
+	  free(e);
+	  continue;
+	}
+
+      cur = line + consumed;
+
+      for (i = 0; i < 4; i++)
+	{
+	  while (*cur == ' ') cur++;
+	  words[i] = cur;
+	  while (*cur && *cur != ' ' && *cur != '\n') cur++;
+	  if (*cur) *cur++ = '\0';
+	}
+
+      e->client_id = sm_state_read_str(words[0]);
+      e->res_name  = sm_state_read_str(words[1]);
+      e->res_class = sm_state_read_str(words[2]);
+      e->role      = sm_state_read_str(words[3]);
+      e->flags    &= SM_SAVED_FLAGS;
+
+      list_add(&entries, NULL, 0, e);
+    }
+
+  fclose(fp);
+
+  return entries;
+}
+
+/* Finds, and takes off the list, the first entry saved for a client
+ * with the same id, class and role. Clients without an SM id only
+ * match entries without one. The caller frees it.
+ */
+MBSessionEntry*
+sm_state_match(MBList     **entries,
+	       const char  *client_id,
+	       const char  *res_name,
+	       const char  *res_class,
+	       const char  *role)
+{
+  MBList         *item;
+  MBSessionEntry *e;
+
+  list_enumerate(*entries, item)
+    {
+      e = (MBSessionEntry *)item->data;
+
+      if (sm_str_equal(e->client_id, client_id)
+	  && sm_str_equal(e->res_name, res_name)
+	  && sm_str_equal(e->res_class, res_class)
+	  && sm_str_equal(e->role, role))
+	{
+	  list_remove(entries, e);
+	  return e;
+	}
+    }
+
+  return NULL;
+}
+
+/* A restored app mapped in under the top app, move it on down to just
+ * under whatever was saved above it. Returns True if it moved, the
+ * caller syncs the stack to the display. */
+Bool
+sm_client_restack(Wm *w, Client *c)
+{
+  Client *p = NULL, *above = NULL;
+
+  if (c->type != MBCLIENT_TYPE_APP || !c->sm_stack_pos)
+    return False;
+
+  stack_enumerate_type(w, p, MBCLIENT_TYPE_APP)
+    if (p != c && p->mapped && p->sm_stack_pos > c->sm_stack_pos
+	&& (above == NULL || p->sm_stack_pos < above->sm_stack_pos))
+      above = p;
+
+  if (above == NULL || c->above == above)
+    return False;
+
+  stack_move_above_client(c, above->below); /* NULL being the bottom */
+
+  return True;
+}
+
+#endif
+
+/* The test only needs the state and stack bits above */
+#if USE_SM && !defined(SESSION_TEST_MAIN)
+
+static char*
+sm_state_path(const char *client_id)
+{
+  char *home = getenv("HOME"), *path;
+
+  if (home == NULL || client_id == NULL)
+    return NULL;
+
+  path = malloc(strlen(home) + strlen(client_id) + 32);
+
+  sprintf(path, "%s/.matchbox", home);
+  mkdir(path, 0755); 		/* fine if its there already */
+
+  sprintf(path, "%s/.matchbox/session-%s", home, client_id);
+
+  return path;
+}
+
+static char*
+sm_get_string_prop(Wm *w, Window win, Atom atom)
+{
+  Atom           type;
+  int            format;
+  unsigned long  n_items, bytes_after;
+  unsigned char *data = NULL;
+  char          *result = NULL;
+
+  if (stats_xget_window_property(w->dpy, win, atom, 0L, 512L, False, XA_STRING,
+				 &type, &format, &n_items, &bytes_after, 
+				 &data) == Success
+      && data && n_items && format == 8)
+    result = strdup((char *)data);
+
+  if (data) XFree(data);
+
+  return result;
+}
+
+/* Fills in what a client is matched up again by */
+static void
+sm_client_get_ids(Wm *w, Client *c, MBSessionEntry *ids)
+{
+  Atom           type;
+  int            format;
+  unsigned long  n_items, bytes_after;
+  unsigned char *data = NULL;
+  Window         leader = c->window;
+  XClassHint     class_hint;
+
+  misc_trap_xerrors();
+
+  if (stats_xget_window_property(w->dpy, c->window, w->atoms[WM_CLIENT_LEADER],
+				 0L, 1L, False, XA_WINDOW, &type, &format,
+				 &n_items, &bytes_after, &data) == Success
+      && data && n_items && format == 32)
+    leader = *(Window *)data;
+
+  if (data) XFree(data);
+
+  ids->client_id = sm_get_string_prop(w, leader, w->atoms[SM_CLIENT_ID]);
+  ids->role = sm_get_string_prop(w, c->window, w->atoms[WM_WINDOW_ROLE]);
+
+  STATS_ROUND_TRIP();
+  if (XGetClassHint(w->dpy, c->window, &class_hint))
+    {
+      if (class_hint.res_name)
+	{
+	  ids->res_name = strdup(class_hint.res_name);
+	  XFree(class_hint.res_name);
+	}
+      if (class_hint.res_class)
+	{
+	  ids->res_class = strdup(class_hint.res_class);
+	  XFree(class_hint.res_class);
+	}
+    }
+
+  misc_untrap_xerrors();
+}
+
+/* Apps and dialogs, bottom to top */
+static void
+sm_state_save_clients(Wm *w)
+{
+  MBList         *entries = NULL, *item;
+  MBSessionEntry *e;
+  Client         *c;
+  char           *path;
+  int             pos = 0;
+
+  if ((path = sm_state_path(w->sm_client_id)) == NULL)
+    return;
+
+  stack_enumerate(w, c)
+    {
+      if (!(c->type & (MBCLIENT_TYPE_APP|MBCLIENT_TYPE_DIALOG)))
+	continue;
+
+      e = malloc(sizeof(MBSessionEntry));
+      memset(e, 0, sizeof(MBSessionEntry));
+
+      sm_client_get_ids(w, c, e);
+
+      if (!e->client_id && !e->res_class && !e->role)
+	{
+	  /* Nothing to know it by again */
+	  sm_entry_free(e);
+	  continue;
+	}
+
+      e->type      = c->type;
+      e->flags     = c->flags & SM_SAVED_FLAGS;
+      e->x         = c->x;
+      e->y         = c->y;
+      e->stack_pos = ++pos;
+
+      list_add(&entries, NULL, 0, e);
+    }
+
+  dbg("%s() saving %i clients to %s\n", __func__, pos, path);
+
+  if (!sm_state_save(path, entries))
+    fprintf(stderr, "matchbox-window-manager: failed to save session to %s\n",
+	    path);
+
+  list_enumerate(entries, item)
+    sm_entry_free((MBSessionEntry *)item->data);
+
+  list_destroy(&entries);
+  free(path);
+}
+
+static void
+sm_state_expire(Wm *w, void *data)
+{
+  MBList *item;
+
+  dbg("%s() dropping saved clients that never came back\n", __func__);
+
+  list_enumerate(w->sm_entries, item)
+    sm_entry_free((MBSessionEntry *)item->data);
+
+  list_destroy(&w->sm_entries);
+}
+
+/* Called as a new client is managed, before its first configure, so
+ * what's restored is there for its first layout rather than relaying it
+ * out after. Does nothing, not even ask for its ids, once every saved
+ * client's been seen to.
+ */
+void
+sm_client_restore(Wm *w, Client *c)
+{
+  MBSessionEntry  ids, *e;
+  Client         *p = NULL;
+
+  if (w->sm_entries == NULL 
+      || !(c->type & (MBCLIENT_TYPE_APP|MBCLIENT_TYPE_DIALOG)))
+    return;
+
+  memset(&ids, 0, sizeof(MBSessionEntry));
+
+  sm_client_get_ids(w, c, &ids);
+
+  e = sm_state_match(&w->sm_entries, ids.client_id, 
+		     ids.res_name, ids.res_class, ids.role);
+
+  sm_entry_free_strings(&ids);
+
+  if (e == NULL)
+    return;
+
+  if (e->type == c->type)
+    {
+      dbg("%s() restoring %s, saved at %i\n", __func__, 
+	  c->name, e->stack_pos);
+
+      c->flags = (c->flags & ~SM_SAVED_FLAGS) | e->flags;
+
+      if (c->type == MBCLIENT_TYPE_DIALOG)
+	{
+	  c->x = e->x;
+	  c->y = e->y;
+	}
+      else
+	{
+	  c->sm_stack_pos = e->stack_pos;
+
+	  /* Something saved above it is back already, so map in under
+	   * that rather than on top, see sm_client_restack() */
+	  stack_enumerate_type(w, p, MBCLIENT_TYPE_APP)
+	    if (p->sm_stack_pos > c->sm_stack_pos && p->mapped)
+	      {
+		c->flags |= CLIENT_NO_FOCUS_ON_MAP;
+		break;
+	      }
+	}
+    }
+
+  sm_entry_free(e);
+}
 
 /* mostly based on twm/metacity code */
 
@@ -32,12 +477,13 @@ sm_save_yourself_cb (SmcConn   smcConn,
 		     int       interactStyle,
 		     Bool      fast)
 {
-  /* Wm *w = (Wm *)clientData; */
-
-  /* XXX This needs much work */
+  Wm *w = (Wm *)clientData;
 
   SmProp      prop1, prop2, prop3, prop4, prop5, prop6, *props[6];
   SmPropValue prop1val, prop2val, prop3val, prop4val, prop5val, prop6val;
+  SmPropValue *restart_vals, discard_vals[3];
+  int          argc, i, n_restart_vals = 0, n_props;
+  char        *state_path;
 
   static int  first_time = 1;
 
@@ -108,20 +554,63 @@ sm_save_yourself_cb (SmcConn   smcConn,
       first_time = 0;
     }
 
-  /* Below is obviously wrong and needs work.
-   * Need to rebuild command line arguments
-  */
+  /* Started again as we were, with the id we've been given */
+
+  for (argc = 0; w->argv[argc] != NULL; argc++)
+    ;
+
+  restart_vals = malloc(sizeof(SmPropValue) * (argc + 2));
+
+  for (i = 0; i < argc; i++)
+    {
+      if (!strcmp(w->argv[i], "--sm-client-id"))
+	{
+	  i++;
+	  continue;
+	}
+      restart_vals[n_restart_vals].value  = w->argv[i];
+      restart_vals[n_restart_vals].length = strlen(w->argv[i]);
+      n_restart_vals++;
+    }
+
+  restart_vals[n_restart_vals].value  = "--sm-client-id";
+  restart_vals[n_restart_vals].length = strlen("--sm-client-id");
+  n_restart_vals++;
+  restart_vals[n_restart_vals].value  = w->sm_client_id;
+  restart_vals[n_restart_vals].length = strlen(w->sm_client_id);
+  n_restart_vals++;
 
   prop1.name     = SmRestartCommand;
   prop1.type     = SmLISTofARRAY8;
-  prop1.vals     = &prop1val;
-  prop1.num_vals = 1;
-  prop1val.value = (SmPointer) "matchbox-window-manager" ;
-  prop1val.length = strlen ("matchbox-window-manager");
+  prop1.vals     = restart_vals;
+  prop1.num_vals = n_restart_vals;
 
   props[0] = &prop1;
+  n_props  = 1;
 
-  SmcSetProperties (smcConn, 1, props);
+  /* Where the apps were, and the discard command to get rid of it */
+  sm_state_save_clients(w);
+
+  if ((state_path = sm_state_path(w->sm_client_id)) != NULL)
+    {
+      prop2.name     = SmDiscardCommand;
+      prop2.type     = SmLISTofARRAY8;
+      prop2.vals     = discard_vals;
+      prop2.num_vals = 3;
+      discard_vals[0].value  = "rm";
+      discard_vals[0].length = 2;
+      discard_vals[1].value  = "-f";
+      discard_vals[1].length = 2;
+      discard_vals[2].value  = state_path;
+      discard_vals[2].length = strlen(state_path);
+
+      props[n_props++] = &prop2;
+    }
+
+  SmcSetProperties (smcConn, n_props, props);
+
+  free(restart_vals);
+  if (state_path) free(state_path);
 
   SmcSaveYourselfDone (smcConn, True);
 }
@@ -215,9 +704,221 @@ sm_connect(Wm *w)
 
     w->sm_ice_fd = IceConnectionNumber (w->ice_conn);
 
+    w->sm_client_id = mb_client_id;
+
     dbg("connected to session manager\n");
 
+    /* Resuming a session, pick up where the clients were */
+    if (w->config->sm_client_id != NULL)
+      {
+	char *path = sm_state_path(w->config->sm_client_id);
+
+	if (path && (w->sm_entries = sm_state_load(path)) != NULL)
+	  timer_add(w, SM_RESTORE_TIMEOUT, sm_state_expire, NULL);
+
+	if (path) free(path);
+      }
+
     return True;
 }
 
 #endif
+
+#ifdef SESSION_TEST_MAIN
+
+/* Test bits for the session state, built by 'make session-test'. Stands
+ * in for the session manager side, saving a session, then has the
+ * clients come back in a random order and checks each finds its own
+ * entry, and that sm_client_restack() puts the stack back as saved.
+ */
+
+#define TEST_N_CLIENTS 60
+
+/* Stand ins for the bits of the wm stack.c pulls in */
+
+void
+client_get_transient_list(Wm *w, MBList **list, Client *c)
+{
+}
+
+void
+misc_trap_xerrors(void)
+{
+}
+
+int
+misc_untrap_xerrors(void)
+{
+  return 0;
+}
+
+static char*
+test_str(const char *fmt, int i)
+{
+  char buf[128];
+
+  sprintf(buf, fmt, i);
+  return strdup(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+  Wm             *w;
+  Client         *c, *p;
+  MBList         *saved = NULL, *entries, *item;
+  MBSessionEntry *e, *back[TEST_N_CLIENTS];
+  char            path[256];
+  int             order[TEST_N_CLIENTS];
+  int             i, j, k, n_apps = 0;
+
+  srand(1);
+
+  w = malloc(sizeof(Wm));
+  memset(w, 0, sizeof(Wm));
+
+  sprintf(path, "%s/matchbox-session-test.%i", 
+	  getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", (int)getpid());
+
+  /* Some with ids, some only told apart by role, and a few identical
+   * ones that can only come back in the order they're seen. */
+  for (i = 0; i < TEST_N_CLIENTS; i++)
+    {
+      e = malloc(sizeof(MBSessionEntry));
+      memset(e, 0, sizeof(MBSessionEntry));
+
+      if (i % 3 == 0)
+	e->client_id = test_str("10a5e%i-%%odd id-", i);
+
+      e->res_name  = strdup("app");
+      e->res_class = test_str("App Class %i", i % 7);
+
+      if (i % 4 != 3)
+	e->role = test_str("role-%i", i);
+
+      e->type      = (i % 5) ? MBCLIENT_TYPE_APP : MBCLIENT_TYPE_DIALOG;
+      e->flags     = (i % 2) ? CLIENT_FULLSCREEN_FLAG : 0;
+      e->x         = i * 3;
+      e->y         = -i;
+      e->stack_pos = i + 1;
+
+      list_add(&saved, NULL, 0, e);
+    }
+
+  if (!sm_state_save(path, saved) || (entries = sm_state_load(path)) == NULL)
+    {
+      printf("session-test: failed to save and load %s\n", path);
+      return 1;
+    }
+
+  unlink(path);
+
+  for (i = 0; i < TEST_N_CLIENTS; i++)
+    order[i] = i;
+
+  for (i = TEST_N_CLIENTS - 1; i > 0; i--)
+    {
+      j = rand() % (i + 1);
+      k = order[i]; order[i] = order[j]; order[j] = k;
+    }
+
+  for (i = 0; i < TEST_N_CLIENTS; i++)
+    back[i] = NULL;
+
+  /* Clients come back, in whatever order */
+  for (i = 0; i < TEST_N_CLIENTS; i++)
+    {
+      list_enumerate(saved, item)
+	if (((MBSessionEntry *)item->data)->stack_pos == order[i] + 1)
+	  break;
+
+      e = (MBSessionEntry *)item->data;
+
+      back[order[i]] = sm_state_match(&entries, e->client_id, e->res_name,
+				      e->res_class, e->role);
+
+      if (back[order[i]] == NULL)
+	{
+	  printf("session-test: client %i not matched\n", order[i]);
+	  return 1;
+	}
+
+      /* Identical ones get each other's entries, fine as long as they
+       * all get one, anything else should be its own. */
+      if (e->client_id || e->role)
+	{
+	  if (back[order[i]]->stack_pos != e->stack_pos
+	      || back[order[i]]->type != e->type
+	      || back[order[i]]->flags != e->flags
+	      || back[order[i]]->x != e->x || back[order[i]]->y != e->y
+	      || !sm_str_equal(back[order[i]]->client_id, e->client_id))
+	    {
+	      printf("session-test: client %i got the wrong entry\n", 
+		     order[i]);
+	      return 1;
+	    }
+	}
+
+      /* Maps in on top, then is moved down under what was saved above */
+      c = malloc(sizeof(Client));
+      memset(c, 0, sizeof(Client));
+
+      c->wm           = w;
+      c->type         = back[order[i]]->type;
+      c->mapped       = True;
+      c->sm_stack_pos = back[order[i]]->stack_pos;
+
+      stack_add_above_client(c, w->stack_top);
+      sm_client_restack(w, c);
+
+      if (c->type == MBCLIENT_TYPE_APP)
+	n_apps++;
+    }
+
+  if (entries != NULL)
+    {
+      printf("session-test: entries left over\n");
+      return 1;
+    }
+
+  k = 0;
+
+  stack_enumerate_type(w, p, MBCLIENT_TYPE_APP)
+    {
+      if (p->sm_stack_pos <= k)
+	{
+	  printf("session-test: stack not put back in order\n");
+	  return 1;
+	}
+
+      k = p->sm_stack_pos;
+      n_apps--;
+    }
+
+  if (n_apps != 0)
+    {
+      printf("session-test: apps lost from the stack\n");
+      return 1;
+    }
+
+  /* Nothing there to match against anymore */
+  if (sm_state_match(&entries, NULL, "app", "App Class 0", NULL) != NULL)
+    {
+      printf("session-test: matched an empty session\n");
+      return 1;
+    }
+
+  for (i = 0; i < TEST_N_CLIENTS; i++)
+    sm_entry_free(back[i]);
+
+  list_enumerate(saved, item)
+    sm_entry_free((MBSessionEntry *)item->data);
+
+  list_destroy(&saved);
+
+  printf("session-test: ok, %i clients\n", TEST_N_CLIENTS);
+
+  return 0;
+}
+
+#endif
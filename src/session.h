@@ -25,6 +25,51 @@
 #include "wm.h"
 #include "config.h"
 
+#if USE_SM || defined(SESSION_TEST_MAIN)
+
+/* Saved state of a managed client, one line of the session file
+ * ( ~/.matchbox/session-<client id> ) written on save yourself. A client
+ * mapping later is matched to it by its leader's SM_CLIENT_ID, WM_CLASS
+ * and WM_WINDOW_ROLE, see sm_state_match(). 
+ */
+typedef struct MBSessionEntry
+{
+  char *client_id;		/* NULL if none */
+  char *res_name, *res_class;
+  char *role;			/* NULL if none */
+  int   type;
+  long  flags;			/* just SM_SAVED_FLAGS */
+  int   x, y;			/* dialogs only */
+  int   stack_pos;		/* 1 is the bottom */
+
+} MBSessionEntry;
+
+#define SM_SAVED_FLAGS (CLIENT_FULLSCREEN_FLAG|CLIENT_TITLE_HIDDEN_FLAG)
+
+/* Saved entries nothing's mapped for by then are dropped */
+#define SM_RESTORE_TIMEOUT 60000
+
+Bool
+sm_state_save(const char *path, MBList *entries);
+
+MBList*
+sm_state_load(const char *path);
+
+MBSessionEntry*
+sm_state_match(MBList     **entries,
+	       const char  *client_id,
+	       const char  *res_name,
+	       const char  *res_class,
+	       const char  *role);
+
+void
+sm_entry_free(MBSessionEntry *entry);
+
+Bool
+sm_client_restack(Wm *w, Client *c);
+
+#endif
+
 #if USE_SM
 
 #include <X11/SM/SMlib.h>
@@ -35,6 +80,9 @@ sm_process_event(Wm *w);
 Bool
 sm_connect(Wm *w);
 
+void
+sm_client_restore(Wm *w, Client *c);
+
 #endif /* USE_SM */
 
 #endif
@@ -0,0 +1,139 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "slab.h"
+#include "list.h"
+
+MBSlab slab_clients    = SLAB_INIT("client", Client, 8);
+MBSlab slab_buttons    = SLAB_INIT("button", MBClientButton, 32);
+MBSlab slab_list_items = SLAB_INIT("list_item", struct list_item, 128);
+
+#ifdef USE_COMPOSITE
+MBSlab slab_overrides  = SLAB_INIT("override", MBOverride, 32);
+#endif
+
+#ifdef DEBUG
+
+static void
+slab_rate_update(MBSlab *slab, int n_allocs, int n_frees)
+{
+  time_t now = time(NULL);
+
+  if (now != slab->rate_time)
+    {
+      if (slab->rate_allocs || slab->rate_frees)
+	dbg("%s() %s: %lu allocs/s %lu frees/s, %lu in use in %lu blocks\n",
+	    __func__, slab->name, slab->rate_allocs, slab->rate_frees,
+	    slab->n_in_use, slab->n_blocks);
+
+      slab->rate_time   = now;
+      slab->rate_allocs = 0;
+      slab->rate_frees  = 0;
+    }
+
+  slab->rate_allocs += n_allocs;
+  slab->rate_frees  += n_frees;
+}
+
+/* Everything past the freelist link should still be poison */
+static void
+slab_poison_check(MBSlab *slab, void *obj)
+{
+  unsigned char *p = (unsigned char *)obj + sizeof(void*);
+  size_t         i;
+
+  for (i = 0; i < slab->size - sizeof(void*); i++)
+    if (p[i] != SLAB_POISON)
+      {
+	fprintf(stderr, "matchbox: %s %p written to after free ( +%lu )\n",
+		slab->name, obj, (unsigned long)(i + sizeof(void*)));
+	return;
+      }
+}
+
+#endif
+
+static void
+slab_grow(MBSlab *slab)
+{
+  char *block, *obj;
+  int   i;
+
+  block = malloc(SLAB_ALIGN + (slab->size * slab->per_block));
+
+  if (block == NULL)
+    return;
+
+  *(void **)block = slab->blocks;
+  slab->blocks    = block;
+  slab->n_blocks++;
+
+  /* Pushed last to first, so they come out in address order */
+  for (i = slab->per_block - 1; i >= 0; i--)
+    {
+      obj = block + SLAB_ALIGN + (slab->size * i);
+#ifdef DEBUG
+      memset(obj, SLAB_POISON, slab->size);
+#endif
+      *(void **)obj   = slab->free_list;
+      slab->free_list = obj;
+    }
+}
+
+void*
+slab_alloc(MBSlab *slab)
+{
+  void *obj;
+
+  if (slab->free_list == NULL)
+    slab_grow(slab);
+
+  if ((obj = slab->free_list) == NULL)
+    return NULL;
+
+  slab->free_list = *(void **)obj;
+
+#ifdef DEBUG
+  slab_poison_check(slab, obj);
+  slab_rate_update(slab, 1, 0);
+#endif
+
+  memset(obj, 0, slab->size);
+
+  slab->n_in_use++;
+  slab->n_allocs++;
+
+  return obj;
+}
+
+void
+slab_free(MBSlab *slab, void *obj)
+{
+  if (obj == NULL)
+    return;
+
+#ifdef DEBUG
+  memset(obj, SLAB_POISON, slab->size);
+  slab_rate_update(slab, 0, 1);
+#endif
+
+  *(void **)obj   = slab->free_list;
+  slab->free_list = obj;
+
+  slab->n_in_use--;
+}
@@ -0,0 +1,73 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MB_SLAB_H_
+#define _MB_SLAB_H_
+
+#include "structs.h"
+
+/* Fixed size object pools, for the structs made and thrown away all the
+ * time - clients, override redirect popups, the decoration buttons,
+ * list nodes. Objects are carved out of blocks and go on a
+ * freelist when freed, blocks are never given back.
+ *
+ * DEBUG builds poison freed objects, complain if the poison's been
+ * written over when one is reused, and dbg() each pool's alloc rate
+ * every second it sees use. Counts are in matchbox-remote -stats.
+ */
+
+#define SLAB_ALIGN  16
+#define SLAB_POISON 0x6b
+
+typedef struct MBSlab
+{
+  const char    *name;
+  size_t         size;		/* rounded up to SLAB_ALIGN */
+  int            per_block;
+  void          *free_list;	/* chained through their first word */
+  void          *blocks;	/* likewise */
+  unsigned long  n_blocks;
+  unsigned long  n_in_use;
+  unsigned long  n_allocs;	/* since startup */
+
+#ifdef DEBUG
+  time_t         rate_time;
+  unsigned long  rate_allocs, rate_frees;
+#endif
+
+} MBSlab;
+
+#define SLAB_INIT(name, type, per_block)				\
+  { (name), (sizeof(type) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1), (per_block) }
+
+extern MBSlab slab_clients;
+extern MBSlab slab_buttons;
+extern MBSlab slab_list_items;
+
+#ifdef USE_COMPOSITE
+extern MBSlab slab_overrides;
+#endif
+
+/* Zeroed, like malloc then memset */
+void*
+slab_alloc(MBSlab *slab);
+
+void
+slab_free(MBSlab *slab, void *obj);
+
+#endif
@@ -20,6 +20,208 @@
 
 #include "stack.h"
 
+/* Alongside the stack each client type has its own list, threaded
+ * through type_above / type_below in the same order, so asking for
+ * the highest dialog or the next app doesn't mean walking past every
+ * panel and toolbar. stack_order labels ( bigger is
+ * higher ) let clients of different types be compared in place.
+ */
+
+#define STACK_ORDER_GAP 0x1000
+
+static int
+stack_type_valid(int type)
+{
+  return (type > 0 && type < (1<<STACK_N_TYPES) && !(type & (type - 1)));
+}
+
+static void
+stack_sync_ensure_size(Wm *w, int n)
+{
+  if (n <= w->stack_sync_size)
+    return;
+
+  w->stack_sync_size    = n + 16;
+  w->stack_sync_order   = realloc(w->stack_sync_order, 
+				  w->stack_sync_size * sizeof(Client*));
+  w->stack_sync_scratch = realloc(w->stack_sync_scratch, 
+				  3 * w->stack_sync_size * sizeof(int));
+}
+
+static void
+stack_order_relabel(Wm *w)
+{
+  Client        *c;
+  unsigned long  order = 0;
+
+  dbg("%s() called\n", __func__);
+
+  stack_enumerate(w, c)
+    c->stack_order = (order += STACK_ORDER_GAP);
+}
+
+/* Gives a just linked client a label between its neighbours */
+static void
+stack_order_label(Wm *w, Client *c)
+{
+  unsigned long lo = c->below ? c->below->stack_order : 0;
+  unsigned long hi = c->above ? c->above->stack_order : ULONG_MAX;
+
+  if (hi - lo < 2)
+    stack_order_relabel(w);
+  else if (c->above == NULL && hi - lo > STACK_ORDER_GAP)
+    c->stack_order = lo + STACK_ORDER_GAP;
+  else
+    c->stack_order = lo + (hi - lo) / 2;
+}
+
+static void
+stack_type_link(Client *c)
+{
+  Wm     *w = c->wm;
+  Client *t;
+  int     i;
+
+  if (!stack_type_valid(c->type))
+    return;
+
+  i = stack_type_index(c->type);
+
+  /* Most things go on top so look from there */
+  for (t = w->stack_type_top[i]; 
+       t != NULL && t->stack_order > c->stack_order; 
+       t = t->type_below)
+    ;
+
+  c->type_below = t;
+
+  if (t)
+    {
+      c->type_above = t->type_above;
+      t->type_above = c;
+    }
+  else
+    {
+      c->type_above = w->stack_type_bottom[i];
+      w->stack_type_bottom[i] = c;
+    }
+
+  if (c->type_above)
+    c->type_above->type_below = c;
+  else
+    w->stack_type_top[i] = c;
+
+  c->stack_type = c->type;
+}
+
+static void
+stack_type_unlink(Client *c)
+{
+  Wm *w = c->wm;
+  int i;
+
+  if (!c->stack_type)
+    return;
+
+  i = stack_type_index(c->stack_type);
+
+  if (c->type_above) 
+    c->type_above->type_below = c->type_below;
+  else
+    w->stack_type_top[i] = c->type_below;
+
+  if (c->type_below) 
+    c->type_below->type_above = c->type_above;
+  else
+    w->stack_type_bottom[i] = c->type_above;
+
+  c->type_above = c->type_below = NULL;
+  c->stack_type = 0;
+}
+
+/* Each client keeps its transients in a list of their own, ordered
+ * like the type lists, so they can be found without a stack walk.
+ */
+static void
+stack_trans_link(Client *c)
+{
+  Client *p = c->trans, *t;
+
+  if (p == NULL)
+    return;
+
+  for (t = p->trans_top; 
+       t != NULL && t->stack_order > c->stack_order; 
+       t = t->trans_below)
+    ;
+
+  c->trans_below = t;
+
+  if (t)
+    {
+      c->trans_above = t->trans_above;
+      t->trans_above = c;
+    }
+  else
+    {
+      c->trans_above = p->trans_bottom;
+      p->trans_bottom = c;
+    }
+
+  if (c->trans_above)
+    c->trans_above->trans_below = c;
+  else
+    p->trans_top = c;
+
+  c->stack_trans = p;
+}
+
+static void
+stack_trans_unlink(Client *c)
+{
+  Client *p = c->stack_trans;
+
+  if (p == NULL)
+    return;
+
+  if (c->trans_above) 
+    c->trans_above->trans_below = c->trans_below;
+  else
+    p->trans_top = c->trans_below;
+
+  if (c->trans_below) 
+    c->trans_below->trans_above = c->trans_above;
+  else
+    p->trans_bottom = c->trans_above;
+
+  c->trans_above = c->trans_below = NULL;
+  c->stack_trans = NULL;
+}
+
+/* Call whenever c->trans is changed */
+void
+stack_update_trans(Client *c)
+{
+  if (c->stack_trans == c->trans)
+    return;
+
+  stack_trans_unlink(c);
+  stack_trans_link(c);
+}
+
+/* Clients are stacked by base_client_new() before they know what
+ * they are, constructors call this once c->type is set.
+ */
+void
+stack_update_type(Client *c)
+{
+  if (c->stack_type == c->type)
+    return;
+
+  stack_type_unlink(c);
+  stack_type_link(c);
+}
+
 void
 stack_add_above_client(Client *client, Client *client_below)
 {
@@ -50,6 +252,10 @@ stack_add_above_client(Client *client, Client *client_below)
     w->stack_top = client;
 
   w->stack_n_items++;
+
+  stack_order_label(w, client);
+  stack_type_link(client);
+  stack_trans_link(client);
 }
 
 
@@ -72,6 +278,9 @@ stack_remove(Client *client)
 {
   Wm *w = client->wm;
 
+  stack_type_unlink(client);
+  stack_trans_unlink(client);
+
   if (w->stack_top == w->stack_bottom)
     {
       w->stack_top = w->stack_bottom = NULL;
@@ -98,12 +307,18 @@ stack_move_client_above_type(Client *client, int type_below)
 {
   Wm     *w = client->wm;
   Client *highest_client = NULL, *c = NULL;
-
-  stack_enumerate(w,c)
-    {
-      if ((c->type & type_below) && c->mapped)
-	highest_client = c;
-    }
+  int     i;
+
+  for (i = 0; i < STACK_N_TYPES; i++)
+    if (type_below & (1<<i))
+      for (c = w->stack_type_top[i]; c != NULL; c = c->type_below)
+	if (c->mapped)
+	  {
+	    if (highest_client == NULL 
+		|| c->stack_order > highest_client->stack_order)
+	      highest_client = c;
+	    break;
+	  }
 
   if (highest_client)
     stack_move_above_client(client, highest_client);
@@ -118,14 +333,40 @@ stack_move_above_client(Client *client, Client *client_below)
   stack_add_above_client(client, client_below);
 }
 
-void
-stack_get_type_list(Wm *w, MBList **list, MBClientTypeEnum  wanted_type)
+/* Fills the sync scratch with the mapped clients of the wanted types,
+ * bottom to top, merging the type lists. Returns how many.
+ */
+static int
+stack_get_type_list(Wm *w, int wanted_type)
 {
-  Client *p = NULL;
+  Client *cur[STACK_N_TYPES], *c;
+  int     i, n = 0;
 
-  stack_enumerate(w,p)
-    if (p->type & wanted_type)
-      list_add(list, NULL, 0, p);
+  stack_sync_ensure_size(w, w->stack_n_items);
+
+  for (i = 0; i < STACK_N_TYPES; i++)
+    cur[i] = (wanted_type & (1<<i)) ? w->stack_type_bottom[i] : NULL;
+
+  for (;;)
+    {
+      int lowest = -1;
+
+      for (i = 0; i < STACK_N_TYPES; i++)
+	if (cur[i] && (lowest < 0 
+		       || cur[i]->stack_order < cur[lowest]->stack_order))
+	  lowest = i;
+
+      if (lowest < 0)
+	break;
+
+      c = cur[lowest];
+      cur[lowest] = c->type_above;
+
+      if (c->mapped)
+	w->stack_sync_order[n++] = c;
+    }
+
+  return n;
 }
 
 void
@@ -133,19 +374,12 @@ stack_move_type_above_client(Wm               *w,
 			     MBClientTypeEnum  wanted_type, 
 			     Client           *client)
 {
-  MBList *list = NULL, *list_item = NULL;
+  int i, n;
 
-  stack_get_type_list(w, &list, wanted_type);
-
-  list_enumerate(list, list_item)
-    {
-      Client *cur = (Client *)list_item->data;
-      if (cur->mapped) 
-	stack_move_above_client(cur, client);
-    }
+  n = stack_get_type_list(w, wanted_type);
 
-  list_destroy(&list);
-  
+  for (i = 0; i < n; i++)
+    stack_move_above_client(w->stack_sync_order[i], client);
 }
 
 
@@ -244,46 +478,67 @@ stack_get_highest(Wm *w, MBClientTypeEnum wanted_type)
 {
   Client *c = NULL;
 
-  stack_enumerate_reverse(w,c)
-    if (c->type == wanted_type && c->mapped)
+  if (!stack_type_valid(wanted_type))
+    return NULL;
+
+  for (c = w->stack_type_top[stack_type_index(wanted_type)]; 
+       c != NULL; 
+       c = c->type_below)
+    if (c->mapped)
       return c;
 
   return NULL;
 }
 
-
-
 Client*
 stack_get_lowest(Wm *w, MBClientTypeEnum wanted_type)
 {
   Client *c = NULL;
 
-  stack_enumerate(w,c)
-    if (c->type == wanted_type && c->mapped)
+  if (!stack_type_valid(wanted_type))
+    return NULL;
+
+  for (c = w->stack_type_bottom[stack_type_index(wanted_type)]; 
+       c != NULL; 
+       c = c->type_above)
+    if (c->mapped)
       return c;
 
   return NULL;
 }
 
+/* Next mapped client of wanted_type above, wrapping round to the
+ * bottom. Returns client_below if there are no others.
+ */
 Client*
 stack_get_above(Client* client_below, MBClientTypeEnum wanted_type)
 {
   Wm     *w = client_below->wm;
-  Client *c = client_below->above;
+  Client *c, *start;
 
   if (wanted_type == MBCLIENT_TYPE_ANY)
     return (client_below->above) ? client_below->above : w->stack_bottom; 
 
-  while ( c != client_below )
-    {
-      if (c == NULL)
-	c = w->stack_bottom;
+  if (!stack_type_valid(wanted_type))
+    return client_below;
 
-      if (c->type == wanted_type && c->mapped)
-	return c;
+  if (client_below->stack_type == wanted_type)
+    start = client_below->type_above;
+  else
+    for (start = w->stack_type_bottom[stack_type_index(wanted_type)];
+	 start != NULL && start->stack_order < client_below->stack_order;
+	 start = start->type_above)
+      ;
 
-      c = c->above;
-    }
+  for (c = start; c != NULL; c = c->type_above)
+    if (c->mapped)
+      return c;
+
+  for (c = w->stack_type_bottom[stack_type_index(wanted_type)]; 
+       c != start && c != client_below; 
+       c = c->type_above)
+    if (c->mapped)
+      return c;
 
   return client_below;
 }
@@ -294,18 +549,28 @@ stack_get_below(Client*          client_above,
 		MBClientTypeEnum wanted_type)
 {
   Wm     *w = client_above->wm;
-  Client *c = client_above->below;
+  Client *c, *start;
 
-  while ( c != client_above )
-    {
-      if (c == NULL)
-	c = w->stack_top;
+  if (!stack_type_valid(wanted_type))
+    return client_above;
 
-      if (c->type == wanted_type && c->mapped)
-	return c;
+  if (client_above->stack_type == wanted_type)
+    start = client_above->type_below;
+  else
+    for (start = w->stack_type_top[stack_type_index(wanted_type)];
+	 start != NULL && start->stack_order > client_above->stack_order;
+	 start = start->type_below)
+      ;
 
-      c = c->below;
-    }
+  for (c = start; c != NULL; c = c->type_below)
+    if (c->mapped)
+      return c;
+
+  for (c = w->stack_type_top[stack_type_index(wanted_type)]; 
+       c != start && c != client_above; 
+       c = c->type_below)
+    if (c->mapped)
+      return c;
 
   return client_above;
 }
@@ -337,35 +602,132 @@ stack_dump(Wm *w)
 #endif
 }
 
+#define STACK_SYNC_NEW  -1 	/* not synced before, must be placed */
+#define STACK_SYNC_KEEP -2 	/* relative order unchanged, left be */
+
+/* Restacks the frames ( and modal blockers ) to match the stack.
+ *
+ * Rather than restacking everything, the longest run of clients still
+ * in the same relative order as the last sync is left alone and only
+ * the rest are moved, each directly below the one above it. Raising
+ * one app in a big stack is then a single XConfigureWindow().
+ */
 void
 stack_sync_to_display(Wm *w)
 {
-  /*
+  MBTraceTime     trace_start = trace_now();
+  unsigned long   serial;
+  Client         *c, **order;
+  XWindowChanges  wc;
+  int            *pos, *tails, *prev;
+  int             n = 0, i, len = 0, lo, hi, mid, first_kept = 0, moves = 0;
+
+  if (!w->stack_n_items)
+    return;
+
+  stack_sync_ensure_size(w, w->stack_n_items);
+
+  order = w->stack_sync_order;
+  pos   = w->stack_sync_scratch;
+  tails = pos   + w->stack_sync_size;
+  prev  = tails + w->stack_sync_size;
+
+  serial = w->stack_sync_serial;
+
+  /* Top to bottom, with where each was last time */
+  stack_enumerate_reverse(w, c)
+    {
+      order[n] = c;
 
-    int XRestackWindows(Display *display, Window windows[], int nwindows);
+      if (serial && c->stack_sync_serial == serial
+	  && c->stack_sync_frame   == c->frame
+	  && c->stack_sync_blocker == c->win_modal_blocker)
+	pos[n] = c->stack_sync_pos;
+      else
+	pos[n] = STACK_SYNC_NEW;
 
-    The XRestackWindows function restacks the windows in the order speci-
-    fied, from top to bottom.  The stacking order of the first window in
-    the windows array is unaffected, but the other windows in the array are
-    stacked underneath the first window, in the order of the array.  The
-    stacking order of the other windows is not affected.  For each window
-    in the window array that is not a child of the specified window, a Bad-
-    Match error results.
+      n++;
+    }
 
+  /* Longest increasing run of old positions, n log n patience sort */
+  for (i = 0; i < n; i++)
+    {
+      prev[i] = -1;
 
-  */
+      if (pos[i] == STACK_SYNC_NEW)
+	continue;
+
+      lo = 0; hi = len;
+      while (lo < hi)
+	{
+	  mid = (lo + hi) / 2;
+	  if (pos[tails[mid]] < pos[i])
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+
+      prev[i]   = lo ? tails[lo-1] : -1;
+      tails[lo] = i;
+
+      if (lo == len) len++;
+    }
 
-  Window *win_list = stack_get_window_list(w);
-  
-  if (win_list)
+  for (i = len ? tails[len-1] : -1; i >= 0; i = prev[i])
     {
-      misc_trap_xerrors();
-      XRestackWindows(w->dpy, win_list, 
-		      w->stack_n_items + w->n_modal_blocker_wins);
-      free(win_list);
-      misc_untrap_xerrors();
+      pos[i]     = STACK_SYNC_KEEP;
+      first_kept = i;
     }
 
+  /* Nothing to go by, like XRestackWindows() leave the top be */
+  if (len == 0)
+    pos[0] = STACK_SYNC_KEEP;
+
+  w->stack_sync_serial = ++serial;
+
+  misc_trap_xerrors();
+
+  for (i = 0; i < n; i++)
+    {
+      c = order[i];
+
+      if (pos[i] != STACK_SYNC_KEEP)
+	{
+	  if (i == 0)
+	    {
+	      wc.sibling    = order[first_kept]->frame;
+	      wc.stack_mode = Above;
+	    }
+	  else
+	    {
+	      wc.sibling    = order[i-1]->win_modal_blocker ? 
+		order[i-1]->win_modal_blocker : order[i-1]->frame;
+	      wc.stack_mode = Below;
+	    }
+
+	  XConfigureWindow(w->dpy, c->frame, CWSibling|CWStackMode, &wc);
+	  moves++;
+
+	  if (c->win_modal_blocker)
+	    {
+	      wc.sibling    = c->frame;
+	      wc.stack_mode = Below;
+	      XConfigureWindow(w->dpy, c->win_modal_blocker, 
+			       CWSibling|CWStackMode, &wc);
+	    }
+	}
+
+      c->stack_sync_pos     = i;
+      c->stack_sync_serial  = serial;
+      c->stack_sync_frame   = c->frame;
+      c->stack_sync_blocker = c->win_modal_blocker;
+    }
+
+  misc_untrap_xerrors();
+
+  dbg("%s() %i of %i clients moved\n", __func__, moves, n);
+
+  trace_record("stack_sync_to_display", trace_start, moves);
 }
 
 #if STACK_STUFF_DEPRECIATED
@@ -530,77 +892,279 @@ stack_move_above_extended(Client *client,
 #endif
 
 
-#if 0
+#ifdef STACK_TEST_MAIN
+
+/* Test bits for stack, built by 'make stack-test'. Checks the type
+ * lists against plain walks of the stack over random restacking, then
+ * times the queries.
+ */
+
+#define TEST_N_CLIENTS 200
+#define TEST_N_OPS     200000
+
+static int test_types[] = { 
+  MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP, 
+  MBCLIENT_TYPE_DIALOG, MBCLIENT_TYPE_TOOLBAR, MBCLIENT_TYPE_PANEL, 
+  MBCLIENT_TYPE_TASK_MENU, MBCLIENT_TYPE_DESKTOP
+};
+
+#define TEST_N_TYPES (sizeof(test_types)/sizeof(int))
+
+/* Stand ins for the bits of the wm stack.c pulls in */
+
+void
+client_get_transient_list(Wm *w, MBList **list, Client *c)
+{
+  Client *p = NULL;
+
+  stack_enumerate(w,p)
+    if (p != c && p->type == MBCLIENT_TYPE_DIALOG && p->trans == c)
+      list_add(list, NULL, 0, p);
+}
 
-/* Test bits for stack  */
+void
+misc_trap_xerrors(void)
+{
+}
 
 int
-main(int argc, char **argv)
+misc_untrap_xerrors(void)
 {
-  Wm *w;
-  int i = 0; 
-  Client *c, *midc, *midc2; 
+  return 0;
+}
 
+static Client*
+test_highest(Wm *w, int type)
+{
+  Client *c = NULL;
 
-  w = malloc(sizeof(Wm));
-  memset(w, 0, sizeof(Wm));
+  stack_enumerate_reverse(w,c)
+    if (c->type == type && c->mapped)
+      return c;
 
-  for (i=0; i<10; i++)
-    {
-      char    buf[64];
+  return NULL;
+}
 
-      sprintf(buf, "Client-%i", i);
-      
-      c = client_new(w, buf);
+static Client*
+test_above(Client *client_below, int type)
+{
+  Wm     *w = client_below->wm;
+  Client *c = client_below->above;
 
-      stack_append_top(c);
+  while ( c != client_below )
+    {
+      if (c == NULL)
+	c = w->stack_bottom;
+
+      if (c->type == type && c->mapped)
+	return c;
 
-      if (i == 5) midc = c;
-      if (i == 6) midc2 = c;
+      c = c->above;
     }
 
-  printf("w->stack_top : %s, next %p   w->stack_bottom : %s, prev %p\n", 
-	 w->stack_top->name, w->stack_top->above, 
-	 w->stack_bottom->name, w->stack_bottom->below);
+  return client_below;
+}
+
+static Client*
+test_below(Client *client_above, int type)
+{
+  Wm     *w = client_above->wm;
+  Client *c = client_above->below;
+
+  while ( c != client_above )
+    {
+      if (c == NULL)
+	c = w->stack_top;
 
+      if (c->type == type && c->mapped)
+	return c;
 
-  stack_move_below_client(w->stack_top, w->stack_bottom);
-  stack_move_above_client(w->stack_bottom, w->stack_top);
+      c = c->below;
+    }
 
-  printf("w->stack_top : %s, next %p   w->stack_bottom : %s, prev %p\n", 
-	 w->stack_top->name, w->stack_top->above, 
-	 w->stack_bottom->name, w->stack_bottom->below);
+  return client_above;
+}
 
+static int
+test_check(Wm *w)
+{
+  Client        *c, *t, *p;
+  unsigned long  order = 0;
+  int            i, n = 0;
 
   stack_enumerate(w,c)
     {
-      printf("%s\n", c->name);
+      if (c->stack_order <= order || c->stack_type != c->type)
+	return 0;
+      order = c->stack_order;
+      n++;
     }
 
-  printf("\n");
+  if (n != w->stack_n_items)
+    return 0;
 
-  printf("\n");
+  /* as should each clients transient list by trans */
+  stack_enumerate(w,t)
+    {
+      c = t->trans_bottom;
 
-  stack_remove(w->stack_top);
+      stack_enumerate(w,p)
+	if (p->trans == t)
+	  {
+	    if (c != p || p->stack_trans != t) return 0;
+	    c = c->trans_above;
+	  }
 
-  stack_remove(w->stack_bottom);
+      if (c != NULL)
+	return 0;
+    }
 
-  stack_enumerate(w,c)
+  for (i = 0; i < TEST_N_TYPES; i++)
+    {
+      /* type list should be the stack filtered by type */
+      t = w->stack_type_bottom[stack_type_index(test_types[i])];
+
+      stack_enumerate(w,c)
+	if (c->type == test_types[i])
+	  {
+	    if (t != c) return 0;
+	    t = t->type_above;
+	  }
+
+      if (t != NULL)
+	return 0;
+
+      if (stack_get_highest(w, test_types[i]) 
+	  != test_highest(w, test_types[i]))
+	return 0;
+
+      stack_enumerate(w,c)
+	if (stack_get_above(c, test_types[i]) != test_above(c, test_types[i])
+	    || stack_get_below(c, test_types[i]) 
+	       != test_below(c, test_types[i]))
+	  return 0;
+    }
+
+  return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+  Wm            *w;
+  Client        *clients[TEST_N_CLIENTS], *c;
+  MBTraceTime    start;
+  int            i, n_ops = TEST_N_OPS, n_found = 0;
+
+  if (argc > 1) n_ops = atoi(argv[1]);
+
+  srand(1);
+
+  w = malloc(sizeof(Wm));
+  memset(w, 0, sizeof(Wm));
+
+  for (i=0; i<TEST_N_CLIENTS; i++)
     {
-      printf("%s\n", c->name);
+      char    buf[64];
+
+      sprintf(buf, "Client-%i", i);
+
+      c = malloc(sizeof(Client));
+      memset(c, 0, sizeof(Client));
+
+      c->wm     = w;
+      c->name   = strdup(buf);
+      c->type   = MBCLIENT_TYPE_APP;
+      c->mapped = True;
+
+      /* Like base_client_new() then a constructor */
+      stack_prepend_bottom(c);
+      c->type = test_types[i % TEST_N_TYPES];
+      stack_update_type(c);
+
+      clients[i] = c;
     }
 
-  stack_move_below_client(w->stack_top, w->stack_bottom);
-  stack_move_above_client(midc, midc2);
+  for (i=0; i<n_ops; i++)
+    {
+      Client *a = clients[rand() % TEST_N_CLIENTS];
+      Client *b = clients[rand() % TEST_N_CLIENTS];
 
-  printf("\n");
+      switch (rand() % 7)
+	{
+	case 0:
+	  stack_move_top(a);
+	  break;
+	case 1:
+	  stack_move_above_client(a, (rand() % 8) ? b : NULL);
+	  break;
+	case 2:
+	  stack_move_client_above_type(a, b->type|MBCLIENT_TYPE_APP);
+	  break;
+	case 3:
+	  stack_move_type_above_client(w, b->type, a);
+	  break;
+	case 4:
+	  stack_cycle_forward(w, MBCLIENT_TYPE_APP);
+	  break;
+	case 5:
+	  a->mapped = !a->mapped;
+	  break;
+	case 6:
+	  /* make a transient for b, or nothing, unless that loops */
+	  for (c = b; c != NULL && c != a; c = c->trans)
+	    ;
+	  a->trans = (c == NULL && (rand() % 4)) ? b : NULL;
+	  stack_update_trans(a);
+	  break;
+	}
 
+      if (i % 1000 == 0 && !test_check(w))
+	{
+	  printf("stack-test: type or transient lists broken after %i ops\n", i);
+	  stack_dump(w);
+	  return 1;
+	}
+    }
 
-  stack_enumerate(w,c)
+  if (!test_check(w))
     {
-      printf("%s\n", c->name);
+      printf("stack-test: type or transient lists broken\n");
+      return 1;
     }
 
+  /* Time with the apps buried under everything else, as they are
+   * under panels and task menus on a busy display.
+   */
+  for (i=0; i<TEST_N_CLIENTS; i++)
+    clients[i]->mapped = True;
+
+  stack_move_type_above_client(w, MBCLIENT_TYPE_DIALOG|MBCLIENT_TYPE_TOOLBAR
+			       |MBCLIENT_TYPE_PANEL|MBCLIENT_TYPE_TASK_MENU, 
+			       w->stack_top);
+
+  c = stack_get_highest(w, MBCLIENT_TYPE_APP);
+
+  start = trace_now();
+
+  for (i=0; i<n_ops; i++)
+    if (stack_get_highest(w, MBCLIENT_TYPE_APP) 
+	&& stack_get_below(c, MBCLIENT_TYPE_APP))
+      n_found++;
+
+  printf("stack-test: ok, %i clients, %i queries in %lu us ( linear ",
+	 TEST_N_CLIENTS, n_ops, (unsigned long)(trace_now() - start));
+
+  start = trace_now();
+
+  for (i=0; i<n_ops; i++)
+    if (test_highest(w, MBCLIENT_TYPE_APP) 
+	&& test_below(c, MBCLIENT_TYPE_APP))
+      n_found++;
+
+  printf("%lu us )\n", (unsigned long)(trace_now() - start));
+
+  return 0;
 }
 
 #endif
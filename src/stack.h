@@ -25,6 +25,9 @@
 #include "wm.h"
 #include "config.h"
 
+#include <strings.h>
+#include <limits.h>
+
 #define stack_enumerate(w,c)                               \
  if ((w)->stack_bottom)                                    \
    for ((c)=(w)->stack_bottom; (c) != NULL; (c)=(c)->above) 
@@ -33,10 +36,23 @@
  if ((w)->stack_top)                                       \
    for ((c)=(w)->stack_top; (c) != NULL; (c)=(c)->below) 
 
+/* Direct transients of t ( not NULL ) bottom to top. Don't restack
+ * in it */
 #define stack_enumerate_transients(w,c,t)                  \
- if ((w)->stack_bottom)                                    \
-   for ((c)=(w)->stack_bottom; (c) != NULL; (c)=(c)->above) \
-     if ((c)->trans == (t))
+ for ((c)=(t)->trans_bottom; (c) != NULL; (c)=(c)->trans_above)
+
+/* Bit index of a single MBCLIENT_TYPE_* value */
+#define stack_type_index(t) (ffs(t) - 1)
+
+/* Just the clients of one type, bottom to top ( or reverse ). Don't
+ * restack in it */
+#define stack_enumerate_type(w,c,t)                        \
+ for ((c)=(w)->stack_type_bottom[stack_type_index(t)];     \
+      (c) != NULL; (c)=(c)->type_above)
+
+#define stack_enumerate_type_reverse(w,c,t)                \
+ for ((c)=(w)->stack_type_top[stack_type_index(t)];        \
+      (c) != NULL; (c)=(c)->type_below)
 
 #define stack_move_top(c) \
  stack_move_above_client((c), (c)->wm->stack_top)
@@ -50,6 +66,10 @@
 #define n_stack_items(w) \
  (w)->stack_n_items
 
+/* For frames restacked behind stack_sync_to_display()'s back */
+#define stack_sync_invalidate(c) \
+ (c)->stack_sync_serial = 0
+
 
 void
 stack_add_above_client(Client *client, Client *client_below);
@@ -63,6 +83,12 @@ stack_prepend_bottom(Client *client);
 void
 stack_remove(Client *client);
 
+void
+stack_update_type(Client *client);
+
+void
+stack_update_trans(Client *client);
+
 void
 stack_move_transients_to_top(Wm *w, Client *client_trans_for, int flags);
 
@@ -0,0 +1,260 @@
+/* 
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "stats.h"
+#include "wm.h"
+
+#include <stdarg.h>
+
+unsigned long stats_round_trips = 0;
+
+static char *event_names[] = {
+  NULL, NULL, 
+  "KeyPress", "KeyRelease", "ButtonPress", "ButtonRelease", 
+  "MotionNotify", "EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+  "KeymapNotify", "Expose", "GraphicsExpose", "NoExpose", 
+  "VisibilityNotify", "CreateNotify", "DestroyNotify", "UnmapNotify", 
+  "MapNotify", "MapRequest", "ReparentNotify", "ConfigureNotify", 
+  "ConfigureRequest", "GravityNotify", "ResizeRequest", 
+  "CirculateNotify", "CirculateRequest", "PropertyNotify", 
+  "SelectionClear", "SelectionRequest", "SelectionNotify", 
+  "ColormapNotify", "ClientMessage", "MappingNotify", "GenericEvent"
+};
+
+const char*
+stats_event_name(int type)
+{
+  if (type >= 0 && type < sizeof(event_names)/sizeof(char*) 
+      && event_names[type])
+    return event_names[type];
+
+  return "Other";
+}
+
+/* Every property read in the wm comes through here, so replays can
+ * answer them from the log and recordings can save the replies.
+ */
+int
+stats_xget_window_property(Display *dpy, Window win, Atom property, 
+			   long offset, long length, Bool delete, 
+			   Atom req_type, Atom *actual_type, 
+			   int *actual_format, unsigned long *nitems, 
+			   unsigned long *bytes_after, unsigned char **prop)
+{
+  MBRecordProperty rp;
+  int              result;
+
+  if (record_replaying
+      && record_replay_property(win, property, offset, length, req_type,
+				&result, actual_type, actual_format, 
+				nitems, bytes_after, prop))
+    return result;
+
+  stats_round_trips++;
+  result = XGetWindowProperty(dpy, win, property, offset, length, delete, 
+			      req_type, actual_type, actual_format, nitems, 
+			      bytes_after, prop);
+
+  if (record_fp != NULL)
+    {
+      memset(&rp, 0, sizeof(rp));
+
+      rp.win           = win;
+      rp.property      = property;
+      rp.req_type      = req_type;
+      rp.offset        = offset;
+      rp.length        = length;
+      rp.status        = result;
+      rp.actual_type   = (result == Success) ? *actual_type : None;
+      rp.actual_format = (result == Success) ? *actual_format : 0;
+      rp.nitems        = (result == Success) ? *nitems : 0;
+      rp.bytes_after   = (result == Success) ? *bytes_after : 0;
+
+      record_property(&rp, (result == Success) ? *prop : NULL);
+    }
+
+  return result;
+}
+
+void
+stats_init(Wm *w)
+{
+  memset(&w->stats, 0, sizeof(MBStats));
+  w->stats.start_time = time(NULL);
+}
+
+/* Buckets are < 1, 2, 4 .. 64ms, the last one catching anything over */
+void
+stats_hist_add(unsigned long *hist, unsigned long usecs)
+{
+  int           i;
+  unsigned long limit = 1000;
+
+  for (i = 0; i < STATS_N_HIST_BUCKETS - 1; i++, limit <<= 1)
+    if (usecs < limit)
+      break;
+
+  hist[i]++;
+}
+
+typedef struct StatsBuf
+{
+  char *str;
+  int   len, size;
+} StatsBuf;
+
+static void
+stats_buf_printf(StatsBuf *buf, const char *format, ...)
+{
+  va_list ap;
+  int     n;
+
+  for (;;)
+    {
+      va_start(ap, format);
+      n = vsnprintf(buf->str + buf->len, buf->size - buf->len, format, ap);
+      va_end(ap);
+
+      if (n >= 0 && n < buf->size - buf->len)
+	break;
+
+      buf->size *= 2;
+      buf->str   = realloc(buf->str, buf->size);
+    }
+
+  buf->len += n;
+}
+
+static void
+stats_buf_slab(StatsBuf *buf, MBSlab *slab)
+{
+  stats_buf_printf(buf, "alloc.%s.in_use=%lu\nalloc.%s.total=%lu\n"
+		   "alloc.%s.blocks=%lu\n",
+		   slab->name, slab->n_in_use, slab->name, slab->n_allocs,
+		   slab->name, slab->n_blocks);
+}
+
+static void
+stats_buf_hist(StatsBuf *buf, const char *key, unsigned long *hist)
+{
+  int i;
+
+  stats_buf_printf(buf, "%s=", key);
+
+  for (i = 0; i < STATS_N_HIST_BUCKETS; i++)
+    stats_buf_printf(buf, "%lu%s", hist[i], 
+		     (i < STATS_N_HIST_BUCKETS - 1) ? "," : "\n");
+}
+
+void
+stats_publish(Wm *w)
+{
+  MBStats       *s = &w->stats;
+  StatsBuf       buf;
+  Client        *c = NULL;
+  unsigned long  total = s->events_other;
+  int            i, n_app = 0, n_dialog = 0, n_toolbar = 0, n_panel = 0, 
+                 n_desktop = 0, n_menu = 0, n_override = 0;
+
+  buf.size = 1024;
+  buf.len  = 0;
+  buf.str  = malloc(buf.size);
+
+  stats_buf_printf(&buf, "uptime_s=%lu\n", 
+		   (unsigned long)(time(NULL) - s->start_time));
+
+  for (i = 0; i < LASTEvent; i++)
+    total += s->events[i];
+
+  stats_buf_printf(&buf, "events.total=%lu\n", total);
+
+  for (i = 0; i < LASTEvent; i++)
+    if (s->events[i])
+      stats_buf_printf(&buf, "events.%s=%lu\n", 
+		       stats_event_name(i), s->events[i]);
+
+  stats_buf_printf(&buf, "events.other=%lu\n", s->events_other);
+  stats_buf_hist(&buf, "dispatch_ms_hist", s->dispatch_hist);
+
+  stats_buf_printf(&buf, "renders=%lu\n", s->renders);
+  stats_buf_hist(&buf, "render_ms_hist", s->render_hist);
+
+  stats_buf_printf(&buf, "paints=%lu\n", s->paints);
+  stats_buf_hist(&buf, "paint_ms_hist", s->paint_hist);
+
+  stats_buf_printf(&buf, "round_trips=%lu\n", stats_round_trips);
+
+  stats_buf_printf(&buf, "theme_cache_hits=%lu\n", s->theme_cache_hits);
+  stats_buf_printf(&buf, "theme_cache_misses=%lu\n", s->theme_cache_misses);
+  stats_buf_printf(&buf, "damage_deferred=%lu\n", s->damage_deferred);
+
+  if (!stack_empty(w))
+    stack_enumerate(w, c)
+      switch (c->type)
+	{
+	case MBCLIENT_TYPE_APP:       n_app++;      break;
+	case MBCLIENT_TYPE_DIALOG:    n_dialog++;   break;
+	case MBCLIENT_TYPE_TOOLBAR:   n_toolbar++;  break;
+	case MBCLIENT_TYPE_PANEL:     n_panel++;    break;
+	case MBCLIENT_TYPE_DESKTOP:   n_desktop++;  break;
+	case MBCLIENT_TYPE_TASK_MENU: n_menu++;     break;
+	default: break;
+	}
+
+#ifdef USE_COMPOSITE
+  {
+    MBOverride *o;
+
+    for (o = w->override_bottom; o != NULL; o = o->above)
+      n_override++;
+  }
+#endif
+
+  stats_buf_printf(&buf, "clients.app=%i\nclients.dialog=%i\n"
+		   "clients.toolbar=%i\nclients.panel=%i\n"
+		   "clients.desktop=%i\nclients.menu=%i\n"
+		   "clients.override=%i\n",
+		   n_app, n_dialog, n_toolbar, n_panel, 
+		   n_desktop, n_menu, n_override);
+
+  stats_buf_slab(&buf, &slab_clients);
+  stats_buf_slab(&buf, &slab_buttons);
+  stats_buf_slab(&buf, &slab_list_items);
+#ifdef USE_COMPOSITE
+  stats_buf_slab(&buf, &slab_overrides);
+#endif
+
+#ifndef STANDALONE
+  if (w->mbtheme)
+    {
+      unsigned long arena = 0, images = 0, pixmaps = 0;
+
+      mbtheme_memory_usage(w->mbtheme, &arena, &images, &pixmaps);
+
+      stats_buf_printf(&buf, "mem.theme_arena=%lu\n"
+		       "mem.theme_image_cache=%lu\n"
+		       "mem.theme_pixmap_cache=%lu\n",
+		       arena, images, pixmaps);
+    }
+#endif
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_STATS], XA_STRING, 8,
+		  PropModeReplace, (unsigned char*)buf.str, buf.len);
+
+  free(buf.str);
+}
@@ -0,0 +1,40 @@
+/* 
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MB_STATS_H_
+#define _MB_STATS_H_
+
+#include "structs.h"
+
+/* Runtime counters, always kept. Written out as key=value lines to the
+ * _MB_STATS root property on MB_CMD_STATS ( matchbox-remote -stats ).
+ */
+
+void
+stats_init(Wm *w);
+
+void
+stats_hist_add(unsigned long *hist, unsigned long usecs);
+
+void
+stats_publish(Wm *w);
+
+const char*
+stats_event_name(int type);
+
+#endif
@@ -30,6 +30,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <time.h>
 
 #include <X11/Xlib.h>
@@ -57,6 +58,7 @@
 #ifdef USE_LIBSN
 #define SN_API_NOT_YET_FROZEN 1
 #define MB_SN_APP_TIMEOUT 30 	/* 30 second timeout for app startup */
+#define SN_CYCLE_HASH_SIZE 32	/* must be a power of 2 */
 #include <libsn/sn.h>
 #endif
 
@@ -71,8 +73,15 @@
 #include <X11/extensions/Xrender.h>
 #endif
 
+#ifdef HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+
 #ifdef USE_XSYNC
 #include <X11/extensions/sync.h>
+
+#define EWMH_SYNC_ALARM_BUCKETS 32  /* alarm -> client index size       */
+#define EWMH_SYNC_TIMEOUT       250 /* ms to wait on a client's repaint */
 #endif
 
 #if USE_SM
@@ -117,6 +126,14 @@
 #define WEST   2
 #define NORTH  3     /* Note, North must be last or pixmap caching will fail*/
 
+/* Decoration frames needing a repaint, see client_decor_queue_redraw() */
+#define DECOR_DIRTY_EAST   (1<<EAST)
+#define DECOR_DIRTY_SOUTH  (1<<SOUTH)
+#define DECOR_DIRTY_WEST   (1<<WEST)
+#define DECOR_DIRTY_NORTH  (1<<NORTH)
+#define DECOR_DIRTY_ALL    (DECOR_DIRTY_EAST|DECOR_DIRTY_SOUTH \
+			    |DECOR_DIRTY_WEST|DECOR_DIRTY_NORTH)
+
 #define ACTIVE   1
 #define INACTIVE 2
 
@@ -145,6 +162,9 @@
 #define MB_CMD_MISC        7 	/* spare, used for debugging */
 #define MB_CMD_COMPOSITE   8
 #define MB_CMB_KEYS_RELOAD 9
+#define MB_CMD_TRACE_DUMP  10
+#define MB_CMD_STATS       11
+#define MB_CMD_RESTART     12
 
 /* Atoms, if you change these check ewmh_init() first */
 
@@ -224,6 +244,13 @@ enum {
   _NET_WM_WINDOW_TYPE_DROPDOWN_MENU,
   _NET_WM_WINDOW_TYPE_POPUP_MENU,
   _MB_NUM_SYSTEM_MODAL_WINDOWS_PRESENT,
+  _MB_DEBUG_THEME_FOOTPRINT,
+  _MB_TRACE_FILE,
+  _MB_STATS,
+  _MB_RESTART_STATE,
+  SM_CLIENT_ID,
+  WM_CLIENT_LEADER,
+  WM_WINDOW_ROLE,
   ATOM_COUNT
 
 } MBAtomEnum;
@@ -245,11 +272,15 @@ typedef enum
   MBCLIENT_TYPE_TASK_MENU = (1<<4),
   MBCLIENT_TYPE_APP       = (1<<5),
   MBCLIENT_TYPE_DESKTOP   = (1<<6),
-  MBCLIENT_TYPE_OVERRIDE  = (1<<7),
+  MBCLIENT_TYPE_OVERRIDE  = (1<<7), /* unused, overrides are MBOverrides
+				       now. Kept so the bits and 
+				       STACK_N_TYPES stay put */
   MBCLIENT_TYPE_ANY       = (1<<8)
 
 } MBClientTypeEnum;
 
+#define STACK_N_TYPES 8 	/* for the per type stack lists */
+
 enum {
   MSK_NORTH = 0,
   MSK_SOUTH,
@@ -260,6 +291,21 @@ enum {
 
 /* Decoration buttons */
 
+/* One shot timers, see timer.c. Kept in a heap on the Wm */
+
+struct _wm;
+
+typedef void (*MBTimerFunc)(struct _wm *w, void *data);
+
+typedef struct MBTimer
+{
+  uint64_t       deadline;	/* timer_now() msecs */
+  int            index;		/* slot in w->timers */
+  MBTimerFunc    func;
+  void          *data;
+
+} MBTimer;
+
 typedef struct _mb_client_button
 {
   Window win;
@@ -295,6 +341,7 @@ typedef struct _mb_client_button
 #define CLIENT_IS_MOVING       (1<<19) /* Used by comosite engine */
 #define CLIENT_DOCK_TITLEBAR_SHOW_ON_DESKTOP (1<<20)
 #define CLIENT_NO_FOCUS_ON_MAP (1<<21) /* for _NET_WM_USER_TIME = 0 */
+#define CLIENT_DECOR_STALE_FLAG (1<<22) /* hidden app needs redecorating */
 #define CLIENT_IS_MINIMIZED    (1<<23) /* used by toolbars + icon on map*/
 #define CLIENT_TOOLBARS_MOVED_FOR_FULLSCREEN (1<<24)
 #define CLIENT_IS_TRANSIENT_FOR_ROOT (1<<25)
@@ -310,6 +357,48 @@ typedef struct _mb_client_button
 #define CLIENT_TB_ALT_TRANS_FOR_APP    (1<<29)
 #endif
 
+#ifdef USE_COMPOSITE
+
+/* An override redirect window ( menu, tooltip .. ), tracked just so the
+ * compositor can paint it. Kept in their own list, apart from the
+ * client stack, and painted over it. See comp_engine_override_add().
+ */
+typedef struct MBOverride
+{
+  Window             window;
+  int                x, y, width, height;
+  Visual            *visual;
+  Bool               is_argb32;
+  int                transparency;
+
+  Damage	     damage;
+  Picture	     picture;
+  XserverRegion	     extents;
+  XserverRegion	     border_clip;
+
+  struct MBOverride *above, *below;
+
+} MBOverride;
+
+#endif
+
+/* A monitor, from RandR CRTCs. Apps, panels and toolbars are laid out
+ * within the output they're on, see wm_outputs_update().
+ */
+typedef struct MBOutput
+{
+  int               x, y, width, height;
+
+  /* Space panels ( and toolbars ) take off each of its edges, indexed
+   * by [include_toolbars][direction]. See wm_offsets_invalidate() */
+  int               offsets[2][4];
+
+  /* stack_order of its visible app, 0 for none. Only good during a
+   * comp_engine_render() */
+  unsigned long     top_order;
+
+} MBOutput;
+
 /* Main Client structure */
 
 typedef struct _client
@@ -332,7 +421,7 @@ typedef struct _client
 				   ifdefs keeping it here */
 #ifdef USE_COMPOSITE
 
-  int		    damaged;
+  int		    damaged;	/* damage left unsubtracted while hidden */
   Damage	    damage;
   Picture	    picture;
   XserverRegion	    extents;
@@ -377,6 +466,20 @@ typedef struct _client
   Bool              have_cache, have_set_bg;
   struct list_item *buttons; 
 
+  /* Deferred decoration repaint */
+
+  int               decor_dirty;      /* DECOR_DIRTY_* frames to repaint  */
+  int               decor_paint_mask; /* frames the running redraw paints */
+  Bool              decor_queued;
+  struct _client   *decor_next;
+
+  /* Deferred relayout, see client_layout_queue() */
+
+  Bool              layout_queued;
+  struct _client   *layout_next;
+  int               layout_x, layout_y;	/* as last passed to move_resize */
+  int               layout_width, layout_height;
+
   /* InputOnly modal 'blocker' win */
 
   Window            win_modal_blocker;
@@ -404,6 +507,9 @@ typedef struct _client
   XSyncValue        ewmh_sync_value;
   XSyncAlarm        ewmh_sync_alarm;
   Bool              ewmh_sync_is_waiting;
+  Bool              ewmh_sync_pending;  /* resize queued behind request */
+  MBTimer          *ewmh_sync_timer;    /* give up waiting on this      */
+  struct _client   *ewmh_sync_next;     /* alarm index bucket chain     */
 #endif
 
   /* References */
@@ -415,6 +521,32 @@ typedef struct _client
   struct _client   *above, *below;
   struct _client   *next_focused_client;
 
+  /* Same type neighbours, see stack_update_type() */
+  struct _client   *type_above, *type_below;
+  int               stack_type;	/* type list its on, 0 for none */
+  unsigned long     stack_order; /* grows bottom to top */
+
+  /* Its own transients bottom to top, and its neighbours among its
+   * parent's, see stack_update_trans() */
+  struct _client   *trans_bottom, *trans_top;
+  struct _client   *trans_above, *trans_below;
+  struct _client   *stack_trans; /* parent list its on, NULL for none */
+
+  /* Where stack_sync_to_display() last put it, valid only if the
+   * serial matches the wm's and the windows are the same */
+  int               stack_sync_pos;
+  unsigned long     stack_sync_serial;
+  Window            stack_sync_frame, stack_sync_blocker;
+
+  /* What it took off a screen edge when the offsets were last summed */
+  int               strut_edge, strut_size;
+
+  int               output;	/* index into wm->outputs */
+
+#if USE_SM || defined(SESSION_TEST_MAIN)
+  int               sm_stack_pos; /* saved app stack position +1, or 0 */
+#endif
+
   /* Client methods */
   
   void (* reparent)( struct _client* c );
@@ -466,18 +598,47 @@ typedef struct _kbdconfig_entry
   int                      idata;
   struct _kbdconfig_entry *next_entry;
 
+  KeyCode                  keycode;  /* as grabbed, 0 if none */
+  struct _kbdconfig_entry *next_keycode_entry;
+  unsigned long            grab_serial;
+  int                      grab_error;
 
 } MBConfigKbdEntry;
 
+#define KEYS_N_KEYCODES 256
+
 typedef struct _kbdconfig
 {
   struct _kbdconfig_entry *entrys;
 
+  /* Entries chained by keycode for wm_handle_keypress() */
+  struct _kbdconfig_entry *keycode_table[KEYS_N_KEYCODES];
+
   int MetaMask, HyperMask, SuperMask, AltMask, 
     ModeMask, NumLockMask, ScrollLockMask, lock_mask;
 
 } MBConfigKbd;
 
+/* Runtime statistics, see stats.c */
+
+#define STATS_N_HIST_BUCKETS 8 	/* < 1, 2, 4 .. 64ms, overflow */
+
+typedef struct MBStats
+{
+  time_t        start_time;
+  unsigned long events[LASTEvent]; /* core events by type */
+  unsigned long events_other;	   /* extension events */
+  unsigned long dispatch_hist[STATS_N_HIST_BUCKETS];
+  unsigned long renders;
+  unsigned long render_hist[STATS_N_HIST_BUCKETS];
+  unsigned long paints;
+  unsigned long paint_hist[STATS_N_HIST_BUCKETS];
+  unsigned long theme_cache_hits;
+  unsigned long theme_cache_misses;
+  unsigned long damage_deferred; /* repairs put off for hidden clients */
+
+} MBStats;
+
 /* Window Manager Runtime Configuration  */
 
 enum {
@@ -526,11 +687,21 @@ typedef struct _wm_config
 /* Queue like structs for startup notification and msg win compile opts  */
 
 #ifdef USE_LIBSN
+/* One per launch. Hashed on bin_name always, on seq_id while starting
+ * and on xid once matched to a window. Busy launches hold a timer to
+ * expire them if no window ever turns up.
+ */
 typedef struct _sncycles 
 {
   char             *bin_name;
+  char             *seq_id;
   Window            xid;
-  struct _sncycles *next;
+  MBTimer          *timer;	/* set while starting */
+
+  struct _sncycles *next, *prev; /* all, in launch order */
+  struct _sncycles *bin_next;
+  struct _sncycles *seq_next;
+  struct _sncycles *xid_next;
 } SnCycle;
 
 typedef struct _sn_execmapping_item
@@ -579,16 +750,43 @@ typedef struct _wm
 
   Client           *stack_top, *stack_bottom;
   int               stack_n_items;     
+
+  /* Per client type lists, indexed by MBCLIENT_TYPE bit */
+  Client           *stack_type_top[STACK_N_TYPES];
+  Client           *stack_type_bottom[STACK_N_TYPES];
+
+  Client          **stack_sync_order; /* scratch kept between syncs */
+  int              *stack_sync_scratch;
+  int               stack_sync_size;
+  unsigned long     stack_sync_serial;
   Client           *stack_top_app; 
   Client           *client_desktop;
 
   MBList           *client_age_list; /* List of clients ordered by age */
 
+  Client           *decor_queue; /* Clients with decorations to repaint */
+  Client           *layout_queue; /* Clients relayed out, to move */
+
+  /* Dialog being dragged, see dialog_client_drag() */
+  Client           *drag_client;
+  Window            drag_outline;
+  int               drag_x1, drag_y1, drag_old_x, drag_old_y;
+  Bool              drag_live;
+
+  MBOutput         *outputs;   /* first is the primary */
+  int               n_outputs;
+  Bool              offsets_valid;
+  Bool              work_area_dirty;
+  long              work_area[4]; /* as last set on _NET_WORKAREA */
+
+  MBStats           stats;
+
   int               n_modal_blocker_wins; /* needed for restack() call */
 
   /*******************/
 
   Wm_config        *config;  
+  char            **argv; 	/* as started, for restart_exec() */
 
   Window            last_click_window;
   Time              last_click_time;
@@ -615,8 +813,11 @@ typedef struct _wm
   SnDisplay        *sn_display;
   SnMonitorContext *sn_context;
   int               sn_busy_cnt;
-  time_t            sn_init_time;
-  SnCycle          *sn_cycles;
+  SnCycle          *sn_cycles, *sn_cycles_tail;
+  SnCycle          *sn_bin_hash[SN_CYCLE_HASH_SIZE];
+  SnCycle          *sn_seq_hash[SN_CYCLE_HASH_SIZE];
+  SnCycle          *sn_xid_hash[SN_CYCLE_HASH_SIZE];
+  Bool              sn_props_dirty;
   struct list_item *sn_mapping_list;
 #endif
 
@@ -664,17 +865,34 @@ typedef struct _wm
 
   MBPixbuf         *argb_pb; 	/* special 32 bpp pixbuf ref */
 
+  MBOverride       *override_bottom, *override_top;
+
+#endif
+
+#ifdef HAVE_XRANDR
+  Bool              have_randr;
+  Bool              randr_have_current; /* 1.3, can skip the re-probe */
+  int               randr_event_base;
+  Rotation          randr_rotation;
 #endif
 
 #ifdef USE_XSYNC
   Bool              have_xsync;
   int               sync_event_base;
   int               sync_error_base;
+  Client           *sync_alarm_index[EWMH_SYNC_ALARM_BUCKETS];
+  int               n_sync_waiting; /* clients with requests in flight */
 #endif
 
 #if USE_SM
   int               sm_ice_fd;      
   IceConn           ice_conn;
+  char             *sm_client_id;   /* as given us this time round */
+  MBList           *sm_entries;     /* saved clients yet to map again */
+#endif
+
+#ifdef USE_THEME_THREAD
+  struct _mb_theme_loader *theme_loader; /* set while loading in background */
 #endif
 
 #ifdef STANDALONE
@@ -685,7 +903,11 @@ typedef struct _wm
   int              toolbar_panel_h;
 #endif
 
+  MBTimer         **timers;	/* binary heap on deadline */
+  int               n_timers, timers_size;
+
   int n_active_ping_clients; 	/* Number of apps we are pinging */
+  MBTimer *ping_timer;		/* set while there are any */
   int n_modals_present;		/* Number of modal windows present */
 
 } Wm;
@@ -738,7 +960,8 @@ enum {
   BUTTON_ACTION_HELP,
   BUTTON_ACTION_ACCEPT,
   BUTTON_ACTION_DESKTOP,
-  BUTTON_ACTION_CUSTOM
+  BUTTON_ACTION_CUSTOM,
+  N_BUTTON_ACTIONS
 };
 
 enum {
@@ -765,4 +988,20 @@ enum {
   N_FRAME_TYPES
 };
 
+/* Calls that wait on the server are counted for the runtime stats.
+ * Put STATS_ROUND_TRIP() next to each one, property reads go through
+ * stats_xget_window_property() which counts ( and records ) them.
+ */
+
+extern unsigned long stats_round_trips;
+
+#define STATS_ROUND_TRIP() (stats_round_trips++)
+
+int
+stats_xget_window_property(Display *dpy, Window win, Atom property, 
+			   long offset, long length, Bool delete, 
+			   Atom req_type, Atom *actual_type, 
+			   int *actual_format, unsigned long *nitems, 
+			   unsigned long *bytes_after, unsigned char **prop);
+
 #endif
@@ -0,0 +1,152 @@
+/* 
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "timer.h"
+#include "wm.h"
+
+#define timer_parent(i) (((i) - 1) / 2)
+
+/* Monotonic, so setting the clock doesn't fire or stall timers, and
+ * 64 bits wide so it never wraps.
+ */
+static uint64_t
+timer_now(void)
+{
+  return trace_now() / 1000;
+}
+
+static void
+timer_heap_set(Wm *w, int i, MBTimer *timer)
+{
+  w->timers[i] = timer;
+  timer->index = i;
+}
+
+static void
+timer_heap_up(Wm *w, int i)
+{
+  MBTimer *timer = w->timers[i];
+
+  while (i > 0 && w->timers[timer_parent(i)]->deadline > timer->deadline)
+    {
+      timer_heap_set(w, i, w->timers[timer_parent(i)]);
+      i = timer_parent(i);
+    }
+
+  timer_heap_set(w, i, timer);
+}
+
+static void
+timer_heap_down(Wm *w, int i)
+{
+  MBTimer *timer = w->timers[i];
+  int      child;
+
+  while ((child = (2 * i) + 1) < w->n_timers)
+    {
+      if (child + 1 < w->n_timers 
+	  && w->timers[child + 1]->deadline < w->timers[child]->deadline)
+	child++;
+
+      if (w->timers[child]->deadline >= timer->deadline)
+	break;
+
+      timer_heap_set(w, i, w->timers[child]);
+      i = child;
+    }
+
+  timer_heap_set(w, i, timer);
+}
+
+MBTimer*
+timer_add(Wm *w, unsigned long msecs, MBTimerFunc func, void *data)
+{
+  MBTimer *timer;
+
+  if (w->n_timers == w->timers_size)
+    {
+      w->timers_size = w->timers_size ? w->timers_size * 2 : 8;
+      w->timers = realloc(w->timers, w->timers_size * sizeof(MBTimer*));
+    }
+
+  timer = malloc(sizeof(MBTimer));
+  memset(timer, 0, sizeof(MBTimer));
+
+  timer->deadline = timer_now() + msecs;
+  timer->func     = func;
+  timer->data     = data;
+
+  timer_heap_set(w, w->n_timers++, timer);
+  timer_heap_up(w, timer->index);
+
+  dbg("%s() %lums, %i pending\n", __func__, msecs, w->n_timers);
+
+  return timer;
+}
+
+void
+timer_remove(Wm *w, MBTimer *timer)
+{
+  int i = timer->index;
+
+  if (i != --w->n_timers)
+    {
+      MBTimer *moved = w->timers[w->n_timers];
+
+      /* The last entry fills the hole, and may need to go either way */
+      timer_heap_set(w, i, moved);
+      timer_heap_up(w, i);
+      timer_heap_down(w, moved->index);
+    }
+
+  free(timer);
+}
+
+/* Milliseconds until the earliest timer for poll(), -1 for none */
+int
+timer_next_timeout(Wm *w)
+{
+  uint64_t now;
+
+  if (w->n_timers == 0)
+    return -1;
+
+  now = timer_now();
+
+  if (w->timers[0]->deadline <= now)
+    return 0;
+
+  return (int)(w->timers[0]->deadline - now);
+}
+
+void
+timer_run_expired(Wm *w)
+{
+  uint64_t now = timer_now();
+
+  while (w->n_timers && w->timers[0]->deadline <= now)
+    {
+      MBTimer     *timer = w->timers[0];
+      MBTimerFunc  func  = timer->func;
+      void        *data  = timer->data;
+
+      timer_remove(w, timer);
+
+      func(w, data);
+    }
+}
@@ -0,0 +1,42 @@
+/* 
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MB_TIMER_H_
+#define _MB_TIMER_H_
+
+#include "structs.h"
+
+/* One shot timers for the event loop. The loop sleeps in poll() until
+ * the earliest deadline, so nothing wakes up an idle wm. A timer is
+ * freed just before its func is called, funcs wanting to repeat add
+ * a new one.
+ */
+
+MBTimer*
+timer_add(Wm *w, unsigned long msecs, MBTimerFunc func, void *data);
+
+void
+timer_remove(Wm *w, MBTimer *timer);
+
+int
+timer_next_timeout(Wm *w);
+
+void
+timer_run_expired(Wm *w);
+
+#endif
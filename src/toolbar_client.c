@@ -44,6 +44,7 @@ toolbar_client_new(Wm *w, Window win)
      }
 
    c->type = MBCLIENT_TYPE_TOOLBAR;
+   stack_update_type(c);
    
    c->configure    = &toolbar_client_configure;
    c->reparent     = &toolbar_client_reparent;
@@ -64,18 +65,19 @@ toolbar_client_new(Wm *w, Window win)
 void
 toolbar_client_configure(Client *c)
 {
-  Wm *w = c->wm;
+  Wm       *w = c->wm;
+  MBOutput *o = &w->outputs[c->output];
 
   if (c->flags & CLIENT_IS_MINIMIZED)
     return;
 
-  c->y = w->dpy_height - wm_get_offsets_size(w, SOUTH, c, True)
+  c->y = o->y + o->height - wm_get_offsets_size(w, SOUTH, c, True)
     - c->height;
-  c->x = toolbar_win_offset(c) 
-    + wm_get_offsets_size(w, WEST,  NULL, False);
-  c->width = w->dpy_width - toolbar_win_offset(c)
-    - wm_get_offsets_size(w, WEST,  NULL, False)
-    - wm_get_offsets_size(w, EAST,  NULL, False);
+  c->x = o->x + toolbar_win_offset(c) 
+    + wm_get_output_offsets_size(w, c->output, WEST,  NULL, False);
+  c->width = o->width - toolbar_win_offset(c)
+    - wm_get_output_offsets_size(w, c->output, WEST,  NULL, False)
+    - wm_get_output_offsets_size(w, c->output, EAST,  NULL, False);
 }
 
 void
@@ -91,6 +93,8 @@ toolbar_client_move_resize(Client *c)
    
   base_client_move_resize(c);
 
+  wm_offsets_invalidate(w);
+
   if (!(c->flags & CLIENT_IS_MINIMIZED))
     {
       if (c->flags & CLIENT_TITLE_HIDDEN_FLAG) max_offset = 0;
@@ -160,6 +164,8 @@ toolbar_client_show(Client *c)
 
   c->mapped = True;
 
+  wm_offsets_invalidate(w);
+
   if (w->stack_top_app 
       && (w->stack_top_app->flags & CLIENT_FULLSCREEN_FLAG))
     main_client_manage_toolbars_for_fullscreen(c, True);
@@ -169,28 +175,21 @@ toolbar_client_show(Client *c)
    if (win_state == WithdrawnState)    /* initial show() state */
      {
        client_set_state(c,NormalState);
-       wm_update_layout(c->wm, c, - c->height);
+       wm_update_layout(c->wm, c->output);
      } 
    else if (win_state == IconicState) /* minimised, set maximised */
      {
        client_set_state(c,NormalState);
 
+       /* Grow up from the bottom of the minimised bar, keeping its 
+        * place among the toolbars, wm_update_layout() does the rest. */
+       if (!(c->flags & CLIENT_TITLE_HIDDEN_FLAG))
+	 c->y -= c->height - toolbar_win_offset(c);
+
        /* Make sure desktop flag is unset */
        c->flags &= ~CLIENT_IS_MINIMIZED;
 
-       wm_update_layout(c->wm, c, -(c->height - toolbar_win_offset(c)));
-
-       if (c->flags & CLIENT_TITLE_HIDDEN_FLAG)
-	 {
-	   c->x = wm_get_offsets_size(c->wm, WEST,  NULL, False);
-	 }
-       else
-	 {
-	   c->x = theme_frame_defined_width_get(w->mbtheme,
-						FRAME_UTILITY_MAX )
-	     + wm_get_offsets_size(c->wm, WEST,  NULL, False);
-	   c->y = c->y - ( c->height - toolbar_win_offset(c));
-	 }
+       wm_update_layout(c->wm, c->output);
 
        /* destroy buttons so they get recreated ok */   
        client_buttons_delete_all(c);   
@@ -219,6 +218,8 @@ toolbar_client_hide(Client *c)
   client_set_state(c,IconicState);
   c->flags |= CLIENT_IS_MINIMIZED; 
 
+  wm_offsets_invalidate(w);
+
   c->ignore_unmap++;
   XUnmapWindow(w->dpy, c->window);
   
@@ -230,7 +231,8 @@ toolbar_client_hide(Client *c)
     {
       client_buttons_delete_all(c);   
   
-      c->x = wm_get_offsets_size(c->wm, WEST,  NULL, False);
+      c->x = w->outputs[c->output].x
+	+ wm_get_output_offsets_size(w, c->output, WEST, NULL, False);
   
       c->y = c->y + c->height 
                - theme_frame_defined_height_get(c->wm->mbtheme, FRAME_UTILITY_MIN);
@@ -242,7 +244,7 @@ toolbar_client_hide(Client *c)
   
   dbg("hiding toolbar y is now %i", c->y);
 
-  wm_update_layout(c->wm, c, c->height - toolbar_win_offset(c));
+  wm_update_layout(c->wm, c->output);
 }
 
 void
@@ -256,16 +258,9 @@ toolbar_client_destroy(Client *c)
                         dialog resizing/repositioning via restack
                         to ignore use  */
 
-  if (c->x == theme_frame_defined_width_get(w->mbtheme, FRAME_UTILITY_MAX )
-      || (c->flags & CLIENT_TITLE_HIDDEN_FLAG) )
-    {
-      wm_update_layout(w, c, c->height);
-    } 
-  else 
-    {
-      wm_update_layout(w, c, theme_frame_defined_height_get(w->mbtheme,
-							   FRAME_UTILITY_MIN));
-    }
+  wm_offsets_invalidate(w);
+
+  wm_update_layout(w, c->output);
   
   base_client_destroy(c);     
 }
@@ -40,6 +40,7 @@ toolbar_client_new(Wm *w, Window win)
   if (!c) return NULL;
 
   c->type = MBCLIENT_TYPE_DIALOG; 
+  stack_update_type(c);
    
   c->configure    = &toolbar_client_configure;
   c->reparent     = &toolbar_client_reparent;
@@ -51,6 +52,7 @@ toolbar_client_new(Wm *w, Window win)
 
   dialog_init_height = -1;
 
+  STATS_ROUND_TRIP();
   XGetTransientForHint(w->dpy, win, &trans_win);
 
   dbg("%s() checking trans hint\n", __func__);
@@ -96,8 +98,9 @@ toolbar_win_offset(Client *c)
 void
 toolbar_client_configure(Client *c)
 {
-  Wm     *w = c->wm;
-  Client *main_client = NULL;
+  Wm       *w = c->wm;
+  MBOutput *o = &w->outputs[c->output];
+  Client   *main_client = NULL;
 
   dbg("%s() called\n", __func__);
 
@@ -114,18 +117,19 @@ toolbar_client_configure(Client *c)
 	  
       if (app_client && (app_client->flags & CLIENT_FULLSCREEN_FLAG))
 	{
-	  c->x      = 0;
-	  c->y      = w->dpy_height - c->height;
-	  c->width  = w->dpy_width;
+	  c->x      = o->x;
+	  c->y      = o->y + o->height - c->height;
+	  c->width  = o->width;
 	  return;
 	}
     }
 
-  c->y = w->dpy_height - wm_get_offsets_size(w, SOUTH, c, True) - c->height;
-  c->x = wm_get_offsets_size(w, WEST,  NULL, False);
-  c->width = w->dpy_width
-    - wm_get_offsets_size(w, WEST,  NULL, False)
-    - wm_get_offsets_size(w, EAST,  NULL, False);
+  c->y = o->y + o->height - wm_get_offsets_size(w, SOUTH, c, True) 
+    - c->height;
+  c->x = o->x + wm_get_output_offsets_size(w, c->output, WEST, NULL, False);
+  c->width = o->width
+    - wm_get_output_offsets_size(w, c->output, WEST,  NULL, False)
+    - wm_get_output_offsets_size(w, c->output, EAST,  NULL, False);
 
   /*
    * Though not transient for app, there could be a fullscreened
@@ -136,9 +140,9 @@ toolbar_client_configure(Client *c)
     {
       if (main_client->flags & CLIENT_FULLSCREEN_FLAG)
 	{
-	  c->x      = 0;
-	  c->y      = w->dpy_height - c->height;
-	  c->width  = w->dpy_width;
+	  c->x      = o->x;
+	  c->y      = o->y + o->height - c->height;
+	  c->width  = o->width;
 	}
     }
 
@@ -163,6 +167,8 @@ toolbar_client_configure(Client *c)
 
 	  c->mapped = True; 	/* Hack Hack */
 	  c->type = MBCLIENT_TYPE_TOOLBAR; 
+	  stack_update_type(c); /* so stack_enumerate_type() finds us */
+	  wm_offsets_invalidate(w);
 
 	  dbg("%s() checking for available geom\n", __func__);
 
@@ -184,7 +190,9 @@ toolbar_client_configure(Client *c)
 	    }
 
 	  c->type = MBCLIENT_TYPE_DIALOG; 
+	  stack_update_type(c);
 	  c->mapped = tmp_mapped;
+	  wm_offsets_invalidate(w);
 	  
 	}
     }
@@ -254,6 +262,7 @@ toolbar_client_show(Client *c)
 	  /* Call this so, map of toolbar hopefully happens before
            * resize preventing potential flash of desktop win. 
 	  */
+	  STATS_ROUND_TRIP();
 	  XSync(w->dpy, False);
 	  
 	  if (app_client &&
@@ -0,0 +1,113 @@
+/* 
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "trace.h"
+
+#include <time.h>
+
+/* Only the main loop records, the signal handler just raises a flag,
+ * so the ring needs no locking. 
+ */
+static MBTraceEvent  trace_ring[TRACE_RING_SIZE];
+static unsigned long trace_head = 0; /* total events ever recorded */
+
+volatile sig_atomic_t trace_dump_requested = 0;
+
+MBTraceTime
+trace_now(void)
+{
+  static MBTraceTime trace_epoch = 0;
+  struct timespec    ts;
+  MBTraceTime        now;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  now = ((MBTraceTime)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+
+  if (trace_epoch == 0)
+    trace_epoch = now;
+
+  return now - trace_epoch;
+}
+
+/* Returns the span duration, so callers can feed their stats too */
+unsigned long
+trace_record(const char *name, MBTraceTime start, int arg)
+{
+  MBTraceEvent *ev = &trace_ring[trace_head++ & (TRACE_RING_SIZE-1)];
+
+  ev->name = name;
+  ev->ts   = start;
+  ev->dur  = (unsigned long)(trace_now() - start);
+  ev->arg  = arg;
+
+  return ev->dur;
+}
+
+/* Dumps to $MB_TRACE_FILE or /tmp/matchbox-trace-<pid>.json and 
+ * publishes where on the root window as _MB_TRACE_FILE.
+ */
+void
+trace_dump(Wm *w)
+{
+  char          *path, buf[256];
+  FILE          *fp;
+  unsigned long  i, first;
+  int            pid = getpid();
+
+  trace_dump_requested = 0;
+
+  if ((path = getenv("MB_TRACE_FILE")) == NULL)
+    {
+      snprintf(buf, sizeof(buf), "/tmp/matchbox-trace-%i.json", pid);
+      path = buf;
+    }
+
+  if ((fp = fopen(path, "w")) == NULL)
+    {
+      fprintf(stderr, "matchbox: unable to write trace to %s\n", path);
+      return;
+    }
+
+  first = (trace_head > TRACE_RING_SIZE) ? trace_head - TRACE_RING_SIZE : 0;
+
+  fprintf(fp, "{\"traceEvents\":[\n");
+
+  for (i = first; i < trace_head; i++)
+    {
+      MBTraceEvent *ev = &trace_ring[i & (TRACE_RING_SIZE-1)];
+
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%lu,"
+	      "\"pid\":%i,\"tid\":1", 
+	      (i == first) ? "" : ",\n", ev->name, 
+	      (unsigned long long)ev->ts, ev->dur, pid);
+
+      if (ev->arg != -1)
+	fprintf(fp, ",\"args\":{\"arg\":%i}", ev->arg);
+
+      fprintf(fp, "}");
+    }
+
+  fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(fp);
+
+  dbg("%s() wrote %lu events to %s\n", __func__, trace_head - first, path);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_TRACE_FILE], XA_STRING, 8,
+		  PropModeReplace, (unsigned char*)path, strlen(path));
+}
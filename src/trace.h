@@ -0,0 +1,65 @@
+/* 
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MB_TRACE_H_
+#define _MB_TRACE_H_
+
+#include <signal.h>
+#include <stdint.h>
+
+#include "structs.h"
+
+/* Always on span tracing for the hot paths. A span is just
+ *
+ *   MBTraceTime start = trace_now();
+ *   ...
+ *   trace_record("name", start, arg);
+ *
+ * recorded into a fixed ring, oldest entries overwritten. trace_dump()
+ * writes the ring out as chrome://tracing / Perfetto JSON.
+ */
+
+#define TRACE_RING_SIZE 4096	/* must be a power of 2 */
+
+/* Microseconds on CLOCK_MONOTONIC since the first trace_now() call, 
+ * wide enough not to wrap and unaffected by the wall clock being set.
+ */
+typedef uint64_t MBTraceTime;
+
+typedef struct MBTraceEvent
+{
+  const char    *name;		/* static strings only */
+  MBTraceTime    ts;		/* usecs */
+  unsigned long  dur;
+  int            arg;		/* -1 for none */
+
+} MBTraceEvent;
+
+/* Set from sig_handler() on SIGUSR1, checked by the event loop */
+extern volatile sig_atomic_t trace_dump_requested;
+
+MBTraceTime
+trace_now(void);
+
+unsigned long
+trace_record(const char *name, MBTraceTime start, int arg);
+
+void
+trace_dump(Wm *w);
+
+#endif
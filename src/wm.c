@@ -21,6 +21,8 @@
 #include "wm.h"
 #include "config.h"
 
+#include <poll.h>
+
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h> /* Used to *really* hide cursor */
 #endif
@@ -37,8 +39,6 @@ static void wm_xsettings_notify_cb (const char       *name,
 #endif
 
 #ifdef USE_LIBSN
-static void wm_sn_timeout_check (Wm *w);
-
 static void wm_sn_exec(Wm *w, char* name, char* bin_name, char *desc);
 
 static void wm_sn_monitor_event_func (SnMonitorEvent *event,
@@ -46,11 +46,19 @@ static void wm_sn_monitor_event_func (SnMonitorEvent *event,
 
 static void wm_sn_cycle_update_root_prop(Wm *w);
 
-static SnCycle *wm_sn_cycle_new(Wm *w, const char *bin_name);
+static SnCycle *wm_sn_cycle_find_bin(Wm *w, const char *bin_name, 
+				     Bool want_xid);
+#endif
 
-static void wm_sn_cycle_add(Wm *w, const char *bin_name);
+#ifdef HAVE_XRANDR
+static void wm_randr_init(Wm *w);
+static void wm_randr_handle_event(Wm *w, XRRScreenChangeNotifyEvent *e);
+static void wm_randr_handle_notify(Wm *w);
 #endif
 
+static void wm_outputs_update(Wm *w);
+static void wm_handle_screen_resize(Wm *w, int width, int height);
+
 Wm*
 wm_new(int argc, char **argv)
 {
@@ -64,6 +72,13 @@ wm_new(int argc, char **argv)
 
    w->flags = STARTUP_FLAG;
 
+   /* Kept for restarting with, copied as Xrm strips the options out */
+   w->argv = malloc(sizeof(char*) * (argc + 1));
+   memcpy(w->argv, argv, sizeof(char*) * argc);
+   w->argv[argc] = NULL;
+
+   stats_init(w);
+
    wm_load_config(w, &argc, argv);
    
    XSetErrorHandler(handle_xerror); 
@@ -91,8 +106,17 @@ wm_new(int argc, char **argv)
 
    XSelectInput(w->dpy, w->root, sattr.event_mask);
 
+#ifdef HAVE_XRANDR
+   wm_randr_init(w);
+#endif
+
+   wm_outputs_update(w);
+
+   record_init(w);
+
    /* Use this 'dull' color for 'base' window backgrounds and such. 
       'Appears' to actually reduce flicker                           */
+   STATS_ROUND_TRIP();
    XAllocNamedColor(w->dpy, 
 		    DefaultColormap(w->dpy, w->screen), 
 		    "grey", 
@@ -104,6 +128,9 @@ wm_new(int argc, char **argv)
    w->gconf_client  = gconf_client_get_default();
    w->gconf_context = g_main_context_default ();
 
+   /* We poll its fds ourselves, see get_xevent() */
+   g_main_context_acquire (w->gconf_context);
+
    if (w->gconf_client != NULL)
      {
        gconf_client_add_dir(w->gconf_client,
@@ -708,8 +735,15 @@ wm_init_existing(Wm *w)
    ewmh_update_lists(w); 
    ewmh_update_desktop_hint(w);
 
+   /* Restarted, most if not all can be had back without asking */
+   restart_restore(w);
+
+   STATS_ROUND_TRIP();
    XQueryTree(w->dpy, w->root, &dummyw1, &dummyw2, &wins, &nwins);
    for (i = 0; i < nwins; i++) {
+      if (wm_find_client(w, wins[i], WINDOW) != NULL)
+	continue;
+      STATS_ROUND_TRIP();
       XGetWindowAttributes(w->dpy, wins[i], &attr);
       if (!attr.override_redirect && attr.map_state == IsViewable)
       {
@@ -749,252 +783,333 @@ wm_find_client(Wm *w, Window win, int mode)
     return NULL;
 }
 
-/* Grab an X Event - block but With a timeout */
+/* Grab an X Event. Sleeps in poll() on the X connection and everything
+ * else needing watching until an event arrives or the next timer is 
+ * due, servicing the other sources here. Returns False without an event.
+ */
 static Bool
-get_xevent_timed(Wm             *w,
-		 XEvent         *event_return, 
-		 struct timeval *tv)
+get_xevent(Wm *w, XEvent *event_return)
 {
-  if (tv->tv_usec == 0 && tv->tv_sec == 0)
+  static struct pollfd *fds = NULL;
+  static int            fds_size = 0;
+  int                   n_fds = 0, timeout, n_extra = 0;
+#ifdef USE_GCONF
+  static GPollFD       *gfds = NULL;
+  static int            gfds_size = 0;
+  gint                  max_prio = 0, g_timeout = -1, n_gfds = 0;
+  int                   g_first = 0, i;
+#endif
+#ifdef USE_SM
+  int                   ice_idx = -1;
+#endif
+#ifdef USE_THEME_THREAD
+  int                   theme_idx = -1;
+#endif
+
+  /* Also flushes the output buffer */
+  if (XPending(w->dpy))
     {
-#ifndef USE_SM
       XNextEvent(w->dpy, event_return);
       return True;
-#else
-      tv->tv_sec = 5;
-#endif
     }
 
-  XFlush(w->dpy);
+  if ((timeout = timer_next_timeout(w)) == 0)
+    return False;
 
-  if (XPending(w->dpy) == 0) 
+#ifdef USE_GCONF
+  if (w->gconf_client != NULL)
     {
-      int fd = ConnectionNumber(w->dpy);
-      fd_set readset;
-      FD_ZERO(&readset);
-      FD_SET(fd, &readset);
+      g_main_context_prepare (w->gconf_context, &max_prio);
 
-#ifdef USE_SM
-      if (w->sm_ice_fd != -1)
+      while ((n_gfds = g_main_context_query (w->gconf_context, max_prio, 
+					     &g_timeout, gfds, gfds_size)) 
+	     > gfds_size)
 	{
-	  FD_SET(w->sm_ice_fd, &readset);
-	  if (w->sm_ice_fd > fd) 
-	    fd = w->sm_ice_fd; 	/* for +1 below */
+	  gfds_size = n_gfds;
+	  gfds      = realloc(gfds, gfds_size * sizeof(GPollFD));
 	}
+
+      if (g_timeout >= 0 && (timeout < 0 || g_timeout < timeout))
+	timeout = g_timeout;
+
+      n_extra = n_gfds;
+    }
 #endif
-      if (select(fd+1, &readset, NULL, NULL, tv) == 0) 
-	{
-	  return False;
-	}
-      else 
-	{
+
+  if (fds_size < n_extra + 3)
+    {
+      fds_size = n_extra + 3;
+      fds      = realloc(fds, fds_size * sizeof(struct pollfd));
+    }
+
+  fds[n_fds].fd     = ConnectionNumber(w->dpy);
+  fds[n_fds].events = POLLIN;
+  n_fds++;
+
 #ifdef USE_SM
-	  if ( w->sm_ice_fd != -1 && FD_ISSET(w->sm_ice_fd, &readset) )
-	    {
-	      sm_process_event(w);
-	      return False;
-	    }
+  if (w->sm_ice_fd != -1)
+    {
+      ice_idx = n_fds++;
+      fds[ice_idx].fd     = w->sm_ice_fd;
+      fds[ice_idx].events = POLLIN;
+    }
 #endif
-	  XNextEvent(w->dpy, event_return);
-	  return True;
-      }
-    } else {
+
+#ifdef USE_THEME_THREAD
+  if (w->theme_loader != NULL)
+    {
+      theme_idx = n_fds++;
+      fds[theme_idx].fd     = w->theme_loader->pipe_fds[0];
+      fds[theme_idx].events = POLLIN;
+    }
+#endif
+
+#ifdef USE_GCONF
+  g_first = n_fds;
+  for (i = 0; i < n_gfds; i++, n_fds++)
+    {
+      fds[n_fds].fd     = gfds[i].fd;
+      fds[n_fds].events = gfds[i].events;
+    }
+#endif
+
+  /* Signals ( trace dump, terminate ) just get us back round the loop */
+  if (poll(fds, n_fds, timeout) <= 0)
+    {
+      int j;
+      for (j = 0; j < n_fds; j++)
+	fds[j].revents = 0;
+    }
+
+#ifdef USE_GCONF
+  if (w->gconf_client != NULL)
+    {
+      for (i = 0; i < n_gfds; i++)
+	gfds[i].revents = fds[g_first + i].revents;
+
+      if (g_main_context_check (w->gconf_context, max_prio, gfds, n_gfds))
+	g_main_context_dispatch (w->gconf_context);
+    }
+#endif
+
+#ifdef USE_SM
+  if (ice_idx != -1 && fds[ice_idx].revents)
+    sm_process_event(w);
+#endif
+
+#ifdef USE_THEME_THREAD
+  if (theme_idx != -1 && fds[theme_idx].revents)
+    mbtheme_switch_complete(w);
+#endif
+
+  if (fds[0].revents && XEventsQueued(w->dpy, QueuedAfterReading))
+    {
       XNextEvent(w->dpy, event_return);
       return True;
     }
+
+  return False;
 }
 
 #ifdef USE_COMPOSITE
 
 /*  For the compositing engine we need to track overide redirect  
- *  windows so the compositor can paint them. 
- *
- *  What we do is make a 'lightweight' client object. 
- *
- *  TODO: base_client_new() should really be able to do this. 
- *        and avoid any extra code. 
+ *  windows so the compositor can paint them, see 
+ *  comp_engine_override_add(). Managed windows map via MapRequest, 
+ *  so anything else is skipped without going to the server.
  */
 void 
-wm_handle_map_notify(Wm *w, Window win)
+wm_handle_map_notify(Wm *w, XMapEvent *e)
 {
   XWindowAttributes attr;
-  Client *new_client = NULL;
 
-  /* Do we already have it ? */
-  if (wm_find_client(w, win, WINDOW)) return;
-  if (wm_find_client(w, win, FRAME)) return;
+  if (!e->override_redirect || !w->have_comp_engine) return;
+
+  /* Do we already have it ? ( frames are override redirect ) */
+  if (comp_engine_override_find(w, e->window)) return;
+  if (wm_find_client(w, e->window, FRAME)) return;
+  if (wm_find_client(w, e->window, WINDOW)) return;
 
   dbg("%s() called for unknown window\n", __func__);
 
   misc_trap_xerrors();
 
-  XGetWindowAttributes(w->dpy, win, &attr);
+  STATS_ROUND_TRIP();
+  XGetWindowAttributes(w->dpy, e->window, &attr);
 
   if (misc_untrap_xerrors()) return; /* safety on */
 
   if (attr.class == InputOnly)
     return;
 
-  if (attr.override_redirect)
-    {
-      dbg("%s() making new overide redirect window\n", __func__);
-
-      new_client = malloc(sizeof(Client));
-      memset(new_client, 0, sizeof(Client));
-
-      new_client->x      = attr.x;
-      new_client->y      = attr.y;
-      new_client->width  = attr.width;
-      new_client->height = attr.height;
-      new_client->visual = attr.visual;
-      
-      new_client->want_shadow = True;
-
-      new_client->type   = MBCLIENT_TYPE_OVERRIDE;
-      new_client->frame  = new_client->window = win;
-      new_client->mapped = True;
-      new_client->name   = strdup("");
-      new_client->wm     = w;
-
-      /* Set up the 'methods' - expect to be overidden */
-      base_client_set_funcs(new_client);
-
-      stack_append_top(new_client);
-
-      dbg("%s() client frame is %li\n", __func__, new_client->frame);
-
-      comp_engine_client_init(w, new_client);
-
-      comp_engine_client_show(w, new_client);
-    }
-
+  comp_engine_override_add(w, e->window, &attr);
 }
 #endif
 
 /* Main event loop, timeout for polling stuff */
+/* Dispatches a single event, also used by the replay driver in record.c */
 void
-wm_event_loop(Wm* w)
+wm_handle_event(Wm *w, XEvent *ev)
 {
-  XEvent ev;
-  int hung_app_timer = 0;
-  struct timeval tvt;
+  /* A dialog drag takes the pointer events while it lasts */
+  if (w->drag_client && dialog_client_drag_handle_event(w, ev))
+    return;
 
-  for (;;) 
+  switch (ev->type) 
     {
-
-      tvt.tv_usec = 0;
-      tvt.tv_sec  = 0;
-
-#ifdef USE_LIBSN
-      if (w->sn_busy_cnt)
-	tvt.tv_sec = 1;
-#endif      
-
-#ifdef USE_GCONF
-      if (w->gconf_client != NULL)
-	tvt.tv_sec = 1;
-#endif
-
-#ifndef NO_PING
-      if (w->n_active_ping_clients)
-	tvt.tv_sec = 1;
-#endif
-
-      if (get_xevent_timed(w, &ev, &tvt))
-	{
-
-	  switch (ev.type) 
-	  {
 #ifdef USE_COMPOSITE
-	  case MapNotify:
-	    wm_handle_map_notify(w, ev.xmap.window);
-	    break;
+    case MapNotify:
+      wm_handle_map_notify(w, &ev->xmap);
+      break;
 #endif
-	  case ButtonPress:
-	    wm_handle_button_event(w, &ev.xbutton); break;
-	  case MapRequest:
-	    wm_handle_map_request(w, &ev.xmaprequest); break;
-	  case UnmapNotify:
-	    wm_handle_unmap_event(w, &ev.xunmap); break;
-	  case Expose:
-	    wm_handle_expose_event(w, &ev.xexpose); break;
-	  case DestroyNotify:
-	    wm_handle_destroy_event(w, &ev.xdestroywindow); break;
-	  case ConfigureRequest:
-	    wm_handle_configure_request(w, &ev.xconfigurerequest); break;
-	  case ConfigureNotify:
-	    wm_handle_configure_notify(w, &ev.xconfigure); break;
-	  case ClientMessage:
-	    wm_handle_client_message(w, &ev.xclient); break;
-	  case KeyPress:
-	    wm_handle_keypress(w, &ev.xkey); break;
-	  case PropertyNotify:
-	    wm_handle_property_change(w, &ev.xproperty); break;
-	  case GravityNotify:
-	    dbg("**** got gravity event ***"); break;
+    case ButtonPress:
+      wm_handle_button_event(w, &ev->xbutton); break;
+    case MapRequest:
+      wm_handle_map_request(w, &ev->xmaprequest); break;
+    case UnmapNotify:
+      wm_handle_unmap_event(w, &ev->xunmap); break;
+    case Expose:
+      wm_handle_expose_event(w, &ev->xexpose); break;
+    case DestroyNotify:
+      wm_handle_destroy_event(w, &ev->xdestroywindow); break;
+    case ConfigureRequest:
+      wm_handle_configure_request(w, &ev->xconfigurerequest); break;
+    case ConfigureNotify:
+      wm_handle_configure_notify(w, &ev->xconfigure); break;
+    case ClientMessage:
+      wm_handle_client_message(w, &ev->xclient); break;
+    case KeyPress:
+      {
+	MBTraceTime   key_start = trace_now();
+	wm_handle_keypress(w, &ev->xkey); 
+	trace_record("wm_handle_keypress", key_start, ev->xkey.keycode);
+      }
+      break;
+    case PropertyNotify:
+      wm_handle_property_change(w, &ev->xproperty); break;
+    case GravityNotify:
+      dbg("**** got gravity event ***"); break;
 #ifndef NO_KBD
-	  case MappingNotify:
-	    dbg("%s() got MappingNotify\n", __func__);
-	    XRefreshKeyboardMapping(&ev.xmapping);
-	    break;
+    case MappingNotify:
+      dbg("%s() got MappingNotify\n", __func__);
+      XRefreshKeyboardMapping(&ev->xmapping);
+      /* Modifier masks are baked into the entries so need a full 
+       * reload, keycode changes just need the table rebuilt. 
+       */
+      if (ev->xmapping.request == MappingModifier)
+	keys_reinit(w);
+      else if (ev->xmapping.request == MappingKeyboard)
+	keys_remap(w);
+      break;
 #endif
-	  default:
-	    dbg("%s() ignoring event->type : %d\n", __func__, ev.type);
-	    break;
-	  }
+    default:
+      dbg("%s() ignoring event->type : %d\n", __func__, ev->type);
+      break;
+    }
 
-	comp_engine_handle_events(w, &ev);
+  comp_engine_handle_events(w, ev);
+
+#ifdef HAVE_XRANDR
+  if (w->have_randr 
+      && ev->type == w->randr_event_base + RRScreenChangeNotify)
+    wm_randr_handle_event(w, (XRRScreenChangeNotifyEvent*)ev);
+
+  /* A monitor moved, came or went within the same screen size */
+  if (w->have_randr 
+      && ev->type == w->randr_event_base + RRNotify)
+    wm_randr_handle_notify(w);
+#endif
 
 #ifdef USE_XSYNC
-     if (w->have_xsync
-	 && ev.type == w->sync_event_base + XSyncAlarmNotify)
-	{
-	  dbg("%s() got ewmh_sync alarm notify\n", __func__);
-	  ewmh_sync_handle_event(w, (XSyncAlarmNotifyEvent*)&ev);
-	}
+  if (w->have_xsync
+      && ev->type == w->sync_event_base + XSyncAlarmNotify)
+    {
+      dbg("%s() got ewmh_sync alarm notify\n", __func__);
+      ewmh_sync_handle_event(w, (XSyncAlarmNotifyEvent*)ev);
+    }
 #endif
 
 #ifdef USE_XSETTINGS
-	if (w->xsettings_client != NULL)
-	  xsettings_client_process_event(w->xsettings_client, &ev);
+  if (w->xsettings_client != NULL)
+    xsettings_client_process_event(w->xsettings_client, ev);
 #endif
 
 #ifdef USE_LIBSN
-	sn_display_process_event (w->sn_display, &ev);
+  sn_display_process_event (w->sn_display, ev);
 #endif
+}
+
+/* Work batched up while handling events, done once the event is through */
+void
+wm_flush_pending(Wm *w)
+{
+  /* Move and resize anything relayed out, before painting it */
+  if (w->layout_queue)
+    client_layout_queue_flush(w);
+
+  /* Paint any decorations dirtied handling this event */
+  if (w->decor_queue)
+    client_decor_queue_flush(w);
 
-      } else {
+  /* Panels and toolbars settled, tell clients the space left */
+  if (w->work_area_dirty)
+    ewmh_update_rects(w);
 
-	/* No X event poll checks here */
 #ifdef USE_LIBSN
-	if (w->sn_busy_cnt)
-	    wm_sn_timeout_check (w);
-#endif      
+  /* A burst of launches only rewrites the props once */
+  if (w->sn_props_dirty)
+    wm_sn_cycle_update_root_prop(w);
+#endif
 
-#ifdef USE_GCONF
-	if (w->gconf_client != NULL)
-	  g_main_context_iteration (w->gconf_context, FALSE);
+#ifdef USE_COMPOSITE
+  if (w->all_damage)
+    {
+      comp_engine_render(w, w->all_damage);
+      XFixesDestroyRegion (w->dpy, w->all_damage);
+      w->all_damage = None;
+    }
 #endif
+}
+
+void
+wm_event_loop(Wm* w)
+{
+  XEvent ev;
 
+  /* Anything queued managing existing windows */
+  wm_flush_pending(w);
 
-#ifndef NO_PING
-	/* check for hung apps every PING_CHECK_FREQ seconds */
-	if (++hung_app_timer >= PING_CHECK_FREQ && w->n_active_ping_clients)
-	  {
-	    hung_app_timer = 0;
-	    ewmh_hung_app_check(w);
-	  }
-#endif
-         }
+  for (;;) 
+    {
+      if (get_xevent(w, &ev))
+	{
+	  MBTraceTime   trace_start = trace_now();
 
-#ifdef USE_COMPOSITE
-      if (w->all_damage)
-      	{
-	  comp_engine_render(w, w->all_damage);
-	  XFixesDestroyRegion (w->dpy, w->all_damage);
-	  w->all_damage = None;
+	  if (record_fp != NULL)
+	    record_event(w, &ev);
+
+	  wm_handle_event(w, &ev);
+
+	  stats_hist_add(w->stats.dispatch_hist,
+			 trace_record("wm_event_loop:dispatch", 
+				      trace_start, ev.type));
+
+	  if (ev.type < LASTEvent)
+	    w->stats.events[ev.type]++;
+	  else
+	    w->stats.events_other++;
 	}
-#endif
+
+      /* Sync timeouts, hung app pings, startup notification expiry.. */
+      timer_run_expired(w);
+
+      if (trace_dump_requested)
+	trace_dump(w);
+
+      if (restart_requested)
+	restart_exec(w);
+
+      wm_flush_pending(w);
     }
 
 }
@@ -1072,13 +1187,13 @@ void
 wm_handle_keypress(Wm *w, XKeyEvent *e)
 {
 #ifndef NO_KBD
-  MBConfigKbdEntry *entry =  w->config->kb->entrys;
+  MBConfigKbdEntry *entry = NULL;
   Client *p = NULL;
   int state = e->state;
 
 #ifdef USE_LIBSN
   Bool found = False;
-  SnCycle *current_cycle = w->sn_cycles;
+  SnCycle *current_cycle = NULL;
 #endif 
 
    dbg("%s() called\n", __func__ );
@@ -1099,10 +1214,12 @@ wm_handle_keypress(Wm *w, XKeyEvent *e)
    /* Don't care about Caps/Num/Scroll lock here */
    state &= ~w->config->kb->lock_mask;
 
+   /* Only entries grabbed on this keycode */
+   entry = keys_lookup(w, e->keycode);
+
    while (entry != NULL)
      {
-       if (XKeycodeToKeysym(w->dpy, e->keycode, entry->index) == entry->key
-	   && state == entry->ModifierMask )
+       if (state == entry->ModifierMask)
 	{
 	  switch (entry->action) 
 	    {
@@ -1112,28 +1229,18 @@ wm_handle_keypress(Wm *w, XKeyEvent *e)
 #ifdef USE_LIBSN
 	    case KEY_ACTN_EXEC_SINGLE:
 	      
-	      if (current_cycle != NULL)
+	      if (wm_sn_cycle_find_bin(w, entry->sdata, False))
 		{
-		  while(current_cycle != NULL)
-		    {
-		      dbg("%s(): checking %s\n", __func__, 
-			  current_cycle->bin_name);
-		      if (!strcmp(current_cycle->bin_name, entry->sdata)
-			  && current_cycle->xid == None)
-			{
-			  dbg("%s() %s is already starting\n", __func__,
-			      entry->sdata);
-			  return;	/* entry is in process of starting  */
-			}
-		      current_cycle = current_cycle->next;
-		    }
+		  dbg("%s() %s is already starting\n", __func__,
+		      entry->sdata);
+		  return;	/* entry is in process of starting  */
 		}
 
-	      current_cycle = w->sn_cycles;
-
 	      if (!stack_empty(w))
 		{
-		  while(current_cycle != NULL)
+		  current_cycle = wm_sn_cycle_find_bin(w, entry->sdata, True);
+
+		  while (current_cycle != NULL)
 		    {
 		      if (current_cycle->xid != None
 			  && !strcmp(current_cycle->bin_name, entry->sdata))
@@ -1145,7 +1252,7 @@ wm_handle_keypress(Wm *w, XKeyEvent *e)
 			      found = True;
 			    }
 			}
-		      current_cycle = current_cycle->next;
+		      current_cycle = current_cycle->bin_next;
 		    }
 		}
 
@@ -1184,173 +1291,466 @@ wm_handle_keypress(Wm *w, XKeyEvent *e)
 	      break;
 	    }
 	}
-      entry = entry->next_entry;
+      entry = entry->next_keycode_entry;
     }
 #endif
 }
 
 
-void
-wm_handle_configure_notify(Wm *w, XConfigureEvent *e)
+/* Builds w->outputs from the lit RandR CRTCs, clones folded. Without
+ * RandR ( or with nothing lit ) theres just the one, the whole screen.
+ * The output at the screen origin goes first as the primary, its what
+ * _NET_WORKAREA describes. Any old list is the callers to free.
+ */
+static void
+wm_outputs_update(Wm *w)
 {
-   Client *p, *cdesktop = NULL;
-   Client *ctitledock   = NULL;
-   int     height_diff, width_diff;
-   
-   dbg("%s() called\n", __func__);
+  MBOutput *outputs = NULL;
+  int       n = 0, i;
 
-   if (e->window == w->root) /* screen rotation */
-   {
-     /* TODO:
-      * It would probably be cleaner ( though add a dep )
-      * to use randr here to get more info about the rotation     
-      * ( eg. direction )
-      */
-      dbg("%s() configure notify event called on root", __func__ );
-      if (e->width  != w->dpy_width ||
-	  e->height != w->dpy_height)
-      {
-	height_diff   = e->height - w->dpy_height;
-	width_diff    = e->width  - w->dpy_width;
-	w->dpy_width  = e->width; 
-	w->dpy_height = e->height;
-	
-	if (stack_empty(w)) return;
-	
-	XGrabServer(w->dpy);
+#ifdef HAVE_XRANDR
+  if (w->have_randr)
+    {
+      XRRScreenResources *res;
+      XRRCrtcInfo        *ci;
+      int                 j;
+
+      /* The plain call makes the server poll every connector first */
+      STATS_ROUND_TRIP();
+      if (w->randr_have_current)
+	res = XRRGetScreenResourcesCurrent(w->dpy, w->root);
+      else
+	res = XRRGetScreenResources(w->dpy, w->root);
 
-	/* Clear all caches so everything gets redrawn ok */
-	theme_img_cache_clear_all( w->mbtheme );
+      if (res != NULL)
+	{
+	  if (res->ncrtc)
+	    outputs = malloc(sizeof(MBOutput) * res->ncrtc);
 
-	theme_pixmap_cache_clear_all( w->mbtheme );
+	  for (i = 0; i < res->ncrtc; i++)
+	    {
+	      STATS_ROUND_TRIP();
+	      if ((ci = XRRGetCrtcInfo(w->dpy, res, res->crtcs[i])) == NULL)
+		continue;
 
+	      if (ci->mode != None && ci->noutput > 0
+		  && ci->width > 0 && ci->height > 0)
+		{
+		  for (j = 0; j < n; j++)
+		    if (outputs[j].x == ci->x && outputs[j].y == ci->y
+			&& outputs[j].width == ci->width 
+			&& outputs[j].height == ci->height)
+		      break;
 
-	stack_enumerate(w, p)
-	 {
-	   switch (p->type)
-	     {
-	     case MBCLIENT_TYPE_APP :
-	       p->width += width_diff;
-	       p->height += height_diff;
-	       p->have_cache = False;
-	       
-	       break;
-	     case MBCLIENT_TYPE_TOOLBAR :
-	       p->width += width_diff;
-	       p->y += height_diff;
-	       break;
-	     case MBCLIENT_TYPE_PANEL :
-	       if (p->flags & CLIENT_DOCK_WEST)
-		 {
-		   p->height += height_diff;
-		 }
-	       else if (p->flags & CLIENT_DOCK_EAST)
-		 {
-		   p->height += height_diff;
-		   p->x      += width_diff;
-		 }
-	       else if (p->flags & CLIENT_DOCK_SOUTH)
-		 {
-		   p->width += width_diff;
-		   p->y += height_diff;
-		 }
-	       else if (p->flags & CLIENT_DOCK_NORTH)
-		 {
-		   p->width += width_diff;
-		 }
-	       else if (p->flags & CLIENT_DOCK_TITLEBAR)
-		 {
-		   ctitledock = p;
-		 }
-	       break;
-	     case MBCLIENT_TYPE_DIALOG :
-	       /* 
-		*  TODO:
-                *  show check if the dialog is centered and make sure
-                *  if gets recentered on rotation ?
-		*  
-		*  - Change x,y,width?,height? rotation size change factors ?
-                *    - above may 'just work'
-                *  - Set x=0, y=0 so centering is forced
-		*    - set a flag is dialog if initally centered ?
-	        */
-	       dialog_client_configure(p);
-	       break;
-	     case MBCLIENT_TYPE_DESKTOP:
-	       p->width += width_diff;
-	       p->height += height_diff;
-	       cdesktop = p;
-	       break;
-	     default:
-	       break;
-	     }
+		  if (j == n)
+		    {
+		      memset(&outputs[n], 0, sizeof(MBOutput));
+		      outputs[n].x      = ci->x;
+		      outputs[n].y      = ci->y;
+		      outputs[n].width  = ci->width;
+		      outputs[n].height = ci->height;
+		      n++;
+		    }
+		}
 
-	   /* we leave desktop/titlebar dock till last */
-	   if (p != cdesktop && p != ctitledock) 	
-	     {
-	       p->move_resize(p);
-	       /* destroy buttons so they get reposioned */
-	       client_buttons_delete_all(p);
-	       p->redraw(p, False);
-	       client_deliver_config(p);
-	     }
+	      XRRFreeCrtcInfo(ci);
+	    }
 
-	   comp_engine_client_repair (w, p);
+	  XRRFreeScreenResources(res);
+	}
+    }
+#endif
 
-	 }
+  if (n == 0)
+    {
+      if (outputs) free(outputs);
 
+      outputs = malloc(sizeof(MBOutput));
+      memset(outputs, 0, sizeof(MBOutput));
 
-	 if (cdesktop)
-	   {
-	     cdesktop->move_resize(cdesktop);
-	     client_deliver_config(cdesktop);
-	   }
+      outputs[0].width  = w->dpy_width;
+      outputs[0].height = w->dpy_height;
+      n = 1;
+    }
 
-	 if (ctitledock)
-	   {
-	     dockbar_client_configure(ctitledock);
-	     ctitledock->move_resize(ctitledock);
-	     client_deliver_config(ctitledock);
-	   }
+  for (i = 1; i < n; i++)
+    if (outputs[i].x == 0 && outputs[i].y == 0)
+      {
+	MBOutput tmp = outputs[0];
+	outputs[0] = outputs[i];
+	outputs[i] = tmp;
+	break;
+      }
 
-	 comp_engine_destroy_root_buffer(w);
-	 comp_engine_render(w, None);
+  for (i = 0; i < n; i++)
+    dbg("%s() output %i is %ix%i+%i+%i\n", __func__, i, 
+	outputs[i].width, outputs[i].height, outputs[i].x, outputs[i].y);
 
-	 ewmh_update_rects(w);
+  w->outputs   = outputs;
+  w->n_outputs = n;
 
-	 wm_activate_client(wm_get_visible_main_client(w));
+  wm_offsets_invalidate(w);
+}
 
-	 XSync(w->dpy, False);
+/* Output a point is on, or nearest to if its off them all */
+int
+wm_output_at(Wm *w, int x, int y)
+{
+  int i, dx, dy, best = 0, best_dist = -1;
 
-	 XUngrabServer(w->dpy);
-      }
-   }
+  for (i = 0; i < w->n_outputs; i++)
+    {
+      MBOutput *o = &w->outputs[i];
+
+      dx = dy = 0;
+
+      if (x < o->x)
+	dx = o->x - x;
+      else if (x >= o->x + o->width)
+	dx = x - (o->x + o->width - 1);
+
+      if (y < o->y)
+	dy = o->y - y;
+      else if (y >= o->y + o->height)
+	dy = y - (o->y + o->height - 1);
+
+      if (dx == 0 && dy == 0)
+	return i;
+
+      if (best_dist < 0 || dx + dy < best_dist)
+	{
+	  best      = i;
+	  best_dist = dx + dy;
+	}
+    }
+
+  return best;
 }
 
+static Bool
+wm_output_listed(MBOutput *o, MBOutput *outputs, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (outputs[i].x == o->x && outputs[i].y == o->y
+	&& outputs[i].width == o->width && outputs[i].height == o->height)
+      return True;
 
-void
-wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
+  return False;
+}
+
+/* The screen or its outputs changed, ie rotated or a monitor came or 
+ * went. Each client moves to whatever replaced its output and is
+ * adjusted by the difference, clients on outputs left alone aren't
+ * touched. All are queued, so it's moved in one go once the event is
+ * handled. Theme caches check their own sizes so are left, decorations
+ * that come out the same size are just reused.
+ */
+static void
+wm_handle_screen_resize(Wm *w, int width, int height)
 {
-   Client         *c = wm_find_client(w, e->window, WINDOW);
-   XWindowChanges  xwc;
+   Client   *p, *cdesktop = NULL;
+   Client   *ctitledock   = NULL;
+   MBOutput *old_outputs  = w->outputs, *from, *to;
+   int      *output_map;
+   int       n_old_outputs = w->n_outputs, i;
+   int       height_diff, width_diff, dx, dy, dw, dh;
+   Bool      outputs_changed = False;
+
+   height_diff   = height - w->dpy_height;
+   width_diff    = width  - w->dpy_width;
+   w->dpy_width  = width; 
+   w->dpy_height = height;
+
+   wm_outputs_update(w);
+
+   if (w->n_outputs != n_old_outputs)
+     outputs_changed = True;
+   else
+     for (i = 0; i < n_old_outputs; i++)
+       if (!wm_output_listed(&old_outputs[i], w->outputs, w->n_outputs))
+	 outputs_changed = True;
 
-   unsigned long   value_mask = e->value_mask;
-   int             req_x      = e->x;
-   int             req_y      = e->y;
-   int             req_w      = e->width;
-   int             req_h      = e->height;
+   if (!outputs_changed && !width_diff && !height_diff)
+     {
+       free(w->outputs);
+       w->outputs = old_outputs;
+       return;
+     }
 
-   Bool            want_activate = False;
+   dbg("%s() %ix%i -> %ix%i, %i outputs -> %i\n", __func__, 
+       width - width_diff, height - height_diff, width, height, 
+       n_old_outputs, w->n_outputs);
 
-   /* TODO: Double check ICCCM on this code. 
-    *       see http://tronche.com/gui/x/icccm/sec-4.html#s-4.1.5
-    *       Only send synthetic configure notify on no change.
-    *
-    */  
+   /* Whatever now covers the old middle takes over its clients */
+   output_map = malloc(sizeof(int) * n_old_outputs);
 
-   if (!c ) 
+   for (i = 0; i < n_old_outputs; i++)
+     output_map[i] = wm_output_at(w, 
+				  old_outputs[i].x + old_outputs[i].width/2,
+				  old_outputs[i].y + old_outputs[i].height/2);
+
+   stack_enumerate(w, p)
      {
-       /* Dont know any thing about this window. Let it have what it 
+       from = &old_outputs[p->output];
+       p->output = output_map[p->output];
+       to   = &w->outputs[p->output];
+
+       dx = to->x - from->x;
+       dy = to->y - from->y;
+       dw = to->width  - from->width;
+       dh = to->height - from->height;
+
+       if (p->type == MBCLIENT_TYPE_DESKTOP)
+	 {
+	   if (!width_diff && !height_diff)
+	     continue;
+	 }
+       else if (!dx && !dy && !dw && !dh)
+	 continue;
+
+       switch (p->type)
+	 {
+	 case MBCLIENT_TYPE_APP :
+	   p->x += dx;
+	   p->y += dy;
+	   p->width += dw;
+	   p->height += dh;
+	   p->have_cache = False;
+	   
+	   break;
+	 case MBCLIENT_TYPE_TOOLBAR :
+	   p->x += dx;
+	   p->width += dw;
+	   p->y += dy + dh;
+	   break;
+	 case MBCLIENT_TYPE_PANEL :
+	   if (p->flags & CLIENT_DOCK_WEST)
+	     {
+	       p->x      += dx;
+	       p->y      += dy;
+	       p->height += dh;
+	     }
+	   else if (p->flags & CLIENT_DOCK_EAST)
+	     {
+	       p->y      += dy;
+	       p->height += dh;
+	       p->x      += dx + dw;
+	     }
+	   else if (p->flags & CLIENT_DOCK_SOUTH)
+	     {
+	       p->x     += dx;
+	       p->width += dw;
+	       p->y     += dy + dh;
+	     }
+	   else if (p->flags & CLIENT_DOCK_NORTH)
+	     {
+	       p->x     += dx;
+	       p->y     += dy;
+	       p->width += dw;
+	     }
+	   else if (p->flags & CLIENT_DOCK_TITLEBAR)
+	     {
+	       ctitledock = p;
+	     }
+	   break;
+	 case MBCLIENT_TYPE_DIALOG :
+	   /* 
+	    *  TODO:
+	    *  show check if the dialog is centered and make sure
+	    *  if gets recentered on rotation ?
+	    *  
+	    *  - Change x,y,width?,height? rotation size change factors ?
+	    *    - above may 'just work'
+	    *  - Set x=0, y=0 so centering is forced
+	    *    - set a flag is dialog if initally centered ?
+	    */
+	   p->x += dx;
+	   p->y += dy;
+	   dialog_client_configure(p);
+	   break;
+	 case MBCLIENT_TYPE_DESKTOP:
+	   p->width += width_diff;
+	   p->height += height_diff;
+	   cdesktop = p;
+	   break;
+	 default:
+	   break;
+	 }
+
+       /* we leave desktop/titlebar dock till last */
+       if (p != cdesktop && p != ctitledock) 	
+	 {
+	   client_layout_queue(p);
+	   /* destroy buttons so they get reposioned */
+	   client_buttons_delete_all(p);
+	   client_decor_queue_redraw(p, DECOR_DIRTY_ALL);
+	 }
+
+       comp_engine_client_repair (w, p);
+     }
+
+   if (cdesktop)
+     client_layout_queue(cdesktop);
+
+   if (ctitledock)
+     {
+       dockbar_client_configure(ctitledock);
+       client_layout_queue(ctitledock);
+     }
+
+   if (width_diff || height_diff)
+     {
+       /* Reallocated at the new size by the next render */
+       comp_engine_destroy_root_buffer(w);
+       comp_engine_damage_all(w);
+     }
+   else
+     {
+       /* Just repaint the outputs that came, went or changed */
+       for (i = 0; i < n_old_outputs; i++)
+	 if (!wm_output_listed(&old_outputs[i], w->outputs, w->n_outputs))
+	   comp_engine_damage_rect(w, old_outputs[i].x, old_outputs[i].y,
+				   old_outputs[i].width, 
+				   old_outputs[i].height);
+
+       for (i = 0; i < w->n_outputs; i++)
+	 if (!wm_output_listed(&w->outputs[i], old_outputs, n_old_outputs))
+	   comp_engine_damage_rect(w, w->outputs[i].x, w->outputs[i].y,
+				   w->outputs[i].width, 
+				   w->outputs[i].height);
+     }
+
+   free(output_map);
+   free(old_outputs);
+
+   ewmh_update_rects(w);
+
+   if (!stack_empty(w))
+     wm_activate_client(wm_get_visible_main_client(w));
+}
+
+#ifdef HAVE_XRANDR
+
+static void
+wm_randr_init(Wm *w)
+{
+  int error_base, major = 0, minor = 0;
+
+  w->have_randr = False;
+
+  if (!XRRQueryExtension(w->dpy, &w->randr_event_base, &error_base)
+      || !XRRQueryVersion(w->dpy, &major, &minor)
+      || (major == 1 && minor < 2))
+    {
+      dbg("%s() no usable RandR\n", __func__);
+      return;
+    }
+
+  w->have_randr = True;
+  w->randr_have_current = (major > 1 || minor >= 3);
+
+  XRRRotations(w->dpy, w->screen, &w->randr_rotation);
+
+  XRRSelectInput(w->dpy, w->root, 
+		 RRScreenChangeNotifyMask|RRCrtcChangeNotifyMask);
+}
+
+/* Gets there before the root ConfigureNotify, which is then a no-op */
+static void
+wm_randr_handle_event(Wm *w, XRRScreenChangeNotifyEvent *e)
+{
+  XRRUpdateConfiguration((XEvent*)e);
+
+  dbg("%s() rotation 0x%x -> 0x%x, %ix%i\n", __func__, 
+      w->randr_rotation, e->rotation, e->width, e->height);
+
+  w->randr_rotation = e->rotation;
+
+  /* Sizes come unrotated */
+  if (e->rotation & (RR_Rotate_90|RR_Rotate_270))
+    wm_handle_screen_resize(w, e->height, e->width);
+  else
+    wm_handle_screen_resize(w, e->width, e->height);
+}
+
+/* One change sends a notify per CRTC and output, re-query just once
+ * for all of those queued. A queued screen change re-queries anyway.
+ */
+static void
+wm_randr_handle_notify(Wm *w)
+{
+  XEvent ev;
+
+  while (XCheckTypedEvent(w->dpy, w->randr_event_base + RRNotify, &ev))
+    ;
+
+  if (XCheckTypedEvent(w->dpy, w->randr_event_base + RRScreenChangeNotify, 
+		       &ev))
+    wm_randr_handle_event(w, (XRRScreenChangeNotifyEvent*)&ev);
+  else
+    wm_handle_screen_resize(w, w->dpy_width, w->dpy_height);
+}
+
+#endif
+
+void
+wm_handle_configure_notify(Wm *w, XConfigureEvent *e)
+{
+   dbg("%s() called\n", __func__);
+
+   if (e->window == w->root) /* screen rotation */
+     {
+       dbg("%s() configure notify event called on root", __func__ );
+
+#ifdef HAVE_XRANDR
+       if (w->have_randr)
+	 {
+	   XRRUpdateConfiguration((XEvent*)e);
+
+	   /* RRScreenChangeNotify got here first and did the work */
+	   if (e->width == w->dpy_width && e->height == w->dpy_height)
+	     return;
+	 }
+#endif
+       wm_handle_screen_resize(w, e->width, e->height);
+     }
+#ifdef USE_COMPOSITE
+   else
+     {
+       MBOverride *o;
+
+       if ((o = comp_engine_override_find(w, e->window)) != NULL)
+	 comp_engine_override_configure(w, o, e);
+     }
+#endif
+}
+
+
+void
+wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
+{
+   Client         *c = wm_find_client(w, e->window, WINDOW);
+   XWindowChanges  xwc;
+
+   unsigned long   value_mask = e->value_mask;
+   int             req_x      = e->x;
+   int             req_y      = e->y;
+   int             req_w      = e->width;
+   int             req_h      = e->height;
+
+   Bool            want_activate = False;
+
+   /* TODO: Double check ICCCM on this code. 
+    *       see http://tronche.com/gui/x/icccm/sec-4.html#s-4.1.5
+    *       Only send synthetic configure notify on no change.
+    *
+    */  
+
+   if (!c ) 
+     {
+       /* Dont know any thing about this window. Let it have what it 
         * wants and leave. 
 	* Can be a window initally mapping, thus the trap as it could
         * of already dissapeared.
@@ -1478,7 +1878,7 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
 	   c->y += change_amount;
 	   c->height = e->height;
 	   c->move_resize(c);
-	   wm_update_layout(w, c, change_amount); 
+	   wm_update_layout(w, c->output); 
 	   return;
 	 }
      }
@@ -1628,7 +2028,7 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
 	     }
 	   
 	   dialog_client_move_resize(c);
-	   dialog_client_redraw(c, False);
+	   client_decor_queue_redraw(c, DECOR_DIRTY_ALL);
 
 	   /* make sure composite does any needed updates */
 	   comp_engine_client_configure(w, c);
@@ -1661,9 +2061,19 @@ wm_handle_map_request(Wm *w, XMapRequestEvent *e)
 void
 wm_handle_unmap_event(Wm *w, XUnmapEvent *e)
 {
-   Client *c = wm_find_client(w, e->window, WINDOW);
+   Client *c;
+
+#ifdef USE_COMPOSITE
+   MBOverride *o;
+
+   if ((o = comp_engine_override_find(w, e->window)) != NULL)
+     {
+       comp_engine_override_remove(w, o);
+       return;
+     }
+#endif
 
-   if (!c) return;
+   if ((c = wm_find_client(w, e->window, WINDOW)) == NULL) return;
 
    dbg("%s() for client %s\n", __func__, c->name);
 
@@ -1706,8 +2116,20 @@ wm_handle_expose_event(Wm *w, XExposeEvent *e)
 void
 wm_handle_destroy_event(Wm *w, XDestroyWindowEvent *e)
 {
-    Client *c = wm_find_client(w, e->window, WINDOW);
-    if (!c) return; 
+    Client *c;
+
+#ifdef USE_COMPOSITE
+    MBOverride *o;
+
+    /* Should be gone at its unmap already, but to be safe */
+    if ((o = comp_engine_override_find(w, e->window)) != NULL)
+      {
+	comp_engine_override_remove(w, o);
+	return;
+      }
+#endif
+
+    if ((c = wm_find_client(w, e->window, WINDOW)) == NULL) return;
 
     dbg("%s for %s\n", __func__, c->name);
 
@@ -1739,11 +2161,12 @@ wm_handle_client_message(Wm *w, XClientMessageEvent *e)
 
 	     dbg("%s() atempting to switch theme\n", __func__ );
 
-	     status = XGetWindowProperty(w->dpy, w->root,
-					 w->atoms[_MB_THEME], 0L, 512L, False,
-					 AnyPropertyType, &realType,
-					 &format, &n, &extra,
-					 (unsigned char **) &value);
+	     status = stats_xget_window_property(w->dpy, w->root,
+						 w->atoms[_MB_THEME], 
+						 0L, 512L, False,
+						 AnyPropertyType, &realType,
+						 &format, &n, &extra,
+						 (unsigned char **) &value);
 	     
 	     if (status == Success && value != NULL)
 	       {
@@ -1782,6 +2205,18 @@ wm_handle_client_message(Wm *w, XClientMessageEvent *e)
 	   break;
 #endif
 
+	 case MB_CMD_TRACE_DUMP:
+	   trace_dump(w);
+	   break;
+
+	 case MB_CMD_STATS:
+	   stats_publish(w);
+	   break;
+
+	 case MB_CMD_RESTART:
+	   restart_exec(w);
+	   break;
+
 #ifdef USE_COMPOSITE
 	 case MB_CMD_COMPOSITE:
 	   if (w->comp_engine_disabled)
@@ -1818,8 +2253,6 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
 
   if (!c) return; 
 
-  if (c->type == MBCLIENT_TYPE_OVERRIDE) return;
-
 #ifdef DEBUG
  {
    char *atomname = XGetAtomName(w->dpy, e->atom);
@@ -1838,6 +2271,7 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
 
       misc_trap_xerrors(); 
 
+      STATS_ROUND_TRIP();
       XFetchName(w->dpy, c->window, (char **)&c->name);
 
       if (!misc_untrap_xerrors())
@@ -1857,6 +2291,7 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
 
       misc_trap_xerrors(); 
 
+      STATS_ROUND_TRIP();
       success = XGetTransientForHint(w->dpy, c->window, &trans_win);
 
       if (!misc_untrap_xerrors() && success)
@@ -1876,17 +2311,20 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
 		    dbg("%s() CLIENT WARNING: %s ( %li ) transient for self\n",
 			__func__, c->name, c->window);
 		    c->trans = NULL;
+		    stack_update_trans(c);
 		    return; 
 		  }
 		p = p->trans;
 	      }
 
 	    c->trans = new_trans_client;
+	    stack_update_trans(c);
 
 	    return;
 	  }
 
       c->trans = NULL;
+      stack_update_trans(c);
 
     }
   else if (e->atom == w->atoms[_NET_WM_NAME])
@@ -1907,6 +2345,7 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
       else
 	{
 	  c->name_is_utf8 = False;
+	  STATS_ROUND_TRIP();
 	  XFetchName(w->dpy, c->window, (char **)&c->name);
 	}
 
@@ -1950,7 +2389,7 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
       comp_engine_client_repair(w, c);
     }
   
-  if (update_titlebar)  c->redraw(c, False);
+  if (update_titlebar)  client_decor_queue_redraw(c, DECOR_DIRTY_NORTH);
 }
 
 /* If configured force a app window be treated as a dialog */
@@ -1963,6 +2402,7 @@ wm_win_force_dialog(Wm *w, Window win)
   if (!w->config->force_dialogs)
     return result;
 
+  STATS_ROUND_TRIP();
   if (XFetchName(w->dpy, win, (char **)&win_title))
     if (strstr(w->config->force_dialogs, win_title)) /* TODO: Improve search */
       result = True;
@@ -1972,6 +2412,93 @@ wm_win_force_dialog(Wm *w, Window win)
   return result;
 }
 
+/* Second half of managing a window, once the client for its type is
+ * made. Sizes, frames and shows it. Called with the server grabbed.
+ */
+void
+wm_manage_client(Wm *w, Client *c)
+{
+   /* We do this now as really needs to know window type */
+
+   base_client_process_name(c);
+
+   /* Transients go on the output of what they're for */
+   if (c->trans)
+     c->output = c->trans->output;
+
+#if USE_SM
+   sm_client_restore(w, c);	/* Saved flags need to be there to size it */
+#endif
+
+   dbg("%s() calling configure method for new client\n", __func__);
+   
+   c->configure(c); 		/* Size up the client */
+
+   comp_engine_client_init(w, c);
+
+   dbg("%s() reparenting new client\n", __func__ );
+   
+   c->reparent(c);             	/* reparent it to frames and decor */
+
+   dbg("%s() move/resizing  new client\n", __func__);
+   
+   c->move_resize(c);          	/* set pos + size */
+
+   /* send new configuration to client - needed */
+   client_deliver_config(c);
+
+   /* TODO:
+    *
+    * Its likely the size we given the new client, is not what it requested. 
+    * We've by now told the app its new size, but we need to give it a 
+    * chance to repaint itself at the new size or other wise we get horrible
+    * flicker on mapping ( as remenants of old size are seen ).
+    *
+    * A possible solutions could be to implement the new _NET_WM_SYNC_REQUEST 
+    * stuff, as this is for resizes and we are resizing after all. 
+    *
+    *  XUngrabServer(w->dpy);
+    *  XSync(w->dpy, False);
+    *  XGrabServer(w->dpy);
+    *
+    * Note, this seems worst on GTK apps.
+    */
+
+   XGrabButton(c->wm->dpy, Button1, 0, c->window, True, ButtonPressMask,
+	       GrabModeSync, GrabModeSync, None, None);
+
+   /* Handle an application started iconized */
+   if (c->flags & CLIENT_IS_MINIMIZED
+       && c->type == MBCLIENT_TYPE_APP)
+     {
+       /* Clear the flag now to be safe */
+       c->flags &= ~CLIENT_IS_MINIMIZED;
+
+       c->redraw(c, False);		/* draw the decorations ready */
+       c->iconize (c);
+
+       ewmh_update_lists(w); 
+
+       return;
+     }
+
+   dbg("%s() showing new client\n", __func__);
+
+   c->redraw(c, False);		/* draw the decorations ready */
+   wm_activate_client(c);       /* Map it into stack, ( will call show()) */
+
+   /* Let window know were all done */
+
+   ewmh_state_set(c); 		/* XXX This is likely not needed */
+
+   client_set_state(c, NormalState);
+
+#if USE_SM
+   if (sm_client_restack(w, c))
+     stack_sync_to_display(w);
+#endif
+}
+
 Client*
 wm_make_new_client(Wm *w, Window win)
 {
@@ -1982,6 +2509,7 @@ wm_make_new_client(Wm *w, Window win)
    Client       *c = NULL, *t = NULL;
    XWMHints     *wmhints = NULL;
    int           mwm_flags = 0;
+   MBTraceTime   trace_start = trace_now();
 
    XGrabServer(w->dpy);
 
@@ -2002,10 +2530,11 @@ wm_make_new_client(Wm *w, Window win)
 
        misc_trap_xerrors();
 
-       status = XGetWindowProperty(w->dpy, win, w->atoms[WINDOW_TYPE], 
-				   0L, 1000000L, 0, XA_ATOM, 
-				   &realType, &format,
-				   &n, &extra, (unsigned char **) &value);
+       status = stats_xget_window_property(w->dpy, win, w->atoms[WINDOW_TYPE], 
+					   0L, 1000000L, 0, XA_ATOM, 
+					   &realType, &format,
+					   &n, &extra, 
+					   (unsigned char **) &value);
 
        if (misc_untrap_xerrors()) /* An X error occured - win deleted ? */
 	 goto end;
@@ -2093,6 +2622,7 @@ wm_make_new_client(Wm *w, Window win)
 
    /* check for transient - ie detect if its a dialog */
 
+   STATS_ROUND_TRIP();
    XGetTransientForHint(w->dpy, win, &trans_win);
    
    if (trans_win && (trans_win != win))
@@ -2111,6 +2641,7 @@ wm_make_new_client(Wm *w, Window win)
 
 	 dbg("%s() transient window not managed\n", __func__);
 
+	 STATS_ROUND_TRIP();
 	 if ((wmhints = XGetWMHints(w->dpy, win)) != NULL)
 	 {
 	    if (wmhints->window_group && !stack_empty(w))
@@ -2135,8 +2666,11 @@ wm_make_new_client(Wm *w, Window win)
 	  c = dialog_client_new(w, win, t);
 	}
       else if (c->type == MBCLIENT_TYPE_DIALOG) /* already exists, update  */
-	c->trans = t;  		/* TODO: what about other types 
+	{
+	  c->trans = t;  	/* TODO: what about other types 
 				         being transient for things ?*/
+	  stack_update_trans(c);
+	}
 
       /* Make sure above state is inherited if parent has it */
       if (c->trans != NULL
@@ -2156,84 +2690,18 @@ wm_make_new_client(Wm *w, Window win)
        }
    }
 
-   /* We do this now as really needs to know window type */
+   wm_manage_client(w, c);
 
-   base_client_process_name(c);
+ end:
 
-   dbg("%s() calling configure method for new client\n", __func__);
-   
-   c->configure(c); 		/* Size up the client */
+   XUngrabServer(w->dpy);
 
-   comp_engine_client_init(w, c);
+   XFlush(w->dpy);
 
-   dbg("%s() reparenting new client\n", __func__ );
-   
-   c->reparent(c);             	/* reparent it to frames and decor */
+   trace_record("wm_make_new_client", trace_start, c ? c->type : -1);
 
-   dbg("%s() move/resizing  new client\n", __func__);
-   
-   c->move_resize(c);          	/* set pos + size */
-
-   /* send new configuration to client - needed */
-   client_deliver_config(c);
-
-   /* TODO:
-    *
-    * Its likely the size we given the new client, is not what it requested. 
-    * We've by now told the app its new size, but we need to give it a 
-    * chance to repaint itself at the new size or other wise we get horrible
-    * flicker on mapping ( as remenants of old size are seen ).
-    *
-    * A possible solutions could be to implement the new _NET_WM_SYNC_REQUEST 
-    * stuff, as this is for resizes and we are resizing after all. 
-    *
-    *  XUngrabServer(w->dpy);
-    *  XSync(w->dpy, False);
-    *  XGrabServer(w->dpy);
-    *
-    * Note, this seems worst on GTK apps.
-    */
-
-   XGrabButton(c->wm->dpy, Button1, 0, c->window, True, ButtonPressMask,
-	       GrabModeSync, GrabModeSync, None, None);
-
-   /* Handle an application started iconized */
-   if (c->flags & CLIENT_IS_MINIMIZED
-       && c->type == MBCLIENT_TYPE_APP)
-     {
-       /* Clear the flag now to be safe */
-       c->flags &= ~CLIENT_IS_MINIMIZED;
-
-       c->redraw(c, False);		/* draw the decorations ready */
-       c->iconize (c);
-
-       ewmh_update_lists(w); 
-
-       XUngrabServer(w->dpy);
-       XFlush(w->dpy);
-
-       goto end;
-     }
-
-   dbg("%s() showing new client\n", __func__);
-
-   c->redraw(c, False);		/* draw the decorations ready */
-   wm_activate_client(c);       /* Map it into stack, ( will call show()) */
-
-   /* Let window know were all done */
-
-   ewmh_state_set(c); 		/* XXX This is likely not needed */
-
-   client_set_state(c, NormalState);
-
- end:
-
-   XUngrabServer(w->dpy);
-
-   XFlush(w->dpy);
-
-   return c;
-}
+   return c;
+}
 
 
 void
@@ -2263,6 +2731,7 @@ wm_remove_client(Wm *w, Client *c)
   XRemoveFromSaveSet(w->dpy, c->window);
 
   /* sync here so any (likely) lingering X errors are trapped */
+  STATS_ROUND_TRIP();
   XSync(w->dpy, False);
 
   misc_untrap_xerrors();
@@ -2279,230 +2748,245 @@ wm_remove_client(Wm *w, Client *c)
   XUngrabServer(w->dpy);
 }
 
+/* Only the app on show gets redecorated straight away after a
+ * relayout, anything hidden behind it is just marked stale and 
+ * caught up by main_client_show(). 
+ */
+static void
+wm_update_layout_app_decor(Wm *w, Client *c)
+{
+  if (c->mapped && c == wm_get_visible_main_client(w))
+    {
+      client_buttons_delete_all(c);
+      client_decor_queue_redraw(c, DECOR_DIRTY_ALL); /* force title redraw */
+    }
+  else
+    {
+      dbg("%s() marking %s stale\n", __func__, c->name);
+      c->flags |= CLIENT_DECOR_STALE_FLAG;
+    }
+}
+
+/* Mapped docks on one edge of an output, outermost first */
+
+typedef struct WmLayoutDock
+{
+  Client *c;
+  int     key;			/* distance in from the outputs edge */
+
+} WmLayoutDock;
+
+static int
+wm_layout_dock_cmp(const void *a, const void *b)
+{
+  return ((WmLayoutDock *)a)->key - ((WmLayoutDock *)b)->key;
+}
+
+static int
+wm_layout_docks_get(Wm               *w, 
+		    int               output, 
+		    MBClientTypeEnum  type,
+		    int               edge, 
+		    WmLayoutDock     *docks)
+{
+  MBOutput *o = &w->outputs[output];
+  Client   *p = NULL;
+  int       n = 0, x, y, width, height, flag = 0;
+
+  if (type == MBCLIENT_TYPE_PANEL)
+    switch (edge)
+      {
+      case NORTH: flag = CLIENT_DOCK_NORTH; break;
+      case SOUTH: flag = CLIENT_DOCK_SOUTH; break;
+      case EAST:  flag = CLIENT_DOCK_EAST;  break;
+      case WEST:  flag = CLIENT_DOCK_WEST;  break;
+      }
+
+  stack_enumerate_type(w, p, type)
+    {
+      if (!p->mapped || p->output != output)
+	continue;
+
+      if (flag && !(p->flags & flag))
+	continue;
+
+      p->get_coverage(p, &x, &y, &width, &height);
+
+      switch (edge)
+	{
+	case NORTH: docks[n].key = y - o->y; break;
+	case SOUTH: docks[n].key = o->y + o->height - (y + height); break;
+	case EAST:  docks[n].key = o->x + o->width - (x + width); break;
+	case WEST:  docks[n].key = x - o->x; break;
+	}
+
+      docks[n++].c = p;
+    }
+
+  qsort(docks, n, sizeof(WmLayoutDock), wm_layout_dock_cmp);
+
+  return n;
+}
+
 /* wm_update_layout() is called in the presence of a panel/toolbar
- * changing its size / appearing. It re-layouts all windows for it
- * to fit. 
+ * changing its size / appearing / going. It lays out the whole output
+ * again from its rect and the docks now mapped on it, so the result
+ * doesn't depend on the order docks came and went in. Docks keep
+ * their order along each edge, apps get what's left.
+ *
+ * Only the new geometry is worked out here, the windows are moved and
+ * told by client_layout_queue_flush() once the event is handled. So a
+ * client shuffled by several panel changes gets at most one configure.
  */
 void
-wm_update_layout(Wm         *w, 
-		 Client     *client_changed, 
-		 signed int  change_amount) /* XXX Change to relayout */
+wm_update_layout(Wm *w, int output)
 {
- Client *p = NULL;
+ MBOutput     *o = &w->outputs[output];
+ WmLayoutDock *docks = NULL;
+ Client       *p = NULL;
+ int           n_docks = 0, n, i, old_width;
+ int           north, south, east, west;
+ int           tb_bottom, tb_x, tb_width;
+ Bool          app_width_changed = False;
+
+ wm_offsets_invalidate(w);
+
+ stack_enumerate_type(w, p, MBCLIENT_TYPE_PANEL)
+   n_docks++;
+ stack_enumerate_type(w, p, MBCLIENT_TYPE_TOOLBAR)
+   n_docks++;
+
+ if (n_docks && (docks = malloc(sizeof(WmLayoutDock) * n_docks)) == NULL)
+   return;
+
+ north = o->y; south = o->y + o->height;
+ west  = o->x; east  = o->x + o->width;
 
- XGrabServer(w->dpy);
+ /* Vertical panels take the full height, the rest fit between them */
 
- stack_enumerate(w,p)
+ n = wm_layout_docks_get(w, output, MBCLIENT_TYPE_PANEL, WEST, docks);
+ for (i = 0; i < n; i++)
    {
-     if (p == client_changed)
-       continue;
+     p = docks[i].c;
+     p->x = west; p->y = o->y; p->height = o->height;
+     west += p->width;
+     client_layout_queue(p);
+   }
 
-     dbg("%s() restacking, comparing %i is less than %i for %s\n",
-	 __func__, p->y, client_changed->y, p->name);
-     if (client_changed->type == MBCLIENT_TYPE_PANEL 
-	 && client_changed->flags & CLIENT_DOCK_WEST)
-       {
-	 if (p->x >= client_changed->x) 
-	   {
-	     switch (p->type)
-	       {
-	       case MBCLIENT_TYPE_APP :
-		 if (p->flags & CLIENT_FULLSCREEN_FLAG)
-		   break;
-		 p->width += change_amount;
-		 p->x     -= change_amount;
-		 p->move_resize(p);
-		 theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
-		 client_deliver_config(p);
-		 client_buttons_delete_all(p);
-		 theme_pixmap_cache_clear_all(w->mbtheme);
-		 main_client_redraw(p, False); /* force title redraw */
-		 break;
-	       case MBCLIENT_TYPE_TOOLBAR :
-	       case MBCLIENT_TYPE_PANEL    :
-		 if (p->flags & CLIENT_DOCK_EAST)
-		   break;
-		 if (p->flags & CLIENT_DOCK_TITLEBAR)
-		   {
-		     /* See notes below on this */
+ n = wm_layout_docks_get(w, output, MBCLIENT_TYPE_PANEL, EAST, docks);
+ for (i = 0; i < n; i++)
+   {
+     p = docks[i].c;
+     east -= p->width;
+     p->x = east; p->y = o->y; p->height = o->height;
+     client_layout_queue(p);
+   }
 
-		     if (change_amount > 0)
-		       {
-			 XRectangle rect;
+ n = wm_layout_docks_get(w, output, MBCLIENT_TYPE_PANEL, NORTH, docks);
+ for (i = 0; i < n; i++)
+   {
+     p = docks[i].c;
+     p->x = west; p->y = north; p->width = east - west;
+     north += p->height;
+     client_layout_queue(p);
+   }
 
-			 mbtheme_get_titlebar_panel_rect(p->wm->mbtheme, 
-							 &rect, client_changed);
-			 p->x      = rect.x + wm_get_offsets_size(p->wm, WEST, client_changed, True); 
-			 p->width  = rect.width  ;
-		       }
-		     else p->configure(p);
-		   }
-		 else
-		   {
-		     p->width += change_amount;
-		     p->x     -= change_amount;
-		   }
+ n = wm_layout_docks_get(w, output, MBCLIENT_TYPE_PANEL, SOUTH, docks);
+ for (i = 0; i < n; i++)
+   {
+     p = docks[i].c;
+     south -= p->height;
+     p->x = west; p->y = south; p->width = east - west;
+     client_layout_queue(p);
+   }
 
-		 p->move_resize(p);
-		 client_deliver_config(p);
+ /* Toolbars stack up from the south panels, or from the bottom over 
+  * all panels while a fullscreen app has moved them there. See 
+  * main_client_manage_toolbars_for_fullscreen().
+  */
+ tb_bottom = south; tb_x = west; tb_width = east - west;
 
-	       default:
-		 break;
-	       }
-	   }
+#ifndef USE_ALT_INPUT_WIN
+ p = wm_get_output_visible_main_client(w, output);
+
+ if (p && (p->flags & CLIENT_TOOLBARS_MOVED_FOR_FULLSCREEN))
+   {
+     tb_bottom = o->y + o->height; tb_x = o->x; tb_width = o->width;
+   }
+#endif
+
+ n = wm_layout_docks_get(w, output, MBCLIENT_TYPE_TOOLBAR, SOUTH, docks);
+ for (i = 0; i < n; i++)
+   {
+     p = docks[i].c;
+
+     if (p->flags & CLIENT_IS_MINIMIZED)
+       {
+	 tb_bottom -= toolbar_win_offset(p);
+	 p->x = tb_x;
+	 p->y = tb_bottom;
        }
-     else if (client_changed->type == MBCLIENT_TYPE_PANEL 
-	      && client_changed->flags & CLIENT_DOCK_EAST)
+     else
        {
-	 if (p->x <= client_changed->x) 
-	   {
-	     switch (p->type)
-	       {
-	       case MBCLIENT_TYPE_APP :
-		 if (p->flags & CLIENT_FULLSCREEN_FLAG)
-		   break;
-		 p->width += change_amount;
-		 p->move_resize(p);
-		 client_deliver_config(p);
-		 theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
-		 theme_pixmap_cache_clear_all(w->mbtheme);
-		 client_buttons_delete_all(p);
-		 main_client_redraw(p, False); /* force title redraw */
-		 break;
-	       case MBCLIENT_TYPE_TOOLBAR :
-	       case MBCLIENT_TYPE_PANEL   :
-		 if (p->flags & CLIENT_DOCK_WEST)
-		   break;
-		 if (p->flags & CLIENT_DOCK_TITLEBAR)
-		   {
-		     /* 
-			The usual configure call takes into account the
-			just removed dock ( +ive change amount ), so 
-			we have to basically do own configure() call 
-			ignoring this. 
-		     */
-
-		     if (change_amount > 0)
-		       {
-			 XRectangle rect;
+	 tb_bottom -= p->height;
+	 p->x     = tb_x + toolbar_win_offset(p);
+	 p->y     = tb_bottom;
+	 p->width = tb_width - toolbar_win_offset(p);
+       }
 
-			 mbtheme_get_titlebar_panel_rect(p->wm->mbtheme, 
-							 &rect, client_changed);
-			 p->x      = rect.x + wm_get_offsets_size(p->wm, WEST, client_changed, True); 
-			 p->width  = rect.width  ;
-		       }
-		     else
-		       p->configure(p); 
-		   }
-		 else
-		   {
-		     p->width += change_amount;
-		   }
-		 p->move_resize(p);
-		 client_deliver_config(p);
+     client_layout_queue(p);
+   }
 
-	       default:
-		 break;
-	       }
-	   }
-       }
-     else if (client_changed->type == MBCLIENT_TYPE_PANEL 
-	      && client_changed->flags & CLIENT_DOCK_NORTH)
+ if (docks)
+   free(docks);
+
+ stack_enumerate_type(w, p, MBCLIENT_TYPE_PANEL)
+   if (p->mapped && p->output == output 
+       && (p->flags & CLIENT_DOCK_TITLEBAR))
+     {
+       p->configure(p);
+       client_layout_queue(p);
+     }
+
+ stack_enumerate_type(w, p, MBCLIENT_TYPE_APP)
+   {
+     if (p->output != output)
+       continue;
+
+     old_width = p->width;
+
+     if (p->flags & CLIENT_FULLSCREEN_FLAG)
        {
-	 if (p->y >= client_changed->y) 
-	   {
-	     switch (p->type)
-	       {
-	       case MBCLIENT_TYPE_APP :
-		 if (p->flags & CLIENT_FULLSCREEN_FLAG)
-		   break;
-		 p->height += change_amount;
-		 p->y      -= change_amount;
-		 p->move_resize(p);
-		 /* XXX shouldn't be any need to redraw here as 
-                  * width won't have changed so no need to repaint 
-                  * entire toolbar. 
-                  *
-                  * It *could* break on if the side decoration themes
-                  * are somehow a function of height. No themes I know
-                  * of do this and we avoid quite a lot of cpu avoiding
-                  * this.
-                  *
-		  * theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
-		  * theme_pixmap_cache_clear_all(w->mbtheme);
-		  * main_client_redraw(p, False);
-		 */
-		 client_deliver_config(p);
-		 break;
-	       case MBCLIENT_TYPE_PANEL :
-		 if (p->flags & CLIENT_DOCK_NORTH
-		     || p->flags & CLIENT_DOCK_TITLEBAR)
-		   {
-		     p->y -= change_amount;
-		     p->move_resize(p);
-		     client_deliver_config(p);
-		   }
-		 break;
-	       default:
-		 break;
-	       }
-	   }
+	 /* Covers the panels but not the toolbars */
+	 p->x = o->x; p->y = o->y; p->width = o->width;
+	 p->height = tb_bottom - o->y;
        }
      else
-       {
-	 /* toolbar changes here */
+       p->configure(p);
 
-	 dbg("%s(): restack NORMAL comparing %i <= %i for %s\n",
-	     __func__, p->y, client_changed->y, p->name);
-	 if ( (p->y <= client_changed->y) 
-	      || (client_changed->type == MBCLIENT_TYPE_PANEL 
-		  && p->type == MBCLIENT_TYPE_TOOLBAR))
-	   {
-	     dbg("%s() restacking ( NORMAL )%s", __func__, p->name);
-	     switch (p->type)
-	       {
-	       case MBCLIENT_TYPE_APP :
-		 if (p->flags & CLIENT_FULLSCREEN_FLAG
-		     && client_changed->type == MBCLIENT_TYPE_PANEL)
-		   break;
-		 p->height += change_amount;
-		 p->move_resize(p);
-		 /*
-		  * See above as to why this is commented out.
-                  *
-                  * theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
-		  * theme_pixmap_cache_clear_all(w->mbtheme);
-		  * main_client_redraw(p, False);
-                  */
-		 client_deliver_config(p);
-		 break;
-	       case MBCLIENT_TYPE_TOOLBAR :
-		 p->y += change_amount;
-		 p->move_resize(p);
-		 client_deliver_config(p);
-		 break;
-	       case MBCLIENT_TYPE_PANEL :
-		 if (p->flags & CLIENT_DOCK_SOUTH)
-		   {
-		     p->y += change_amount;
-		     p->move_resize(p);
-		     client_deliver_config(p);
-		   }
-		 break;
-	       case MBCLIENT_TYPE_DIALOG :
-	       default:
-		 break;
-	       }
-	   }
-      }
+     client_layout_queue(p);
+
+     if (p->width != old_width)
+       {
+	 wm_update_layout_app_decor(w, p);
+	 app_width_changed = True;
+       }
    }
 
+ /* App titlebars are cached at a single width, so drop them once 
+  * here rather than for every app resized above.
+  */
+ if (app_width_changed)
+   {
+     theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
+     theme_pixmap_cache_clear_all(w->mbtheme);
+   }
 
  /* Handle dialog centering etc */
 
  stack_enumerate(w, p)
    {
-     if (p->type == MBCLIENT_TYPE_DIALOG) 
+     if (p->type == MBCLIENT_TYPE_DIALOG && p->output == output) 
        {
 	 Bool force_height = False;
 	 int req_x = p->x, req_y = p->y, req_w = p->width, req_h = p->height;
@@ -2516,8 +3000,7 @@ wm_update_layout(Wm         *w,
 	                   |CLIENT_TB_ALT_TRANS_FOR_APP))
 	   {
 	     p->configure(p);
-	     p->move_resize(p);
-	     client_deliver_config(p);
+	     client_layout_queue(p);
 	     continue;
 	   }
 #else
@@ -2536,17 +3019,10 @@ wm_update_layout(Wm         *w,
 	     || force_height)
 	   {
 	     p->x = req_x; p->y = req_y; p->width = req_w; p->height = req_h;
-	     p->move_resize(p);
-	     client_deliver_config(p);
+	     client_layout_queue(p);
 	   }
        }
    }
-
- ewmh_update_rects(w);
-
- XSync(w->dpy, False);
- XUngrabServer(w->dpy);
-
 }
 
 
@@ -2607,8 +3083,6 @@ wm_activate_client(Client *c)
     }
 #endif
 
-  XGrabServer(w->dpy);
-
   c->show(c); /* Set 'relative' pos in stack, map windows
 		 if needed etc                           */
 
@@ -2843,10 +3317,6 @@ wm_activate_client(Client *c)
 	}
     }
 #endif
-
-  XSync(w->dpy, False);	    
-
-  XUngrabServer(w->dpy);
 }
 
 /* Returns either desktop or main app client */
@@ -2870,63 +3340,130 @@ wm_get_visible_main_client(Wm *w)
   return NULL;
 }
 
-/* Get area taken up on an edge by panels, toolbars */
-int
-wm_get_offsets_size(Wm*     w, 
-		    int     wanted_direction,
-		    Client* ignore_client, 
-		    Bool    include_toolbars
-		    )
+/* As above for one output, its highest mapped app. Apps on the other
+ * outputs don't overlap it so don't hide it however they're stacked.
+ */
+Client*
+wm_get_output_visible_main_client(Wm *w, int output)
 {
-  Client *p;
-  int     x, y, width, height, result = 0;
+  Client *c;
 
-  if (stack_empty(w)) return 0;
+  if (w->flags & DESKTOP_RAISED_FLAG)
+    return wm_get_desktop(w);
+
+  if (w->stack_top_app && w->stack_top_app->output == output)
+    return w->stack_top_app;
+
+  stack_enumerate_type_reverse(w, c, MBCLIENT_TYPE_APP)
+    if (c->output == output && c->mapped)
+      return c;
+
+  return NULL;
+}
+
+/* Call when a panel or toolbar maps, unmaps, moves or resizes. The
+ * edge offsets get summed again on next use and _NET_WORKAREA is
+ * reset once the event has been handled.
+ */
+void
+wm_offsets_invalidate(Wm *w)
+{
+  w->offsets_valid   = False;
+  w->work_area_dirty = True;
+}
+
+static void
+wm_offsets_update(Wm *w)
+{
+  Client *p;
+  int     x, y, width, height;
 
   dbg("%s() called\n", __func__);
 
+  for (x = 0; x < w->n_outputs; x++)
+    memset(w->outputs[x].offsets, 0, sizeof(w->outputs[x].offsets));
+
   stack_enumerate(w, p)
      {
-       if ((ignore_client && p == ignore_client) || p->mapped == False) 
+       p->strut_size = 0;
+
+       if (p->mapped == False)
 	 continue;
 
-       switch(wanted_direction)
+       if (p->type == MBCLIENT_TYPE_PANEL)
 	 {
-	 case NORTH:
-	   if (p->type == MBCLIENT_TYPE_PANEL && p->flags & CLIENT_DOCK_NORTH)
-	     {
-	       p->get_coverage(p, &x, &y, &width, &height);
-	       result += height;
-	     }
-	   break;
-	 case SOUTH:
-	   if ((p->type == MBCLIENT_TYPE_PANEL && p->flags & CLIENT_DOCK_SOUTH)
-	       || (p->type == MBCLIENT_TYPE_TOOLBAR && include_toolbars) )
-	     {
-	       p->get_coverage(p, &x, &y, &width, &height);
-	       result += height;
-	     }
-	   break;
-	 case EAST:
-	   if (p->type == MBCLIENT_TYPE_PANEL && p->flags & CLIENT_DOCK_EAST)
-	   {
-	       p->get_coverage(p, &x, &y, &width, &height);
-	       result += width;
-	   }
-	   break;
-	 case WEST:
-	   if (p->type == MBCLIENT_TYPE_PANEL && p->flags & CLIENT_DOCK_WEST)
-	   {
-	       p->get_coverage(p, &x, &y, &width, &height);
-	       result += width;
-	   }
-	   break;
+	   if (p->flags & CLIENT_DOCK_NORTH)
+	     p->strut_edge = NORTH;
+	   else if (p->flags & CLIENT_DOCK_SOUTH)
+	     p->strut_edge = SOUTH;
+	   else if (p->flags & CLIENT_DOCK_EAST)
+	     p->strut_edge = EAST;
+	   else if (p->flags & CLIENT_DOCK_WEST)
+	     p->strut_edge = WEST;
+	   else
+	     continue;
 	 }
+       else if (p->type == MBCLIENT_TYPE_TOOLBAR)
+	 p->strut_edge = SOUTH;
+       else
+	 continue;
+
+       p->get_coverage(p, &x, &y, &width, &height);
+
+       if (p->strut_edge == EAST || p->strut_edge == WEST)
+	 p->strut_size = width;
+       else
+	 p->strut_size = height;
+
+       if (p->type == MBCLIENT_TYPE_PANEL)
+	 w->outputs[p->output].offsets[False][p->strut_edge] += p->strut_size;
+
+       w->outputs[p->output].offsets[True][p->strut_edge] += p->strut_size;
      }
 
-   return result;
+  w->offsets_valid = True;
+}
+
+/* Get area taken up on an edge of an output by panels, toolbars */
+int
+wm_get_output_offsets_size(Wm*     w, 
+			   int     output,
+			   int     wanted_direction,
+			   Client* ignore_client, 
+			   Bool    include_toolbars
+			   )
+{
+  int result;
+
+  if (!w->offsets_valid)
+    wm_offsets_update(w);
+
+  include_toolbars = include_toolbars ? True : False;
+
+  result = w->outputs[output].offsets[include_toolbars][wanted_direction];
+
+  if (ignore_client && ignore_client->strut_size 
+      && ignore_client->output == output
+      && ignore_client->strut_edge == wanted_direction
+      && (include_toolbars || ignore_client->type != MBCLIENT_TYPE_TOOLBAR))
+    result -= ignore_client->strut_size;
+
+  return result;
 }
 
+/* As above, for ignore_clients output or the primary */
+int
+wm_get_offsets_size(Wm*     w, 
+		    int     wanted_direction,
+		    Client* ignore_client, 
+		    Bool    include_toolbars
+		    )
+{
+  return wm_get_output_offsets_size(w, 
+				    ignore_client ? ignore_client->output : 0,
+				    wanted_direction, ignore_client, 
+				    include_toolbars);
+}
 
 void
 wm_toggle_desktop(Wm *w)
@@ -2979,6 +3516,7 @@ wm_set_cursor_visibility(Wm *w, Bool visible)
            * but no way to query that ?
 	  */
 	  XFixesShowCursor (w->dpy, w->root);
+	  STATS_ROUND_TRIP();
 	  XSync(w->dpy, False);
 	  misc_untrap_xerrors();
 	}
@@ -3161,204 +3699,270 @@ wm_sn_exec(Wm *w, char* name, char* bin_name, char *desc)
   sn_launcher_context_unref (context);
 }
 
-static void 
-wm_sn_timeout_check (Wm *w)
+static unsigned int
+wm_sn_str_hash(const char *str)
 {
-  time_t now ;
+  unsigned int h = 5381;
 
-  dbg("%s() called\n", __func__);
+  while (*str)
+    h = (h << 5) + h + (unsigned char)*str++;
 
-  if (!w->sn_busy_cnt) return;
-  
-  now = time(NULL);
-  if ((now - w->sn_init_time) > MB_SN_APP_TIMEOUT) 
-    {
-      w->sn_busy_cnt--;
-      w->sn_init_time = time(NULL);
-    }
+  return h & (SN_CYCLE_HASH_SIZE-1);
+}
+
+#define wm_sn_xid_hash(xid) ((xid) & (SN_CYCLE_HASH_SIZE-1))
+
+/* Unlinks from one of the hash chains, link names which */
+#define wm_sn_hash_unlink(bucket, cycle, link)		\
+  do {							\
+    SnCycle **pp = (bucket);				\
+    while (*pp != NULL)					\
+      {							\
+	if (*pp == (cycle))				\
+	  {						\
+	    *pp = (cycle)->link;			\
+	    break;					\
+	  }						\
+	pp = &(*pp)->link;				\
+      }							\
+  } while (0)
 
+static void
+wm_sn_update_cursor(Wm *w)
+{
   if (w->sn_busy_cnt)
     XDefineCursor(w->dpy, w->root, w->curs_busy);
   else
-    {
-      XDefineCursor(w->dpy, w->root, w->curs);
-      XDeleteProperty(w->dpy, w->root, w->atoms[MB_CLIENT_STARTUP_LIST]);
-    }
+    XDefineCursor(w->dpy, w->root, w->curs);
 }
 
-static void 
-wm_sn_cycle_update_root_prop(Wm *w)
+static void
+wm_sn_cycle_unbusy(Wm *w, SnCycle *cycle)
 {
-  SnCycle *current_cycle = w->sn_cycles;
-  char *prop_str = NULL;
-  int prop_str_len = 0;
+  if (cycle->timer == NULL)
+    return;
 
-  ewmh_update_lists(w);
+  timer_remove(w, cycle->timer);
+  cycle->timer = NULL;
 
-  if (current_cycle == NULL)
-    {
-      XDeleteProperty(w->dpy, w->root, w->atoms[MB_CLIENT_STARTUP_LIST]);
-      XFlush(w->dpy);
-      return;
-    }
+  if (--w->sn_busy_cnt == 0)
+    wm_sn_update_cursor(w);
+}
 
-  XGrabServer(w->dpy);
+static void
+wm_sn_cycle_free(Wm *w, SnCycle *cycle)
+{
+  wm_sn_cycle_unbusy(w, cycle);
 
-  while(current_cycle != NULL)
-    {
-	  dbg("%s() looping on %s, %li\n", __func__, 
-	      current_cycle->bin_name, current_cycle->xid );
+  wm_sn_hash_unlink(&w->sn_bin_hash[wm_sn_str_hash(cycle->bin_name)],
+		    cycle, bin_next);
 
-      if (current_cycle->xid == None)
-	{
-	  dbg("%s() adding %s, %li\n", __func__, 
-	      current_cycle->bin_name, current_cycle->xid );
-	  prop_str_len += (strlen(current_cycle->bin_name) + 1);
-	}
-      current_cycle = current_cycle->next;
-    }
+  if (cycle->seq_id)
+    wm_sn_hash_unlink(&w->sn_seq_hash[wm_sn_str_hash(cycle->seq_id)],
+		      cycle, seq_next);
 
-  if (prop_str_len > 1)
-    {
-      prop_str = malloc(sizeof(char)*(prop_str_len+1));
-      memset(prop_str, 0, prop_str_len+1);
+  if (cycle->xid != None)
+    wm_sn_hash_unlink(&w->sn_xid_hash[wm_sn_xid_hash(cycle->xid)],
+		      cycle, xid_next);
 
-      current_cycle = w->sn_cycles;
-      while(current_cycle != NULL)
-	{
-	  if (current_cycle->xid == None)
-	    {
-	      strcat(prop_str, current_cycle->bin_name);
-	      strcat(prop_str, "|");
-	    }
-	  current_cycle = current_cycle->next;
-	}
-      
-      dbg("%s() Setting MB_CLIENT_STARTUP_LIST to %s\n", __func__, prop_str);
+  if (cycle->prev)
+    cycle->prev->next = cycle->next;
+  else
+    w->sn_cycles = cycle->next;
 
-      if (prop_str)
-	{
-	  XChangeProperty(w->dpy, w->root, w->atoms[MB_CLIENT_STARTUP_LIST] ,
-			  XA_STRING, 8, PropModeReplace,
-			  (unsigned char *)prop_str, strlen(prop_str)
-			  );
-	  
-	  free(prop_str);
-	}
-    }
+  if (cycle->next)
+    cycle->next->prev = cycle->prev;
   else
+    w->sn_cycles_tail = cycle->prev;
+
+  w->sn_props_dirty = True;
+
+  if (cycle->seq_id) free(cycle->seq_id);
+  free(cycle->bin_name);
+  free(cycle);
+}
+
+static SnCycle *
+wm_sn_cycle_find_seq(Wm *w, const char *seq_id)
+{
+  SnCycle *cycle = w->sn_seq_hash[wm_sn_str_hash(seq_id)];
+
+  while (cycle != NULL && strcmp(cycle->seq_id, seq_id))
+    cycle = cycle->seq_next;
+
+  return cycle;
+}
+
+/* First launch of bin_name either still starting ( xid None ) or
+ * running, going by want_xid.
+ */
+static SnCycle *
+wm_sn_cycle_find_bin(Wm *w, const char *bin_name, Bool want_xid)
+{
+  SnCycle *cycle = w->sn_bin_hash[wm_sn_str_hash(bin_name)];
+
+  while (cycle != NULL)
     {
-      dbg("%s() Deleting MB_CLIENT_STARTUP_LIST \n", __func__ );
-      XDeleteProperty(w->dpy, w->root, w->atoms[MB_CLIENT_STARTUP_LIST]);
+      if ((cycle->xid != None) == want_xid 
+	  && !strcmp(cycle->bin_name, bin_name))
+	return cycle;
+      cycle = cycle->bin_next;
     }
-  XFlush(w->dpy);
 
-  XUngrabServer(w->dpy);
+  return NULL;
+}
+
+/* Launch never got a window */
+static void
+wm_sn_cycle_timeout(Wm *w, void *data)
+{
+  SnCycle *cycle = (SnCycle *)data;
+
+  dbg("%s() %s timed out\n", __func__, cycle->bin_name);
+
+  cycle->timer = NULL; 		/* already gone */
+
+  if (--w->sn_busy_cnt == 0)
+    wm_sn_update_cursor(w);
+
+  wm_sn_cycle_free(w, cycle);
 }
 
-static SnCycle * 
-wm_sn_cycle_new(Wm *w, const char *bin_name)
+static char*
+wm_sn_cycle_serialise(Wm *w, Bool running)
 {
-  SnCycle *new_cycle = malloc(sizeof(SnCycle));
-  memset(new_cycle, 0, sizeof(SnCycle));
-  new_cycle->bin_name = strdup(bin_name);
-  new_cycle->xid      = None;
-  new_cycle->next     = NULL;
-  return new_cycle;
+  SnCycle *cycle;
+  char    *str, *p;
+  int      len = 0;
+
+  for (cycle = w->sn_cycles; cycle != NULL; cycle = cycle->next)
+    if ((cycle->xid != None) == running)
+      len += strlen(cycle->bin_name) + (running ? 24 : 1);
+
+  if (len == 0)
+    return NULL;
+
+  p = str = malloc(len + 1);
+  *p = '\0';
+
+  for (cycle = w->sn_cycles; cycle != NULL; cycle = cycle->next)
+    if ((cycle->xid != None) == running)
+      {
+	if (running)
+	  p += sprintf(p, "%s=%li|", cycle->bin_name, cycle->xid);
+	else
+	  p += sprintf(p, "%s|", cycle->bin_name);
+      }
+
+  return str;
 }
 
-static void 
-wm_sn_cycle_add(Wm *w, const char *bin_name)
+static void
+wm_sn_cycle_set_root_prop(Wm *w, Atom atom, char *str)
 {
-  SnCycle *current_cycle;
-  dbg("%s() called with %s\n", __func__, bin_name);
-  if (w->sn_cycles == NULL)
+  if (str != NULL)
     {
-      w->sn_cycles = wm_sn_cycle_new(w, bin_name);
+      dbg("%s() setting to %s\n", __func__, str);
+      XChangeProperty(w->dpy, w->root, atom, XA_STRING, 8, PropModeReplace,
+		      (unsigned char *)str, strlen(str));
+      free(str);
     }
+  else XDeleteProperty(w->dpy, w->root, atom);
+}
+
+/* Rewrites MB_CLIENT_STARTUP_LIST ( starting bin names ) and 
+ * MB_CLIENT_EXEC_MAP ( bin_name=xid for running ones ). Done once
+ * per event via wm_flush_pending() when anything changed.
+ */
+static void 
+wm_sn_cycle_update_root_prop(Wm *w)
+{
+  w->sn_props_dirty = False;
+
+  wm_sn_cycle_set_root_prop(w, w->atoms[MB_CLIENT_STARTUP_LIST],
+			    wm_sn_cycle_serialise(w, False));
+  wm_sn_cycle_set_root_prop(w, w->atoms[MB_CLIENT_EXEC_MAP],
+			    wm_sn_cycle_serialise(w, True));
+}
+
+static void 
+wm_sn_cycle_add(Wm *w, const char *bin_name, const char *seq_id)
+{
+  SnCycle      *cycle;
+  unsigned int  h;
+
+  dbg("%s() called with %s ( %s )\n", __func__, bin_name, seq_id);
+
+  if (wm_sn_cycle_find_seq(w, seq_id))
+    return;
+
+  cycle = malloc(sizeof(SnCycle));
+  memset(cycle, 0, sizeof(SnCycle));
+
+  cycle->bin_name = strdup(bin_name);
+  cycle->seq_id   = strdup(seq_id);
+  cycle->xid      = None;
+  cycle->timer    = timer_add(w, MB_SN_APP_TIMEOUT * 1000, 
+			      wm_sn_cycle_timeout, cycle);
+
+  h = wm_sn_str_hash(bin_name);
+  cycle->bin_next    = w->sn_bin_hash[h];
+  w->sn_bin_hash[h]  = cycle;
+
+  h = wm_sn_str_hash(seq_id);
+  cycle->seq_next    = w->sn_seq_hash[h];
+  w->sn_seq_hash[h]  = cycle;
+
+  cycle->prev = w->sn_cycles_tail;
+  if (w->sn_cycles_tail)
+    w->sn_cycles_tail->next = cycle;
   else
-    {
-      current_cycle = w->sn_cycles;
-      if (!strcmp(current_cycle->bin_name, bin_name)
-	  && current_cycle->xid == None)
-	{
-	  dbg("%s() already have %s\n", __func__, bin_name);
-	  return; 		/* already have it */
-	}
+    w->sn_cycles = cycle;
+  w->sn_cycles_tail = cycle;
 
-      while (current_cycle->next != NULL)
-	{
-	  if (!strcmp(current_cycle->bin_name, bin_name)
-	      && current_cycle->xid == None )
-	    {
-	      dbg("%s() already have %s\n", __func__, bin_name);
-	      return; 		/* already have it */
-	    }
-	  current_cycle = current_cycle->next;
-	}
-      current_cycle->next = wm_sn_cycle_new(w, bin_name);
-    }
-  wm_sn_cycle_update_root_prop(w);
+  if (w->sn_busy_cnt++ == 0)
+    wm_sn_update_cursor(w);
+
+  w->sn_props_dirty = True;
 }
 
 void
 wm_sn_cycle_remove(Wm *w, Window xid)
 {
-  SnCycle *current_cycle = w->sn_cycles, *prev_cycle = NULL;
+  SnCycle *cycle = w->sn_xid_hash[wm_sn_xid_hash(xid)];
+
+  while (cycle != NULL && cycle->xid != xid)
+    cycle = cycle->xid_next;
 
-  while(current_cycle != NULL)
+  if (cycle != NULL)
     {
-      if (current_cycle->xid == xid)
-	{
-	  if (current_cycle == w->sn_cycles)
-	    {
-	      w->sn_cycles = current_cycle->next; 
-	      dbg("%s(): removed, w->sn_cycles is now %p\n", __func__, 
-		  w->sn_cycles);
-	    }
-	  else
-	    {
-	      prev_cycle->next = current_cycle->next;
-	    }
-	  free(current_cycle->bin_name);
-	  free(current_cycle);
-	  wm_sn_cycle_update_root_prop(w);
-	  return;
-	}
-      prev_cycle = current_cycle;
-      current_cycle = current_cycle->next;
+      dbg("%s() removing %s\n", __func__, cycle->bin_name);
+      wm_sn_cycle_free(w, cycle);
     }
-  wm_sn_cycle_update_root_prop(w);
 }
 
+/* Launch has a window, move it from the starting to the running set */
 static void
-wm_sn_cycle_update_xid(Wm *w, const char *bin_name, Window xid)
+wm_sn_cycle_update_xid(Wm *w, SnCycle *cycle, Window xid)
 {
-  /* find first where xid is None, and update */
+  unsigned int h;
 
-  /* in above check, check another dont exist _without_ xid */
+  dbg("%s() %s, setting xid = %li\n", __func__, cycle->bin_name, xid);
 
-  /* destroy must call sn_cycle remove ? - unless theme switch flag is on */
+  wm_sn_hash_unlink(&w->sn_seq_hash[wm_sn_str_hash(cycle->seq_id)],
+		    cycle, seq_next);
+  free(cycle->seq_id);
+  cycle->seq_id = NULL;
 
-  SnCycle *current_cycle = w->sn_cycles;
+  cycle->xid = xid;
 
-  dbg("%s() called with %s, %li\n", __func__, bin_name, xid);
+  h = wm_sn_xid_hash(xid);
+  cycle->xid_next   = w->sn_xid_hash[h];
+  w->sn_xid_hash[h] = cycle;
 
-  while(current_cycle != NULL)
-    {
-      if (!strcmp(current_cycle->bin_name, bin_name)
-	  && current_cycle->xid == None)
-	{
-	  dbg("%s() got match for %s, setting xid = %li\n", 
-	      __func__, bin_name, xid);
-	  current_cycle->xid = xid;
-	  wm_sn_cycle_update_root_prop(w);
-	  return;
-	}
-      current_cycle = current_cycle->next;
-    }
-  dbg("%s() match failed\n", __func__);
-  wm_sn_cycle_update_root_prop(w);
+  wm_sn_cycle_unbusy(w, cycle);
+
+  w->sn_props_dirty = True;
 }
 
 static void 
@@ -3368,6 +3972,7 @@ wm_sn_monitor_event_func (SnMonitorEvent *event,
   SnStartupSequence *sequence;
   Wm *w = (Wm *)user_data;
   const char *seq_id = NULL, *bin_name = NULL;
+  SnCycle *cycle;
   Client *p;
 
   dbg("%s() called\n", __func__);
@@ -3393,9 +3998,7 @@ wm_sn_monitor_event_func (SnMonitorEvent *event,
     {
     case SN_MONITOR_EVENT_INITIATED:
       dbg("%s() SN_MONITOR_EVENT_INITIATED\n", __func__);
-      w->sn_busy_cnt++;
-      w->sn_init_time = time(NULL);
-      wm_sn_cycle_add(w, bin_name);
+      wm_sn_cycle_add(w, bin_name, seq_id);
       break;
     case SN_MONITOR_EVENT_CHANGED:
       dbg("%s() SN_MONITOR_EVENT_CHANGED\n", __func__);
@@ -3403,9 +4006,11 @@ wm_sn_monitor_event_func (SnMonitorEvent *event,
     case SN_MONITOR_EVENT_COMPLETED:
       dbg("%s() SN_MONITOR_EVENT_COMPLETED\n", __func__ );
 
+      if ((cycle = wm_sn_cycle_find_seq(w, seq_id)) == NULL)
+	break;
+
       if (!stack_empty(w))
 	{
-
 	  stack_enumerate(w, p)
 	    {
 	      if (p->startup_id && !strcmp(p->startup_id, seq_id))
@@ -3413,25 +4018,21 @@ wm_sn_monitor_event_func (SnMonitorEvent *event,
 		  dbg("%s() found startup_id match ( %s ) for %s \n", 
 		      __func__, seq_id, p->name );
 		  
-		  wm_sn_cycle_update_xid(w, bin_name, p->window);
-		  wm_sn_cycle_update_root_prop(w);
-		  w->sn_busy_cnt--;
-		  break;
+		  wm_sn_cycle_update_xid(w, cycle, p->window);
+		  return;
 		}
 	    }
 	}
-      else w->sn_busy_cnt--;
+
+      /* Completed without a window we know of */
+      wm_sn_cycle_free(w, cycle);
       break;
     case SN_MONITOR_EVENT_CANCELED:
-      /* wm_sn_cycle_remove(w, bin_name); */
-      w->sn_busy_cnt--;
+      dbg("%s() SN_MONITOR_EVENT_CANCELED\n", __func__ );
+      if ((cycle = wm_sn_cycle_find_seq(w, seq_id)) != NULL)
+	wm_sn_cycle_free(w, cycle);
       break;
     }
-
-  if (w->sn_busy_cnt)
-    XDefineCursor(w->dpy, w->root, w->curs_busy);
-  else
-    XDefineCursor(w->dpy, w->root, w->curs);
 }
 
 #endif
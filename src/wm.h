@@ -42,6 +42,12 @@
 #endif
 
 #include "keys.h"
+#include "trace.h"
+#include "stats.h"
+#include "record.h"
+#include "timer.h"
+#include "restart.h"
+#include "slab.h"
 
 /* Atoms */
 
@@ -71,6 +77,12 @@ wm_init_existing(Wm *w);
 void 
 wm_event_loop(Wm* w);
 
+void
+wm_handle_event(Wm *w, XEvent *ev);
+
+void
+wm_flush_pending(Wm *w);
+
 void 
 wm_handle_button_event(Wm *w, XButtonEvent *e);
 
@@ -110,6 +122,9 @@ wm_find_client(Wm *w, Window win, int mode);
 Client *
 wm_make_new_client(Wm *w, Window win);
 
+void
+wm_manage_client(Wm *w, Client *c);
+
 void    
 wm_remove_client(Wm *w, Client *c);
 
@@ -120,7 +135,7 @@ void
 wm_lowlight(Wm *w, Client *c);
 
 void 
-wm_update_layout(Wm *w, Client *c, signed int amount);
+wm_update_layout(Wm *w, int output);
 
 int 
 wm_get_offsets_size(Wm*     w, 
@@ -129,12 +144,29 @@ wm_get_offsets_size(Wm*     w,
 		    Bool    include_toolbars
 		    );
 
+int 
+wm_get_output_offsets_size(Wm*     w, 
+			   int     output,
+			   int     wanted_direction,
+			   Client* ignore_client, 
+			   Bool    include_toolbars
+			   );
+
+int
+wm_output_at(Wm *w, int x, int y);
+
+void
+wm_offsets_invalidate(Wm *w);
+
 void 
 wm_set_cursor_visibility(Wm *w, Bool visible);
 
 Client * 			/* Returns either desktop or main app client */
 wm_get_visible_main_client(Wm *w);
 
+Client *
+wm_get_output_visible_main_client(Wm *w, int output);
+
 void 
 wm_toggle_desktop(Wm *w);
 